@@ -130,6 +130,15 @@ Result BinaryReaderLogging::BeginSection(Index section_index,
   return reader_->BeginSection(section_index, section_type, size);
 }
 
+bool BinaryReaderLogging::SkipSection(Index section_index,
+                                      BinarySection section_type) {
+  return reader_->SkipSection(section_index, section_type);
+}
+
+bool BinaryReaderLogging::SkipFunctionBody(Index index) {
+  return reader_->SkipFunctionBody(index);
+}
+
 Result BinaryReaderLogging::BeginCustomSection(Index section_index,
                                                Offset size,
                                                std::string_view section_name) {
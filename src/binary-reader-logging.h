@@ -36,6 +36,7 @@ class BinaryReaderLogging : public BinaryReaderDelegate {
   Result BeginSection(Index section_index,
                       BinarySection section_type,
                       Offset size) override;
+  bool SkipSection(Index section_index, BinarySection section_type) override;
 
   Result BeginCustomSection(Index section_index,
                             Offset size,
@@ -127,6 +128,7 @@ class BinaryReaderLogging : public BinaryReaderDelegate {
 
   Result BeginCodeSection(Offset size) override;
   Result OnFunctionBodyCount(Index count) override;
+  bool SkipFunctionBody(Index index) override;
   Result BeginFunctionBody(Index index, Offset size) override;
   Result OnLocalDeclCount(Index count) override;
   Result OnLocalDecl(Index decl_index, Index count, Type type) override;
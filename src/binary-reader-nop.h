@@ -34,6 +34,9 @@ class BinaryReaderNop : public BinaryReaderDelegate {
                       Offset size) override {
     return Result::Ok;
   }
+  bool SkipSection(Index section_index, BinarySection section_type) override {
+    return false;
+  }
 
   /* Custom section */
   Result BeginCustomSection(Index section_index,
@@ -165,6 +168,7 @@ class BinaryReaderNop : public BinaryReaderDelegate {
   /* Code section */
   Result BeginCodeSection(Offset size) override { return Result::Ok; }
   Result OnFunctionBodyCount(Index count) override { return Result::Ok; }
+  bool SkipFunctionBody(Index index) override { return false; }
   Result BeginFunctionBody(Index index, Offset size) override {
     return Result::Ok;
   }
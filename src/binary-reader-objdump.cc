@@ -17,10 +17,14 @@
 #include "src/binary-reader-objdump.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #if HAVE_STRCASECMP
@@ -29,6 +33,7 @@
 
 #include "src/binary-reader-nop.h"
 #include "src/filenames.h"
+#include "src/leb128.h"
 #include "src/literal.h"
 #include "src/string-util.h"
 
@@ -36,6 +41,32 @@ namespace wabt {
 
 namespace {
 
+// The Import, Function, Memory, Code and DataCount sections are needed by the
+// BinaryReader itself to number functions and to read the code section, so
+// they are decoded by every pass.
+bool IsRequiredSection(BinarySection section_code) {
+  switch (section_code) {
+    case BinarySection::Import:
+    case BinarySection::Function:
+    case BinarySection::Memory:
+    case BinarySection::Code:
+    case BinarySection::DataCount:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool SectionMatches(const ObjdumpOptions* options,
+                    const ObjdumpState* state,
+                    Index section_index) {
+  if (!options->section_name) {
+    return true;
+  }
+  std::string match_name(state->section_names.Get(section_index));
+  return !strcasecmp(options->section_name, match_name.c_str());
+}
+
 class BinaryReaderObjdumpBase : public BinaryReaderNop {
  public:
   BinaryReaderObjdumpBase(const uint8_t* data,
@@ -49,11 +80,13 @@ class BinaryReaderObjdumpBase : public BinaryReaderNop {
   Result BeginSection(Index section_index,
                       BinarySection section_type,
                       Offset size) override;
+  bool SkipSection(Index section_index, BinarySection section_type) override;
 
   Result OnOpcode(Opcode Opcode) override;
   Result OnRelocCount(Index count, Index section_index) override;
 
  protected:
+  bool NeedsSection(Index section_index, BinarySection section_code) const;
   std::string_view GetTypeName(Index index) const;
   std::string_view GetFunctionName(Index index) const;
   std::string_view GetGlobalName(Index index) const;
@@ -63,7 +96,7 @@ class BinaryReaderObjdumpBase : public BinaryReaderNop {
   std::string_view GetSymbolName(Index index) const;
   std::string_view GetSegmentName(Index index) const;
   std::string_view GetTableName(Index index) const;
-  void PrintRelocation(const Reloc& reloc, Offset offset) const;
+  void PrintRelocation(Stream* stream, const Reloc& reloc, Offset offset) const;
   Offset GetPrintOffset(Offset offset) const;
   Offset GetSectionStart(BinarySection section_code) const {
     return section_starts_[static_cast<size_t>(section_code)];
@@ -105,27 +138,70 @@ Result BinaryReaderObjdumpBase::BeginSection(Index section_index,
   return Result::Ok;
 }
 
-bool BinaryReaderObjdumpBase::OnError(const Error&) {
-  // Tell the BinaryReader that this error is "handled" for all passes other
-  // than the prepass. When the error is handled the default message will be
-  // suppressed.
-  return options_->mode != ObjdumpMode::Prepass;
+bool BinaryReaderObjdumpBase::SkipSection(Index section_index,
+                                          BinarySection section_code) {
+  if (section_index >= objdump_state_->sections.size()) {
+    return false;
+  }
+  if (!IsRequiredSection(section_code) &&
+      !NeedsSection(section_index, section_code)) {
+    return true;
+  }
+  ObjdumpSection& section = objdump_state_->sections[section_index];
+  if (!section.decoded) {
+    section.decoded = true;
+    section.decoded_by = options_->mode;
+  }
+  return false;
 }
 
-Result BinaryReaderObjdumpBase::BeginModule(uint32_t version) {
+bool BinaryReaderObjdumpBase::NeedsSection(Index section_index,
+                                           BinarySection section_code) const {
+  std::string_view name = GetSectionName(section_index);
   switch (options_->mode) {
+    case ObjdumpMode::Prepass:
+      // Function parameter counts and relocations.
+      return section_code == BinarySection::Type ||
+             (section_code == BinarySection::Custom &&
+              name.rfind(WABT_BINARY_SECTION_RELOC, 0) == 0);
+    case ObjdumpMode::Names:
+      return section_code == BinarySection::Export ||
+             (section_code == BinarySection::Custom &&
+              (name == WABT_BINARY_SECTION_NAME ||
+               name == WABT_BINARY_SECTION_LINKING));
+    case ObjdumpMode::Details:
+      return SectionMatches(options_, objdump_state_, section_index);
     case ObjdumpMode::Headers:
-      printf("\n");
-      printf("Sections:\n\n");
+    case ObjdumpMode::Disassemble:
+    case ObjdumpMode::RawData:
       break;
+  }
+  return false;
+}
+
+bool BinaryReaderObjdumpBase::OnError(const Error& error) {
+  // Tell the BinaryReader that this error is "handled" unless this is the
+  // prepass, or the first pass to decode the section the error is in. When the
+  // error is handled the default message will be suppressed.
+  if (options_->mode == ObjdumpMode::Prepass) {
+    return false;
+  }
+  // A failed read past the end of a section is reported at its end offset.
+  for (const ObjdumpSection& section : objdump_state_->sections) {
+    if (error.loc.offset >= section.offset &&
+        error.loc.offset <= section.offset + section.size) {
+      return !section.decoded || section.decoded_by != options_->mode;
+    }
+  }
+  return true;
+}
+
+Result BinaryReaderObjdumpBase::BeginModule(uint32_t version) {
+  switch (options_->mode) {
     case ObjdumpMode::Details:
       printf("\n");
       printf("Section Details:\n\n");
       break;
-    case ObjdumpMode::Disassemble:
-      printf("\n");
-      printf("Code Disassembly:\n\n");
-      break;
     case ObjdumpMode::Prepass: {
       std::string_view basename = GetBasename(options_->filename);
       if (basename == "-") {
@@ -133,8 +209,15 @@ Result BinaryReaderObjdumpBase::BeginModule(uint32_t version) {
       }
       printf("%s:\tfile format wasm %#x\n", std::string(basename).c_str(),
              version);
+      if (!objdump_state_->module_name.empty()) {
+        printf("module name: <" PRIstringview ">\n",
+               WABT_PRINTF_STRING_VIEW_ARG(objdump_state_->module_name));
+      }
       break;
     }
+    case ObjdumpMode::Names:
+    case ObjdumpMode::Headers:
+    case ObjdumpMode::Disassemble:
     case ObjdumpMode::RawData:
       break;
   }
@@ -198,18 +281,19 @@ std::string_view BinaryReaderObjdumpBase::GetSymbolName(
   WABT_UNREACHABLE;
 }
 
-void BinaryReaderObjdumpBase::PrintRelocation(const Reloc& reloc,
+void BinaryReaderObjdumpBase::PrintRelocation(Stream* stream,
+                                              const Reloc& reloc,
                                               Offset offset) const {
-  printf("           %06" PRIzx ": %-18s %" PRIindex, offset,
-         GetRelocTypeName(reloc.type), reloc.index);
+  stream->Writef("           %06" PRIzx ": %-18s %" PRIindex, offset,
+                 GetRelocTypeName(reloc.type), reloc.index);
   if (reloc.addend) {
-    printf(" + %d", reloc.addend);
+    stream->Writef(" + %d", reloc.addend);
   }
   if (reloc.type != RelocType::TypeIndexLEB) {
-    printf(" <" PRIstringview ">",
-           WABT_PRINTF_STRING_VIEW_ARG(GetSymbolName(reloc.index)));
+    stream->Writef(" <" PRIstringview ">",
+                   WABT_PRINTF_STRING_VIEW_ARG(GetSymbolName(reloc.index)));
   }
-  printf("\n");
+  stream->Writef("\n");
 }
 
 Offset BinaryReaderObjdumpBase::GetPrintOffset(Offset offset) const {
@@ -238,21 +322,22 @@ class BinaryReaderObjdumpPrepass : public BinaryReaderObjdumpBase {
  public:
   using BinaryReaderObjdumpBase::BinaryReaderObjdumpBase;
 
-  Result BeginSection(Index section_index,
-                      BinarySection section_code,
-                      Offset size) override {
-    BinaryReaderObjdumpBase::BeginSection(section_index, section_code, size);
-    if (section_code != BinarySection::Custom) {
-      objdump_state_->section_names.Set(section_index,
-                                        wabt::GetSectionName(section_code));
-    }
+  Result EndModule() override {
+    objdump_state_->first_function_body = first_function_body_;
+    objdump_state_->num_function_bodies = num_function_bodies_;
+    objdump_state_->function_body_offsets = std::move(function_body_offsets_);
     return Result::Ok;
   }
 
-  Result BeginCustomSection(Index section_index,
-                            Offset size,
-                            std::string_view section_name) override {
-    objdump_state_->section_names.Set(section_index, section_name);
+  bool SkipFunctionBody(Index index) override {
+    function_body_offsets_.push_back(state->offset);
+    return false;
+  }
+
+  Result BeginFunctionBody(Index index, Offset size) override {
+    if (num_function_bodies_++ == 0) {
+      first_function_body_ = index;
+    }
     return Result::Ok;
   }
 
@@ -436,14 +521,6 @@ class BinaryReaderObjdumpPrepass : public BinaryReaderObjdumpBase {
                  Index index,
                  uint32_t addend) override;
 
-  Result OnModuleName(std::string_view name) override {
-    if (options_->mode == ObjdumpMode::Prepass) {
-      printf("module name: <" PRIstringview ">\n",
-             WABT_PRINTF_STRING_VIEW_ARG(name));
-    }
-    return Result::Ok;
-  }
-
   Result OnSegmentInfo(Index index,
                        std::string_view name,
                        Address alignment_log2,
@@ -462,6 +539,10 @@ class BinaryReaderObjdumpPrepass : public BinaryReaderObjdumpBase {
   void SetTagName(Index index, std::string_view name);
   void SetTableName(Index index, std::string_view name);
   void SetSegmentName(Index index, std::string_view name);
+
+  Index first_function_body_ = 0;
+  Index num_function_bodies_ = 0;
+  std::vector<Offset> function_body_offsets_;
 };
 
 void BinaryReaderObjdumpPrepass::SetTypeName(Index index,
@@ -515,10 +596,38 @@ Result BinaryReaderObjdumpPrepass::OnReloc(RelocType type,
 
 class BinaryReaderObjdumpDisassemble : public BinaryReaderObjdumpBase {
  public:
-  using BinaryReaderObjdumpBase::BinaryReaderObjdumpBase;
+  BinaryReaderObjdumpDisassemble(const uint8_t* data,
+                                 size_t size,
+                                 ObjdumpOptions* options,
+                                 ObjdumpState* state);
 
   std::string BlockSigToString(Type type) const;
 
+  // Only disassemble the function bodies in [begin, end).
+  void SelectFunctions(Index begin, Index end) {
+    selected_functions_begin_ = begin;
+    selected_functions_end_ = end;
+  }
+
+  // Write the disassembly of the selected functions, without the heading, to
+  // |out| and |err| rather than to stdout and stderr.
+  void RedirectOutput(Stream* out, Stream* err) {
+    out_ = out;
+    err_ = err;
+    print_heading_ = false;
+  }
+
+  bool selected_functions_done() const { return selected_functions_done_; }
+
+  // Read just the selected function bodies, using the offsets found by the
+  // prepass, rather than the whole module.
+  Result ReadSelectedFunctions(const ReadBinaryOptions& read_options);
+
+  Result BeginModule(uint32_t version) override;
+  bool SkipFunctionBody(Index index) override {
+    return index < selected_functions_begin_ ||
+           index >= selected_functions_end_;
+  }
   Result BeginFunctionBody(Index index, Offset size) override;
   Result EndFunctionBody(Index index) override;
 
@@ -559,8 +668,52 @@ class BinaryReaderObjdumpDisassemble : public BinaryReaderObjdumpBase {
   Index local_index_ = 0;
   bool in_function_body = false;
   bool skip_next_opcode_ = false;
+  Index selected_functions_begin_ = 0;
+  Index selected_functions_end_ = kInvalidIndex;
+  bool selected_functions_done_ = false;
+  bool print_heading_ = true;
+  std::unique_ptr<FileStream> stdout_stream_;
+  Stream* out_;
+  Stream* err_;
 };
 
+BinaryReaderObjdumpDisassemble::BinaryReaderObjdumpDisassemble(
+    const uint8_t* data,
+    size_t size,
+    ObjdumpOptions* options,
+    ObjdumpState* objdump_state)
+    : BinaryReaderObjdumpBase(data, size, options, objdump_state),
+      stdout_stream_(FileStream::CreateStdout()),
+      out_(stdout_stream_.get()),
+      err_(err_stream_.get()) {}
+
+Result BinaryReaderObjdumpDisassemble::BeginModule(uint32_t version) {
+  if (print_heading_) {
+    out_->Writef("\n");
+    out_->Writef("Code Disassembly:\n\n");
+  }
+  return Result::Ok;
+}
+
+Result BinaryReaderObjdumpDisassemble::ReadSelectedFunctions(
+    const ReadBinaryOptions& read_options) {
+  for (const ObjdumpSection& section : objdump_state_->sections) {
+    if (section.code == BinarySection::Code) {
+      section_starts_[static_cast<size_t>(BinarySection::Code)] =
+          section.offset;
+    }
+  }
+  Index first = objdump_state_->first_function_body;
+  for (Index index = selected_functions_begin_; index < selected_functions_end_;
+       ++index) {
+    Offset offset = objdump_state_->function_body_offsets[index - first];
+    CHECK_RESULT(ReadBinaryFunction(data_, size_, offset, index,
+                                    objdump_state_->module_state, this,
+                                    read_options));
+  }
+  return Result::Ok;
+}
+
 std::string BinaryReaderObjdumpDisassemble::BlockSigToString(Type type) const {
   if (type.IsIndex()) {
     return StringPrintf("type[%d]", type.GetIndex());
@@ -578,19 +731,17 @@ Result BinaryReaderObjdumpDisassemble::OnOpcode(Opcode opcode) {
   }
   if (options_->debug) {
     const char* opcode_name = opcode.GetName();
-    err_stream_->Writef("on_opcode: %#" PRIzx ": %s\n", state->offset,
-                        opcode_name);
+    err_->Writef("on_opcode: %#" PRIzx ": %s\n", state->offset, opcode_name);
   }
 
   if (last_opcode_end) {
     if (state->offset != last_opcode_end + opcode.GetLength()) {
       Opcode missing_opcode = Opcode::FromCode(data_[last_opcode_end]);
       const char* opcode_name = missing_opcode.GetName();
-      fprintf(stderr,
-              "error: %#" PRIzx " missing opcode callback at %#" PRIzx
-              " (%#02x=%s)\n",
-              state->offset, last_opcode_end + 1, data_[last_opcode_end],
-              opcode_name);
+      err_->Writef("error: %#" PRIzx " missing opcode callback at %#" PRIzx
+                   " (%#02x=%s)\n",
+                   state->offset, last_opcode_end + 1, data_[last_opcode_end],
+                   opcode_name);
       return Result::Error;
     }
   }
@@ -618,22 +769,22 @@ Result BinaryReaderObjdumpDisassemble::OnLocalDecl(Index decl_index,
   Offset offset = current_opcode_offset;
   size_t data_size = state->offset - offset;
 
-  printf(" %06" PRIzx ":", GetPrintOffset(offset));
+  out_->Writef(" %06" PRIzx ":", GetPrintOffset(offset));
   for (size_t i = 0; i < data_size && i < IMMEDIATE_OCTET_COUNT;
        i++, offset++) {
-    printf(" %02x", data_[offset]);
+    out_->Writef(" %02x", data_[offset]);
   }
   for (size_t i = data_size; i < IMMEDIATE_OCTET_COUNT; i++) {
-    printf("   ");
+    out_->Writef("   ");
   }
-  printf(" | local[%" PRIindex, local_index_);
+  out_->Writef(" | local[%" PRIindex, local_index_);
 
   if (count != 1) {
-    printf("..%" PRIindex "", local_index_ + count - 1);
+    out_->Writef("..%" PRIindex "", local_index_ + count - 1);
   }
   local_index_ += count;
 
-  printf("] type=%s\n", type.GetName().c_str());
+  out_->Writef("] type=%s\n", type.GetName().c_str());
 
   last_opcode_end = current_opcode_offset + data_size;
   current_opcode_offset = last_opcode_end;
@@ -662,17 +813,17 @@ void BinaryReaderObjdumpDisassemble::LogOpcode(const char* fmt, ...) {
   while (offset < offset_end) {
     // Print bytes, but only display a maximum of IMMEDIATE_OCTET_COUNT on each
     // line.
-    printf(" %06" PRIzx ":", GetPrintOffset(offset));
+    out_->Writef(" %06" PRIzx ":", GetPrintOffset(offset));
     size_t i;
     for (i = 0; offset < offset_end && i < IMMEDIATE_OCTET_COUNT;
          ++i, ++offset) {
-      printf(" %02x", data_[offset]);
+      out_->Writef(" %02x", data_[offset]);
     }
     // Fill the rest of the remaining space with spaces.
     for (; i < IMMEDIATE_OCTET_COUNT; ++i) {
-      printf("   ");
+      out_->Writef("   ");
     }
-    printf(" | ");
+    out_->Writef(" | ");
 
     if (first_line) {
       first_line = false;
@@ -688,21 +839,18 @@ void BinaryReaderObjdumpDisassemble::LogOpcode(const char* fmt, ...) {
           break;
       }
       for (int j = 0; j < indent_level; j++) {
-        printf("  ");
+        out_->Writef("  ");
       }
 
       const char* opcode_name = current_opcode.GetName();
-      printf("%s", opcode_name);
+      out_->Writef("%s", opcode_name);
       if (fmt) {
-        printf(" ");
-        va_list args;
-        va_start(args, fmt);
-        vprintf(fmt, args);
-        va_end(args);
+        WABT_SNPRINTF_ALLOCA(buffer, length, fmt);
+        out_->Writef(" %s", buffer);
       }
     }
 
-    printf("\n");
+    out_->Writef("\n");
   }
 
   last_opcode_end = state->offset;
@@ -714,7 +862,7 @@ void BinaryReaderObjdumpDisassemble::LogOpcode(const char* fmt, ...) {
     Offset code_start = GetSectionStart(BinarySection::Code);
     Offset abs_offset = code_start + reloc.offset;
     if (last_opcode_end > abs_offset) {
-      PrintRelocation(reloc, abs_offset);
+      PrintRelocation(out_, reloc, abs_offset);
       next_reloc++;
     }
   }
@@ -922,24 +1070,40 @@ Result BinaryReaderObjdumpDisassemble::OnEndExpr() {
 
 Result BinaryReaderObjdumpDisassemble::BeginFunctionBody(Index index,
                                                          Offset size) {
-  printf("%06" PRIzx " func[%" PRIindex "]", GetPrintOffset(state->offset),
-         index);
+  out_->Writef("%06" PRIzx " func[%" PRIindex "]",
+               GetPrintOffset(state->offset), index);
   auto name = GetFunctionName(index);
   if (!name.empty()) {
-    printf(" <" PRIstringview ">", WABT_PRINTF_STRING_VIEW_ARG(name));
+    out_->Writef(" <" PRIstringview ">", WABT_PRINTF_STRING_VIEW_ARG(name));
   }
-  printf(":\n");
+  out_->Writef(":\n");
 
+  // Skip the relocations of any function bodies that were not disassembled.
+  Offset code_start = GetSectionStart(BinarySection::Code);
+  while (next_reloc < objdump_state_->code_relocations.size() &&
+         code_start + objdump_state_->code_relocations[next_reloc].offset <
+             state->offset) {
+    next_reloc++;
+  }
+
+  // Each function body is disassembled independently of the others, so that
+  // they can also be disassembled in parallel.
   last_opcode_end = 0;
+  indent_level = 0;
   in_function_body = true;
   current_function_index = index;
-  local_index_ = objdump_state_->function_param_counts[index];
+  auto iter = objdump_state_->function_param_counts.find(index);
+  local_index_ =
+      iter != objdump_state_->function_param_counts.end() ? iter->second : 0;
   return Result::Ok;
 }
 
 Result BinaryReaderObjdumpDisassemble::EndFunctionBody(Index index) {
   assert(in_function_body);
   in_function_body = false;
+  if (index + 1 == selected_functions_end_) {
+    selected_functions_done_ = true;
+  }
   return Result::Ok;
 }
 
@@ -1235,10 +1399,6 @@ Result BinaryReaderObjdump::BeginCustomSection(Index section_index,
                                                std::string_view section_name) {
   PrintDetails(" - name: \"" PRIstringview "\"\n",
                WABT_PRINTF_STRING_VIEW_ARG(section_name));
-  if (options_->mode == ObjdumpMode::Headers) {
-    printf("\"" PRIstringview "\"\n",
-           WABT_PRINTF_STRING_VIEW_ARG(section_name));
-  }
   return Result::Ok;
 }
 
@@ -1247,24 +1407,15 @@ Result BinaryReaderObjdump::BeginSection(Index section_index,
                                          Offset size) {
   BinaryReaderObjdumpBase::BeginSection(section_index, section_code, size);
 
-  // |section_name| and |match_name| are identical for known sections. For
-  // custom sections, |section_name| is "Custom", but |match_name| is the name
-  // of the custom section.
+  // For custom sections, |section_name| is "Custom", but the name matched
+  // against is the name of the custom section.
   const char* section_name = wabt::GetSectionName(section_code);
-  std::string match_name(GetSectionName(section_index));
-
-  bool section_match = !options_->section_name ||
-                       !strcasecmp(options_->section_name, match_name.c_str());
+  bool section_match = SectionMatches(options_, objdump_state_, section_index);
   if (section_match) {
     section_found_ = true;
   }
 
   switch (options_->mode) {
-    case ObjdumpMode::Headers:
-      printf("%9s start=%#010" PRIzx " end=%#010" PRIzx " (size=%#010" PRIoffset
-             ") ",
-             section_name, state->offset, state->offset + size, size);
-      break;
     case ObjdumpMode::Details:
       if (section_match) {
         printf("%s", section_name);
@@ -1280,15 +1431,11 @@ Result BinaryReaderObjdump::BeginSection(Index section_index,
         print_details_ = false;
       }
       break;
-    case ObjdumpMode::RawData:
-      if (section_match) {
-        printf("\nContents of section %s:\n", section_name);
-        out_stream_->WriteMemoryDump(data_ + state->offset, size, state->offset,
-                                     PrintChars::Yes);
-      }
-      break;
     case ObjdumpMode::Prepass:
+    case ObjdumpMode::Names:
+    case ObjdumpMode::Headers:
     case ObjdumpMode::Disassemble:
+    case ObjdumpMode::RawData:
       break;
   }
   return Result::Ok;
@@ -1313,9 +1460,7 @@ void WABT_PRINTF_FORMAT(2, 3) BinaryReaderObjdump::PrintDetails(const char* fmt,
 }
 
 Result BinaryReaderObjdump::OnCount(Index count) {
-  if (options_->mode == ObjdumpMode::Headers) {
-    printf("count: %" PRIindex "\n", count);
-  } else if (options_->mode == ObjdumpMode::Details && print_details_) {
+  if (ShouldPrintDetails()) {
     printf("[%" PRIindex "]:\n", count);
   }
   return Result::Ok;
@@ -1333,7 +1478,7 @@ Result BinaryReaderObjdump::EndModule() {
       for (size_t i = next_data_reloc_;
            i < objdump_state_->data_relocations.size(); i++) {
         const Reloc& reloc = objdump_state_->data_relocations[i];
-        PrintRelocation(reloc, reloc.offset);
+        PrintRelocation(out_stream_.get(), reloc, reloc.offset);
       }
 
       return Result::Error;
@@ -1450,25 +1595,17 @@ Result BinaryReaderObjdump::BeginFunctionBody(Index index, Offset size) {
 }
 
 Result BinaryReaderObjdump::OnStartFunction(Index func_index) {
-  if (options_->mode == ObjdumpMode::Headers) {
-    printf("start: %" PRIindex "\n", func_index);
-  } else {
-    PrintDetails(" - start function: %" PRIindex, func_index);
-    auto name = GetFunctionName(func_index);
-    if (!name.empty()) {
-      PrintDetails(" <" PRIstringview ">", WABT_PRINTF_STRING_VIEW_ARG(name));
-    }
-    PrintDetails("\n");
+  PrintDetails(" - start function: %" PRIindex, func_index);
+  auto name = GetFunctionName(func_index);
+  if (!name.empty()) {
+    PrintDetails(" <" PRIstringview ">", WABT_PRINTF_STRING_VIEW_ARG(name));
   }
+  PrintDetails("\n");
   return Result::Ok;
 }
 
 Result BinaryReaderObjdump::OnDataCount(Index count) {
-  if (options_->mode == ObjdumpMode::Headers) {
-    printf("count: %" PRIindex "\n", count);
-  } else {
-    PrintDetails(" - data count: %" PRIindex "\n", count);
-  }
+  PrintDetails(" - data count: %" PRIindex "\n", count);
   return Result::Ok;
 }
 
@@ -1956,7 +2093,8 @@ Result BinaryReaderObjdump::OnDataSegmentData(Index index,
     if (abs_offset > state->offset) {
       break;
     }
-    PrintRelocation(reloc, reloc.offset - segment_offset + data_offset_);
+    PrintRelocation(out_stream_.get(), reloc,
+                    reloc.offset - segment_offset + data_offset_);
     next_data_reloc_++;
   }
 
@@ -2312,6 +2450,286 @@ Result BinaryReaderObjdump::OnCodeMetadata(Offset code_offset,
   return Result::Ok;
 }
 
+// Builds the section index from the section headers alone. Like ReadBinary,
+// this stops at the first section header that is invalid or out of order, so
+// the index covers exactly the sections that each pass will visit. The module
+// name is read here too, since it is always printed but the rest of the name
+// section is only needed by some passes.
+void ReadSectionIndex(const uint8_t* data, size_t size, ObjdumpState* state) {
+  const uint8_t* end = data + size;
+  uint32_t magic;
+  uint32_t version;
+  if (size < sizeof(magic) + sizeof(version)) {
+    return;
+  }
+  memcpy(&magic, data, sizeof(magic));
+  memcpy(&version, data + sizeof(magic), sizeof(version));
+  if (magic != WABT_BINARY_MAGIC || version != WABT_BINARY_VERSION) {
+    return;
+  }
+
+  bool seen_section_code[kBinarySectionCount] = {false};
+  BinarySection last_known_section = BinarySection::Invalid;
+  bool seen_names_section = false;
+  const uint8_t* p = data + sizeof(magic) + sizeof(version);
+  while (p < end) {
+    uint8_t section_code = *p++;
+    uint32_t section_size;
+    size_t length = ReadU32Leb128(p, end, &section_size);
+    if (length == 0 || section_code >= kBinarySectionCount) {
+      break;
+    }
+    p += length;
+    if (section_size > static_cast<size_t>(end - p)) {
+      break;
+    }
+
+    BinarySection section = static_cast<BinarySection>(section_code);
+    if (section != BinarySection::Custom) {
+      if (seen_section_code[section_code] || seen_names_section ||
+          (last_known_section != BinarySection::Invalid &&
+           GetSectionOrder(section) <= GetSectionOrder(last_known_section))) {
+        break;
+      }
+      seen_section_code[section_code] = true;
+      last_known_section = section;
+    }
+
+    ObjdumpSection entry;
+    entry.code = section;
+    entry.offset = p - data;
+    entry.size = section_size;
+    entry.count = kInvalidIndex;
+    const uint8_t* contents = p;
+    const uint8_t* contents_end = p + section_size;
+    uint32_t value;
+    if (section == BinarySection::Custom) {
+      length = ReadU32Leb128(contents, contents_end, &value);
+      if (length != 0 && value <= static_cast<size_t>(contents_end - contents -
+                                                      length)) {
+        contents += length;
+        entry.name.assign(reinterpret_cast<const char*>(contents), value);
+        contents += value;
+      }
+      if (entry.name == WABT_BINARY_SECTION_NAME) {
+        seen_names_section = true;
+        // The module name must be the first subsection, if present.
+        uint32_t subsection_size;
+        if (contents < contents_end &&
+            *contents == static_cast<uint8_t>(NameSectionSubsection::Module) &&
+            (length = ReadU32Leb128(contents + 1, contents_end,
+                                    &subsection_size)) != 0) {
+          contents += 1 + length;
+          length = ReadU32Leb128(contents, contents_end, &value);
+          if (length != 0 && value <= static_cast<size_t>(contents_end -
+                                                          contents - length)) {
+            state->module_name.assign(
+                reinterpret_cast<const char*>(contents + length), value);
+          }
+        }
+      }
+      state->section_names.Set(state->sections.size(), entry.name);
+    } else {
+      if (ReadU32Leb128(contents, contents_end, &value) != 0) {
+        entry.count = value;
+      }
+      state->section_names.Set(state->sections.size(),
+                               wabt::GetSectionName(section));
+    }
+    state->sections.push_back(std::move(entry));
+    p += section_size;
+  }
+}
+
+Result EndSectionIndexDump(const ObjdumpOptions* options, bool section_found) {
+  if (options->section_name && !section_found) {
+    fprintf(stderr, "Section not found: %s\n", options->section_name);
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+// Headers and raw contents are printed straight from the section index, so no
+// section contents need to be decoded at all.
+Result PrintSectionHeaders(const ObjdumpOptions* options,
+                           const ObjdumpState* state) {
+  printf("\n");
+  printf("Sections:\n\n");
+  bool section_found = false;
+  for (Index i = 0; i < state->sections.size(); ++i) {
+    const ObjdumpSection& section = state->sections[i];
+    if (SectionMatches(options, state, i)) {
+      section_found = true;
+    }
+    printf("%9s start=%#010" PRIzx " end=%#010" PRIzx " (size=%#010" PRIoffset
+           ") ",
+           wabt::GetSectionName(section.code), section.offset,
+           section.offset + section.size, section.size);
+    if (section.code == BinarySection::Custom) {
+      printf("\"" PRIstringview "\"\n",
+             WABT_PRINTF_STRING_VIEW_ARG(section.name));
+    } else if (section.count != kInvalidIndex) {
+      printf("%s: %" PRIindex "\n",
+             section.code == BinarySection::Start ? "start" : "count",
+             section.count);
+    }
+  }
+  return EndSectionIndexDump(options, section_found);
+}
+
+Result PrintSectionContents(const uint8_t* data,
+                            const ObjdumpOptions* options,
+                            const ObjdumpState* state) {
+  std::unique_ptr<FileStream> out_stream = FileStream::CreateStdout();
+  bool section_found = false;
+  for (Index i = 0; i < state->sections.size(); ++i) {
+    const ObjdumpSection& section = state->sections[i];
+    if (SectionMatches(options, state, i)) {
+      section_found = true;
+      printf("\nContents of section %s:\n",
+             wabt::GetSectionName(section.code));
+      out_stream->WriteMemoryDump(data + section.offset, section.size,
+                                  section.offset, PrintChars::Yes);
+    }
+  }
+  return EndSectionIndexDump(options, section_found);
+}
+
+Result FindFunction(const char* function_name,
+                    const ObjdumpState* state,
+                    Index* out_index) {
+  uint32_t index;
+  bool found = false;
+  if (Succeeded(ParseInt32(function_name, function_name + strlen(function_name),
+                           &index, ParseIntType::UnsignedOnly))) {
+    found = true;
+  } else {
+    for (const auto& [name_index, name] : state->function_names.names) {
+      if (name == function_name) {
+        index = name_index;
+        found = true;
+        break;
+      }
+    }
+  }
+  // Only defined functions have a body to disassemble.
+  if (found && state->num_function_bodies > 0 &&
+      index < state->first_function_body) {
+    fprintf(stderr, "Function is imported: %s\n", function_name);
+    return Result::Error;
+  }
+  if (!found ||
+      index >= state->first_function_body + state->num_function_bodies) {
+    fprintf(stderr, "Function not found: %s\n", function_name);
+    return Result::Error;
+  }
+  *out_index = index;
+  return Result::Ok;
+}
+
+// Disassembles the function bodies in chunks on several threads. Each chunk is
+// written to its own buffers, which are written out in order, so the output is
+// identical to that of disassembling sequentially.
+Result DisassembleInParallel(const uint8_t* data,
+                             size_t size,
+                             ObjdumpOptions* options,
+                             ObjdumpState* state,
+                             const ReadBinaryOptions& read_options) {
+  struct Chunk {
+    Index begin;
+    Index end;
+    MemoryStream out;
+    MemoryStream err;
+    Result result = Result::Ok;
+    bool complete = false;
+    bool done = false;
+  };
+
+  // Use a few chunks per thread, so the threads stay busy even if some
+  // function bodies are much larger than others.
+  const Index kChunksPerThread = 4;
+  Index num_threads = options->num_threads;
+  Index max_threads = std::thread::hardware_concurrency();
+  if (max_threads != 0) {
+    num_threads = std::min(num_threads, max_threads);
+  }
+  Index begin = state->first_function_body;
+  Index end = begin + state->num_function_bodies;
+  Index num_chunks =
+      std::min(state->num_function_bodies, num_threads * kChunksPerThread);
+  Index chunk_size = (state->num_function_bodies + num_chunks - 1) / num_chunks;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  for (Index index = begin; index < end; index += chunk_size) {
+    auto chunk = std::make_unique<Chunk>();
+    chunk->begin = index;
+    chunk->end = std::min(index + chunk_size, end);
+    chunks.push_back(std::move(chunk));
+  }
+
+  // The workers only read the function bodies, so mark the sections that a
+  // sequential pass would have decoded here, before they start, rather than
+  // from each worker.
+  for (ObjdumpSection& section : state->sections) {
+    if (IsRequiredSection(section.code) && !section.decoded) {
+      section.decoded = true;
+      section.decoded_by = options->mode;
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable chunk_done;
+  std::atomic<size_t> next_chunk{0};
+  std::atomic<bool> cancelled{false};
+  auto run_chunks = [&]() {
+    size_t i;
+    while (!cancelled && (i = next_chunk++) < chunks.size()) {
+      Chunk& chunk = *chunks[i];
+      BinaryReaderObjdumpDisassemble reader(data, size, options, state);
+      reader.SelectFunctions(chunk.begin, chunk.end);
+      reader.RedirectOutput(&chunk.out, &chunk.err);
+      Result result = reader.ReadSelectedFunctions(read_options);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      chunk.result = result;
+      chunk.complete = reader.selected_functions_done();
+      chunk.done = true;
+      chunk_done.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (Index i = 0; i < num_threads; ++i) {
+    threads.emplace_back(run_chunks);
+  }
+
+  printf("\n");
+  printf("Code Disassembly:\n\n");
+  Result result = Result::Ok;
+  for (std::unique_ptr<Chunk>& chunk : chunks) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      chunk_done.wait(lock, [&chunk]() { return chunk->done; });
+    }
+    const std::vector<uint8_t>& out = chunk->out.output_buffer().data;
+    const std::vector<uint8_t>& err = chunk->err.output_buffer().data;
+    fwrite(out.data(), 1, out.size(), stdout);
+    fwrite(err.data(), 1, err.size(), stderr);
+    chunk->out.Clear();
+    chunk->err.Clear();
+    result |= chunk->result;
+    if (!chunk->complete) {
+      // Disassembling sequentially would have stopped in this chunk too.
+      cancelled = true;
+      break;
+    }
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return result;
+}
+
 }  // end anonymous namespace
 
 std::string_view ObjdumpNames::Get(Index index) const {
@@ -2352,14 +2770,32 @@ Result ReadBinaryObjdump(const uint8_t* data,
   ReadBinaryOptions read_options(features, options->log_stream, kReadDebugNames,
                                  kStopOnFirstError, kFailOnCustomSectionError);
 
+  if (options->mode == ObjdumpMode::Prepass) {
+    ReadSectionIndex(data, size, state);
+  }
+
   switch (options->mode) {
-    case ObjdumpMode::Prepass: {
+    case ObjdumpMode::Prepass:
+    case ObjdumpMode::Names: {
       read_options.skip_function_bodies = true;
       BinaryReaderObjdumpPrepass reader(data, size, options, state);
-      return ReadBinary(data, size, &reader, read_options);
+      return ReadBinary(data, size, &reader, read_options,
+                        &state->module_state);
     }
+    case ObjdumpMode::Headers:
+      return PrintSectionHeaders(options, state);
+    case ObjdumpMode::RawData:
+      return PrintSectionContents(data, options, state);
     case ObjdumpMode::Disassemble: {
       BinaryReaderObjdumpDisassemble reader(data, size, options, state);
+      if (options->function_name) {
+        Index function_index;
+        CHECK_RESULT(
+            FindFunction(options->function_name, state, &function_index));
+        reader.SelectFunctions(function_index, function_index + 1);
+      } else if (options->num_threads > 1 && state->num_function_bodies > 1) {
+        return DisassembleInParallel(data, size, options, state, read_options);
+      }
       return ReadBinary(data, size, &reader, read_options);
     }
     default: {
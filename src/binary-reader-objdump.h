@@ -20,6 +20,8 @@
 #include <map>
 #include <string>
 
+#include "src/binary-reader.h"
+#include "src/binary.h"
 #include "src/common.h"
 #include "src/feature.h"
 #include "src/stream.h"
@@ -31,6 +33,7 @@ struct ReadBinaryOptions;
 
 enum class ObjdumpMode {
   Prepass,
+  Names,
   Headers,
   Details,
   Disassemble,
@@ -49,6 +52,8 @@ struct ObjdumpOptions {
   ObjdumpMode mode;
   const char* filename;
   const char* section_name;
+  const char* function_name;
+  int num_threads;
 };
 
 struct ObjdumpSymbol {
@@ -71,9 +76,24 @@ struct ObjdumpLocalNames {
   std::map<std::pair<Index, Index>, std::string> names;
 };
 
+// An entry of the section index, which is built from the section headers
+// alone so that each pass only has to decode the sections it needs.
+struct ObjdumpSection {
+  BinarySection code;
+  std::string name;  // Only set for custom sections.
+  Offset offset;     // Start of the contents, just after the section size.
+  Offset size;
+  Index count;  // The leading count (or start function), or kInvalidIndex.
+  // Errors in a section are only reported by the first pass that decodes it.
+  bool decoded = false;
+  ObjdumpMode decoded_by = ObjdumpMode::Prepass;
+};
+
 // read_binary_objdump uses this state to store information from previous runs
 // and use it to display more useful information.
 struct ObjdumpState {
+  std::vector<ObjdumpSection> sections;
+  std::string module_name;
   std::vector<Reloc> code_relocations;
   std::vector<Reloc> data_relocations;
   ObjdumpNames type_names;
@@ -86,6 +106,13 @@ struct ObjdumpState {
   ObjdumpLocalNames local_names;
   std::vector<ObjdumpSymbol> symtab;
   std::map<Index, Index> function_param_counts;
+  // The function bodies, as found by the prepass. Only set if the prepass
+  // read the whole module.
+  Index first_function_body = 0;
+  Index num_function_bodies = 0;
+  // The offset of each function body, for ReadBinaryFunction.
+  std::vector<Offset> function_body_offsets;
+  BinaryReaderModuleState module_state;
 };
 
 Result ReadBinaryObjdump(const uint8_t* data,
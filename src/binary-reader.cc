@@ -72,6 +72,10 @@ class BinaryReader {
                const ReadBinaryOptions& options);
 
   Result ReadModule();
+  Result ReadFunctionAt(Offset offset,
+                        Index func_index,
+                        const BinaryReaderModuleState& module_state);
+  void GetModuleState(BinaryReaderModuleState* out_state) const;
 
  private:
   template <typename T, T BinaryReader::*member>
@@ -128,6 +132,7 @@ class BinaryReader {
   Result ReadAddress(Address* out_value,
                      Index memory,
                      const char* desc) WABT_WARN_UNUSED;
+  Result ReadFunction(Index func_index) WABT_WARN_UNUSED;
   Result ReadFunctionBody(Offset end_offset) WABT_WARN_UNUSED;
   // ReadInstructions either until and END instruction, or until
   // the given end_offset.
@@ -2693,42 +2698,66 @@ Result BinaryReader::ReadCodeSection(Offset section_size) {
   CALLBACK(OnFunctionBodyCount, num_function_bodies_);
   for (Index i = 0; i < num_function_bodies_; ++i) {
     Index func_index = num_func_imports_ + i;
-    Offset func_offset = state_.offset;
-    state_.offset = func_offset;
-    uint32_t body_size;
-    CHECK_RESULT(ReadU32Leb128(&body_size, "function body size"));
-    Offset body_start_offset = state_.offset;
-    Offset end_offset = body_start_offset + body_size;
-    CALLBACK(BeginFunctionBody, func_index, body_size);
-
-    uint64_t total_locals = 0;
-    Index num_local_decls;
-    CHECK_RESULT(ReadCount(&num_local_decls, "local declaration count"));
-    CALLBACK(OnLocalDeclCount, num_local_decls);
-    for (Index k = 0; k < num_local_decls; ++k) {
-      Index num_local_types;
-      CHECK_RESULT(ReadIndex(&num_local_types, "local type count"));
-      total_locals += num_local_types;
-      ERROR_UNLESS(total_locals < UINT32_MAX,
-                   "local count must be < 0x10000000");
-      Type local_type;
-      CHECK_RESULT(ReadType(&local_type, "local type"));
-      ERROR_UNLESS(IsConcreteType(local_type), "expected valid local type");
-      CALLBACK(OnLocalDecl, k, num_local_types, local_type);
+    if (delegate_->SkipFunctionBody(func_index)) {
+      uint32_t body_size;
+      CHECK_RESULT(ReadU32Leb128(&body_size, "function body size"));
+      state_.offset += body_size;
+      continue;
     }
+    CHECK_RESULT(ReadFunction(func_index));
+  }
+  CALLBACK0(EndCodeSection);
+  return Result::Ok;
+}
 
-    if (options_.skip_function_bodies) {
-      state_.offset = end_offset;
-    } else {
-      CHECK_RESULT(ReadFunctionBody(end_offset));
-    }
+Result BinaryReader::ReadFunction(Index func_index) {
+  uint32_t body_size;
+  CHECK_RESULT(ReadU32Leb128(&body_size, "function body size"));
+  Offset body_start_offset = state_.offset;
+  Offset end_offset = body_start_offset + body_size;
+  CALLBACK(BeginFunctionBody, func_index, body_size);
+
+  uint64_t total_locals = 0;
+  Index num_local_decls;
+  CHECK_RESULT(ReadCount(&num_local_decls, "local declaration count"));
+  CALLBACK(OnLocalDeclCount, num_local_decls);
+  for (Index k = 0; k < num_local_decls; ++k) {
+    Index num_local_types;
+    CHECK_RESULT(ReadIndex(&num_local_types, "local type count"));
+    total_locals += num_local_types;
+    ERROR_UNLESS(total_locals < UINT32_MAX,
+                 "local count must be < 0x10000000");
+    Type local_type;
+    CHECK_RESULT(ReadType(&local_type, "local type"));
+    ERROR_UNLESS(IsConcreteType(local_type), "expected valid local type");
+    CALLBACK(OnLocalDecl, k, num_local_types, local_type);
+  }
 
-    CALLBACK(EndFunctionBody, func_index);
+  if (options_.skip_function_bodies) {
+    state_.offset = end_offset;
+  } else {
+    CHECK_RESULT(ReadFunctionBody(end_offset));
   }
-  CALLBACK0(EndCodeSection);
+
+  CALLBACK(EndFunctionBody, func_index);
   return Result::Ok;
 }
 
+Result BinaryReader::ReadFunctionAt(
+    Offset offset,
+    Index func_index,
+    const BinaryReaderModuleState& module_state) {
+  state_.offset = offset;
+  data_count_ = module_state.data_count;
+  memories = module_state.memories;
+  return ReadFunction(func_index);
+}
+
+void BinaryReader::GetModuleState(BinaryReaderModuleState* out_state) const {
+  out_state->data_count = data_count_;
+  out_state->memories = memories;
+}
+
 Result BinaryReader::ReadDataSection(Offset section_size) {
   CALLBACK(BeginDataSection, section_size);
   Index num_data_segments;
@@ -2816,6 +2845,14 @@ Result BinaryReader::ReadSections() {
 
     CALLBACK(BeginSection, section_index, section, section_size);
 
+    if (delegate_->SkipSection(section_index, section)) {
+      state_.offset = read_end_;
+      if (section != BinarySection::Custom) {
+        last_known_section_ = section;
+      }
+      continue;
+    }
+
     bool stop_on_first_error = options_.stop_on_first_error;
     Result section_result = Result::Error;
     switch (section) {
@@ -2940,9 +2977,25 @@ Result BinaryReader::ReadModule() {
 Result ReadBinary(const void* data,
                   size_t size,
                   BinaryReaderDelegate* delegate,
-                  const ReadBinaryOptions& options) {
+                  const ReadBinaryOptions& options,
+                  BinaryReaderModuleState* out_state) {
+  BinaryReader reader(data, size, delegate, options);
+  Result result = reader.ReadModule();
+  if (out_state) {
+    reader.GetModuleState(out_state);
+  }
+  return result;
+}
+
+Result ReadBinaryFunction(const void* data,
+                          size_t size,
+                          Offset offset,
+                          Index func_index,
+                          const BinaryReaderModuleState& module_state,
+                          BinaryReaderDelegate* delegate,
+                          const ReadBinaryOptions& options) {
   BinaryReader reader(data, size, delegate, options);
-  return reader.ReadModule();
+  return reader.ReadFunctionAt(offset, func_index, module_state);
 }
 
 }  // namespace wabt
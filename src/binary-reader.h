@@ -83,6 +83,12 @@ class BinaryReaderDelegate {
                               BinarySection section_type,
                               Offset size) = 0;
 
+  // Called after BeginSection. Return true to skip the contents of the
+  // section; no other callbacks are made for it. Skipping a section that later
+  // sections depend on (e.g. the Import or Function section) can cause
+  // spurious errors.
+  virtual bool SkipSection(Index section_index, BinarySection section_type) = 0;
+
   /* Custom section */
   virtual Result BeginCustomSection(Index section_index,
                                     Offset size,
@@ -185,6 +191,10 @@ class BinaryReaderDelegate {
   /* Code section */
   virtual Result BeginCodeSection(Offset size) = 0;
   virtual Result OnFunctionBodyCount(Index count) = 0;
+  // Return true to skip a function body; no callbacks are made for it.
+  // state->offset is the offset of the body, i.e. of its size, which can be
+  // passed to ReadBinaryFunction to read the body later.
+  virtual bool SkipFunctionBody(Index index) = 0;
   virtual Result BeginFunctionBody(Index index, Offset size) = 0;
   virtual Result OnLocalDeclCount(Index count) = 0;
   virtual Result OnLocalDecl(Index decl_index, Index count, Type type) = 0;
@@ -475,10 +485,32 @@ class BinaryReaderDelegate {
   const State* state = nullptr;
 };
 
+// The module-level state the reader itself uses to check a function body.
+struct BinaryReaderModuleState {
+  Index data_count = kInvalidIndex;  // kInvalidIndex if no DataCount section.
+  std::vector<Limits> memories;      // Includes imported and defined.
+};
+
+// If `out_state` is non-null, it is filled in with the state of the module
+// that was read, to be passed to ReadBinaryFunction.
 Result ReadBinary(const void* data,
                   size_t size,
                   BinaryReaderDelegate* reader,
-                  const ReadBinaryOptions& options);
+                  const ReadBinaryOptions& options,
+                  BinaryReaderModuleState* out_state = nullptr);
+
+// Reads a single function body, starting at `offset` in the code section; see
+// BinaryReaderDelegate::SkipFunctionBody. The delegate is called from
+// BeginFunctionBody to EndFunctionBody, as it would be by ReadBinary, so it
+// must already know about the rest of the module. `module_state` is the state
+// from the ReadBinary call that skipped the body.
+Result ReadBinaryFunction(const void* data,
+                          size_t size,
+                          Offset offset,
+                          Index func_index,
+                          const BinaryReaderModuleState& module_state,
+                          BinaryReaderDelegate* reader,
+                          const ReadBinaryOptions& options);
 
 size_t ReadU32Leb128(const uint8_t* ptr,
                      const uint8_t* end,
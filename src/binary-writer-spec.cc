@@ -28,6 +28,7 @@
 #include "src/filenames.h"
 #include "src/ir.h"
 #include "src/literal.h"
+#include "src/make-unique.h"
 #include "src/stream.h"
 
 namespace wabt {
@@ -44,6 +45,10 @@ class BinaryWriterSpec {
 
   Result WriteScript(const Script& script);
 
+  void BeginCommands();
+  void WriteCommand(const Script& script, Index command_index);
+  Result EndCommands();
+
  private:
   std::string GetModuleFilename(const char* extension);
   void WriteString(const char* s);
@@ -65,7 +70,6 @@ class BinaryWriterSpec {
   void WriteScriptModule(std::string_view filename,
                          const ScriptModule& script_module);
   void WriteInvalidModule(const ScriptModule& module, std::string_view text);
-  void WriteCommands();
 
   const Script* script_ = nullptr;
   Stream* json_stream_ = nullptr;
@@ -75,6 +79,7 @@ class BinaryWriterSpec {
   const WriteBinaryOptions& options_;
   Result result_ = Result::Ok;
   size_t num_modules_ = 0;
+  Index last_module_index_ = kInvalidIndex;
 };
 
 BinaryWriterSpec::BinaryWriterSpec(
@@ -441,172 +446,210 @@ void BinaryWriterSpec::WriteInvalidModule(const ScriptModule& module,
   WriteScriptModule(filename, module);
 }
 
-void BinaryWriterSpec::WriteCommands() {
+void BinaryWriterSpec::BeginCommands() {
   json_stream_->Writef("{\"source_filename\": ");
   WriteEscapedString(source_filename_);
   json_stream_->Writef(",\n \"commands\": [\n");
-  Index last_module_index = kInvalidIndex;
-  for (size_t i = 0; i < script_->commands.size(); ++i) {
-    const Command* command = script_->commands[i].get();
+}
 
-    if (i != 0) {
-      WriteSeparator();
-      json_stream_->Writef("\n");
-    }
+void BinaryWriterSpec::WriteCommand(const Script& script, Index i) {
+  script_ = &script;
+  const Command* command = script_->commands[i].get();
 
-    json_stream_->Writef("  {");
-    WriteCommandType(*command);
+  if (i != 0) {
     WriteSeparator();
+    json_stream_->Writef("\n");
+  }
 
-    switch (command->type) {
-      case CommandType::Module: {
-        const Module& module = cast<ModuleCommand>(command)->module;
-        std::string filename = GetModuleFilename(kWasmExtension);
-        WriteLocation(module.loc);
-        WriteSeparator();
-        if (!module.name.empty()) {
-          WriteKey("name");
-          WriteEscapedString(module.name);
-          WriteSeparator();
-        }
-        WriteKey("filename");
-        WriteEscapedString(GetBasename(filename));
-        WriteModule(filename, module);
-        num_modules_++;
-        last_module_index = i;
-        break;
-      }
+  json_stream_->Writef("  {");
+  WriteCommandType(*command);
+  WriteSeparator();
 
-      case CommandType::Action: {
-        const Action& action = *cast<ActionCommand>(command)->action;
-        WriteLocation(action.loc);
-        WriteSeparator();
-        WriteAction(action);
+  switch (command->type) {
+    case CommandType::Module: {
+      const Module& module = cast<ModuleCommand>(command)->module;
+      std::string filename = GetModuleFilename(kWasmExtension);
+      WriteLocation(module.loc);
+      WriteSeparator();
+      if (!module.name.empty()) {
+        WriteKey("name");
+        WriteEscapedString(module.name);
         WriteSeparator();
-        WriteKey("expected");
-        WriteActionResultType(action);
-        break;
       }
+      WriteKey("filename");
+      WriteEscapedString(GetBasename(filename));
+      WriteModule(filename, module);
+      num_modules_++;
+      last_module_index_ = i;
+      break;
+    }
 
-      case CommandType::Register: {
-        auto* register_command = cast<RegisterCommand>(command);
-        const Var& var = register_command->var;
-        WriteLocation(var.loc);
-        WriteSeparator();
-        if (var.is_name()) {
-          WriteKey("name");
-          WriteVar(var);
-          WriteSeparator();
-        } else {
-          /* If we're not registering by name, then we should only be
-           * registering the last module. */
-          WABT_USE(last_module_index);
-          assert(var.index() == last_module_index);
-        }
-        WriteKey("as");
-        WriteEscapedString(register_command->module_name);
-        break;
-      }
+    case CommandType::Action: {
+      const Action& action = *cast<ActionCommand>(command)->action;
+      WriteLocation(action.loc);
+      WriteSeparator();
+      WriteAction(action);
+      WriteSeparator();
+      WriteKey("expected");
+      WriteActionResultType(action);
+      break;
+    }
 
-      case CommandType::AssertMalformed: {
-        auto* assert_malformed_command = cast<AssertMalformedCommand>(command);
-        WriteInvalidModule(*assert_malformed_command->module,
-                           assert_malformed_command->text);
-        num_modules_++;
-        break;
+    case CommandType::Register: {
+      auto* register_command = cast<RegisterCommand>(command);
+      const Var& var = register_command->var;
+      WriteLocation(var.loc);
+      WriteSeparator();
+      if (var.is_name()) {
+        WriteKey("name");
+        WriteVar(var);
+        WriteSeparator();
+      } else {
+        /* If we're not registering by name, then we should only be
+         * registering the last module. */
+        assert(var.index() == last_module_index_);
       }
+      WriteKey("as");
+      WriteEscapedString(register_command->module_name);
+      break;
+    }
 
-      case CommandType::AssertInvalid: {
-        auto* assert_invalid_command = cast<AssertInvalidCommand>(command);
-        WriteInvalidModule(*assert_invalid_command->module,
-                           assert_invalid_command->text);
-        num_modules_++;
-        break;
-      }
+    case CommandType::AssertMalformed: {
+      auto* assert_malformed_command = cast<AssertMalformedCommand>(command);
+      WriteInvalidModule(*assert_malformed_command->module,
+                         assert_malformed_command->text);
+      num_modules_++;
+      break;
+    }
 
-      case CommandType::AssertUnlinkable: {
-        auto* assert_unlinkable_command =
-            cast<AssertUnlinkableCommand>(command);
-        WriteInvalidModule(*assert_unlinkable_command->module,
-                           assert_unlinkable_command->text);
-        num_modules_++;
-        break;
-      }
+    case CommandType::AssertInvalid: {
+      auto* assert_invalid_command = cast<AssertInvalidCommand>(command);
+      WriteInvalidModule(*assert_invalid_command->module,
+                         assert_invalid_command->text);
+      num_modules_++;
+      break;
+    }
 
-      case CommandType::AssertUninstantiable: {
-        auto* assert_uninstantiable_command =
-            cast<AssertUninstantiableCommand>(command);
-        WriteInvalidModule(*assert_uninstantiable_command->module,
-                           assert_uninstantiable_command->text);
-        num_modules_++;
-        break;
-      }
+    case CommandType::AssertUnlinkable: {
+      auto* assert_unlinkable_command =
+          cast<AssertUnlinkableCommand>(command);
+      WriteInvalidModule(*assert_unlinkable_command->module,
+                         assert_unlinkable_command->text);
+      num_modules_++;
+      break;
+    }
 
-      case CommandType::AssertReturn: {
-        auto* assert_return_command = cast<AssertReturnCommand>(command);
-        WriteLocation(assert_return_command->action->loc);
-        WriteSeparator();
-        WriteAction(*assert_return_command->action);
-        WriteSeparator();
-        WriteKey("expected");
-        WriteConstVector(assert_return_command->expected);
-        break;
-      }
+    case CommandType::AssertUninstantiable: {
+      auto* assert_uninstantiable_command =
+          cast<AssertUninstantiableCommand>(command);
+      WriteInvalidModule(*assert_uninstantiable_command->module,
+                         assert_uninstantiable_command->text);
+      num_modules_++;
+      break;
+    }
 
-      case CommandType::AssertTrap: {
-        auto* assert_trap_command = cast<AssertTrapCommand>(command);
-        WriteLocation(assert_trap_command->action->loc);
-        WriteSeparator();
-        WriteAction(*assert_trap_command->action);
-        WriteSeparator();
-        WriteKey("text");
-        WriteEscapedString(assert_trap_command->text);
-        WriteSeparator();
-        WriteKey("expected");
-        WriteActionResultType(*assert_trap_command->action);
-        break;
-      }
+    case CommandType::AssertReturn: {
+      auto* assert_return_command = cast<AssertReturnCommand>(command);
+      WriteLocation(assert_return_command->action->loc);
+      WriteSeparator();
+      WriteAction(*assert_return_command->action);
+      WriteSeparator();
+      WriteKey("expected");
+      WriteConstVector(assert_return_command->expected);
+      break;
+    }
 
-      case CommandType::AssertExhaustion: {
-        auto* assert_exhaustion_command =
-            cast<AssertExhaustionCommand>(command);
-        WriteLocation(assert_exhaustion_command->action->loc);
-        WriteSeparator();
-        WriteAction(*assert_exhaustion_command->action);
-        WriteSeparator();
-        WriteKey("text");
-        WriteEscapedString(assert_exhaustion_command->text);
-        WriteSeparator();
-        WriteKey("expected");
-        WriteActionResultType(*assert_exhaustion_command->action);
-        break;
-      }
+    case CommandType::AssertTrap: {
+      auto* assert_trap_command = cast<AssertTrapCommand>(command);
+      WriteLocation(assert_trap_command->action->loc);
+      WriteSeparator();
+      WriteAction(*assert_trap_command->action);
+      WriteSeparator();
+      WriteKey("text");
+      WriteEscapedString(assert_trap_command->text);
+      WriteSeparator();
+      WriteKey("expected");
+      WriteActionResultType(*assert_trap_command->action);
+      break;
+    }
 
-      case CommandType::AssertException: {
-        auto* assert_exception_command = cast<AssertExceptionCommand>(command);
-        WriteLocation(assert_exception_command->action->loc);
-        WriteSeparator();
-        WriteAction(*assert_exception_command->action);
-        WriteSeparator();
-        WriteKey("expected");
-        WriteActionResultType(*assert_exception_command->action);
-        break;
-      }
+    case CommandType::AssertExhaustion: {
+      auto* assert_exhaustion_command =
+          cast<AssertExhaustionCommand>(command);
+      WriteLocation(assert_exhaustion_command->action->loc);
+      WriteSeparator();
+      WriteAction(*assert_exhaustion_command->action);
+      WriteSeparator();
+      WriteKey("text");
+      WriteEscapedString(assert_exhaustion_command->text);
+      WriteSeparator();
+      WriteKey("expected");
+      WriteActionResultType(*assert_exhaustion_command->action);
+      break;
     }
 
-    json_stream_->Writef("}");
+    case CommandType::AssertException: {
+      auto* assert_exception_command = cast<AssertExceptionCommand>(command);
+      WriteLocation(assert_exception_command->action->loc);
+      WriteSeparator();
+      WriteAction(*assert_exception_command->action);
+      WriteSeparator();
+      WriteKey("expected");
+      WriteActionResultType(*assert_exception_command->action);
+      break;
+    }
   }
+
+  json_stream_->Writef("}");
+}
+
+Result BinaryWriterSpec::EndCommands() {
   json_stream_->Writef("]}\n");
+  return result_;
 }
 
 Result BinaryWriterSpec::WriteScript(const Script& script) {
-  script_ = &script;
-  WriteCommands();
-  return result_;
+  BeginCommands();
+  for (Index i = 0; i < script.commands.size(); ++i) {
+    WriteCommand(script, i);
+  }
+  return EndCommands();
 }
 
 }  // end anonymous namespace
 
+class SpecScriptWriter::Impl : public BinaryWriterSpec {
+ public:
+  using BinaryWriterSpec::BinaryWriterSpec;
+};
+
+SpecScriptWriter::SpecScriptWriter(
+    Stream* json_stream,
+    WriteBinarySpecStreamFactory module_stream_factory,
+    std::string_view source_filename,
+    std::string_view module_filename_noext,
+    const WriteBinaryOptions& options)
+    : writer_(MakeUnique<Impl>(json_stream,
+                               module_stream_factory,
+                               source_filename,
+                               module_filename_noext,
+                               options)) {
+  writer_->BeginCommands();
+}
+
+SpecScriptWriter::~SpecScriptWriter() = default;
+
+void SpecScriptWriter::WriteCommand(const Script& script,
+                                    const Command& command) {
+  assert(!script.commands.empty() &&
+         script.commands.back().get() == &command);
+  writer_->WriteCommand(script, script.commands.size() - 1);
+}
+
+Result SpecScriptWriter::Finish() {
+  return writer_->EndCommands();
+}
+
 Result WriteBinarySpecScript(Stream* json_stream,
                              WriteBinarySpecStreamFactory module_stream_factory,
                              Script* script,
@@ -45,6 +45,28 @@ Result WriteBinarySpecScript(Stream* json_stream,
                              std::string_view module_filename_noext,
                              const WriteBinaryOptions&);
 
+// Writes a script one command at a time, as it is parsed by the streaming
+// version of ParseWastScript. Modules are written through
+// |module_stream_factory| as soon as their command is written.
+class SpecScriptWriter {
+ public:
+  WABT_DISALLOW_COPY_AND_ASSIGN(SpecScriptWriter);
+  SpecScriptWriter(Stream* json_stream,
+                   WriteBinarySpecStreamFactory module_stream_factory,
+                   std::string_view source_filename,
+                   std::string_view module_filename_noext,
+                   const WriteBinaryOptions&);
+  ~SpecScriptWriter();
+
+  // |command| must be the most recent command of |script|.
+  void WriteCommand(const Script& script, const Command& command);
+  Result Finish();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> writer_;
+};
+
 // Convenience function for producing MemoryStream outputs all modules.
 Result WriteBinarySpecScript(
     Stream* json_stream,
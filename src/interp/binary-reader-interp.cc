@@ -17,6 +17,7 @@
 #include "src/interp/binary-reader-interp.h"
 
 #include <map>
+#include <memory>
 #include <set>
 
 #include "src/binary-reader-nop.h"
@@ -76,7 +77,8 @@ class BinaryReaderInterp : public BinaryReaderNop {
   BinaryReaderInterp(ModuleDesc* module,
                      std::string_view filename,
                      Errors* errors,
-                     const Features& features);
+                     const Features& features,
+                     const FuelCosts* fuel_costs);
 
   // Implement BinaryReader.
   bool OnError(const Error&) override;
@@ -120,6 +122,8 @@ class BinaryReaderInterp : public BinaryReaderNop {
 
   Result OnFunctionCount(Index count) override;
   Result OnFunction(Index index, Index sig_index) override;
+  Result OnFunctionBodyCount(Index count) override;
+  bool SkipFunctionBody(Index index) override;
 
   Result OnTableCount(Index count) override;
   Result OnTable(Index index,
@@ -275,6 +279,9 @@ class BinaryReaderInterp : public BinaryReaderNop {
                            const void* data,
                            Address size) override;
 
+  Result OnFunctionName(Index function_index,
+                        std::string_view function_name) override;
+
  private:
   Location GetLocation() const;
   Label* GetLabel(Index depth);
@@ -302,20 +309,37 @@ class BinaryReaderInterp : public BinaryReaderNop {
   Result BeginInitExpr(Type type, FuncDesc* init_func);
   Result EndInitExpr();
 
-  void EmitBr(Index depth,
-              Index drop_count,
-              Index keep_count,
-              Index catch_drop_count);
+  void EmitBr(Index depth, Index drop_count, Index keep_count);
+  // Emits the offset of the label, or a fixup if it isn't known yet.
+  void EmitLabelOffset(Index depth);
   void FixupTopLabel();
   u32 GetFuncOffset(Index func_index);
 
+  // Fuel metering. Each basic block starts with an interp_fuel instruction,
+  // whose cost is filled in when the next block starts, followed by the
+  // block's index in the function.
+  void BeginFuelBlock(Opcode = Opcode::InterpFuel);
+  void EndFuelBlock();
+
+  // Stack maps; see StackMapDesc. The frame's references at the end of the
+  // istream are taken from the validator between instructions, and adjusted
+  // for the drop/keeps emitted in the middle of branches.
+  void ResetStackMap();
+  void AdjustStackMap(Index drop_count, Index keep_count);
+  void RecordStackMap();
+
   Index TranslateLocalIndex(Index local_index);
 
+  // Marks the module as using v128 values, if `type` is v128.
+  void OnValueType(Type);
+
   Index num_func_imports() const;
 
+  friend class LazyCompilerInterp;
+
   Errors* errors_ = nullptr;
-  ModuleDesc& module_;
-  Istream& istream_;
+  ModuleDesc* module_;
+  Istream* istream_;
 
   SharedValidator validator_;
 
@@ -324,15 +348,45 @@ class BinaryReaderInterp : public BinaryReaderNop {
   FixupMap depth_fixups_;
   FixupMap func_fixups_;
 
-  u32 local_decl_count_;
   u32 local_count_;
 
+  // The ref slots of the params and the locals declared so far, which come
+  // before the operand stack in the frame.
+  std::vector<u32> local_ref_slots_;
+  u32 num_frame_locals_ = 0;
+  std::vector<u32> ref_slots_;
+  u32 stack_height_ = 0;
+  // The highest stack_height_ in the current function, and the fixup of the
+  // InterpAlloca at its start that is resolved from it.
+  u32 max_stack_height_ = 0;
+  Istream::Offset alloca_fixup_ = Istream::kInvalidOffset;
+
+  const FuelCosts* fuel_costs_;
+  Istream::Offset fuel_fixup_ = Istream::kInvalidOffset;
+  u32 fuel_cost_ = 0;
+
   std::vector<FuncType> func_types_;      // Includes imported and defined.
   std::vector<TableType> table_types_;    // Includes imported and defined.
   std::vector<MemoryType> memory_types_;  // Includes imported and defined.
   std::vector<GlobalType> global_types_;  // Includes imported and defined.
   std::vector<TagType> tag_types_;        // Includes imported and defined.
 
+  // Lazy compilation; see LazyCompilerInterp. Each defined function has a
+  // stub in the istream, and the offset of its body in the binary.
+  bool lazy_ = false;
+  LazyValidation lazy_validation_ = LazyValidation::Eager;
+  std::vector<Istream::Offset> stub_offsets_;
+  std::vector<Offset> body_offsets_;
+  Index data_count_ = kInvalidIndex;
+
+  // With LazyValidation::Eager, the bodies are read when the module is read,
+  // but the code for them is generated here and thrown away.
+  bool validate_only_ = false;
+  Istream scratch_istream_;
+  FuncDesc scratch_func_{
+      FuncType{{}, {}}, {}, Istream::kInvalidOffset, {}, {}, {}};
+  Index saved_num_call_indirect_sites_ = 0;
+
   static const Index kMemoryIndex0 = 0;
   std::string_view filename_;
 };
@@ -366,11 +420,13 @@ void FixupMap::Resolve(Istream& istream, Index index) {
 BinaryReaderInterp::BinaryReaderInterp(ModuleDesc* module,
                                        std::string_view filename,
                                        Errors* errors,
-                                       const Features& features)
+                                       const Features& features,
+                                       const FuelCosts* fuel_costs)
     : errors_(errors),
-      module_(*module),
-      istream_(module->istream),
+      module_(module),
+      istream_(&module->istream),
       validator_(errors, ValidateOptions(features)),
+      fuel_costs_(fuel_costs),
       filename_(filename) {}
 
 Label* BinaryReaderInterp::GetLabel(Index depth) {
@@ -419,6 +475,10 @@ Result BinaryReaderInterp::GetBrDropKeepCount(Index depth,
   Index keep_count = label->br_types().size();
   CHECK_RESULT(
       GetDropCount(keep_count, label->type_stack_limit, out_drop_count));
+  // The exceptions caught by the catch blocks that are left are dropped too.
+  Index catch_count;
+  CHECK_RESULT(validator_.GetCatchCount(depth, &catch_count));
+  *out_drop_count += catch_count;
   *out_keep_count = keep_count;
   return Result::Ok;
 }
@@ -436,37 +496,139 @@ Result BinaryReaderInterp::GetReturnCallDropKeepCount(const FuncType& func_type,
                                                       Index* out_drop_count,
                                                       Index* out_keep_count) {
   Index keep_count = static_cast<Index>(func_type.params.size()) + keep_extra;
+  Index catch_count;
   CHECK_RESULT(GetDropCount(keep_count, 0, out_drop_count));
-  *out_drop_count += validator_.GetLocalCount();
+  CHECK_RESULT(
+      validator_.GetCatchCount(label_stack_.size() - 1, &catch_count));
+  *out_drop_count += validator_.GetLocalCount() + catch_count;
   *out_keep_count = keep_count;
   return Result::Ok;
 }
 
 void BinaryReaderInterp::EmitBr(Index depth,
                                 Index drop_count,
-                                Index keep_count,
-                                Index catch_drop_count) {
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.EmitCatchDrop(catch_drop_count);
+                                Index keep_count) {
+  istream_->EmitDropKeep(drop_count, keep_count);
+  AdjustStackMap(drop_count, keep_count);
+  istream_->Emit(Opcode::Br);
+  EmitLabelOffset(depth);
+}
+
+void BinaryReaderInterp::EmitLabelOffset(Index depth) {
   Istream::Offset offset = GetLabel(depth)->offset;
-  istream_.Emit(Opcode::Br);
   if (offset == Istream::kInvalidOffset) {
     // depth_fixups_ stores the depth counting up from zero, where zero is the
     // top-level function scope.
-    depth_fixups_.Append(label_stack_.size() - 1 - depth, istream_.end());
+    depth_fixups_.Append(label_stack_.size() - 1 - depth, istream_->end());
   }
-  istream_.Emit(offset);
+  istream_->Emit(offset);
 }
 
 void BinaryReaderInterp::FixupTopLabel() {
-  depth_fixups_.Resolve(istream_, label_stack_.size() - 1);
+  depth_fixups_.Resolve(*istream_, label_stack_.size() - 1);
+}
+
+void BinaryReaderInterp::BeginFuelBlock(Opcode opcode) {
+  if (!fuel_costs_) {
+    return;
+  }
+  // Blocks start where branches land, so they need a stack map of their own
+  // when the interp_fuel instruction separates them from the next
+  // instruction.
+  ResetStackMap();
+  EndFuelBlock();
+  func_->block_offsets.push_back(istream_->end());
+  istream_->Emit(opcode);
+  fuel_fixup_ = istream_->EmitFixupU32();
+  istream_->Emit(static_cast<u32>(func_->block_offsets.size() - 1));
+}
+
+void BinaryReaderInterp::EndFuelBlock() {
+  if (fuel_fixup_ != Istream::kInvalidOffset) {
+    istream_->ResolveFixupU32(fuel_fixup_, fuel_cost_);
+    fuel_fixup_ = Istream::kInvalidOffset;
+    fuel_cost_ = 0;
+  }
+}
+
+void BinaryReaderInterp::ResetStackMap() {
+  if (validate_only_) {
+    return;
+  }
+  const TypeVector& type_stack = validator_.type_stack();
+  ref_slots_ = local_ref_slots_;
+  u32 slot = num_frame_locals_;
+  size_t i = 0;
+  auto add_values = [&](size_t end) {
+    for (; i < end; ++i, ++slot) {
+      if (type_stack[i].IsRef()) {
+        ref_slots_.push_back(slot);
+      }
+    }
+  };
+  // Each catch block keeps its exception below the block's values.
+  for (Index depth = label_stack_.size(); depth-- > 0;) {
+    SharedValidator::Label* label;
+    if (Succeeded(validator_.GetLabel(depth, &label)) &&
+        label->label_type == LabelType::Catch) {
+      add_values(label->type_stack_limit);
+      ref_slots_.push_back(slot++);
+    }
+  }
+  add_values(type_stack.size());
+  stack_height_ = slot;
+  max_stack_height_ = std::max(max_stack_height_, stack_height_);
+  RecordStackMap();
+}
+
+void BinaryReaderInterp::AdjustStackMap(Index drop_count, Index keep_count) {
+  if (validate_only_ || drop_count == 0) {
+    return;
+  }
+  u32 keep_begin = stack_height_ - keep_count;
+  u32 drop_begin = keep_begin - drop_count;
+  std::vector<u32> ref_slots;
+  for (u32 slot : ref_slots_) {
+    if (slot >= keep_begin) {
+      ref_slots.push_back(slot - drop_count);
+    } else if (slot < drop_begin) {
+      ref_slots.push_back(slot);
+    }
+  }
+  ref_slots_ = std::move(ref_slots);
+  stack_height_ -= drop_count;
+  RecordStackMap();
+}
+
+void BinaryReaderInterp::RecordStackMap() {
+  if (validate_only_) {
+    return;
+  }
+  auto& stack_maps = module_->stack_maps;
+  Istream::Offset offset = istream_->end();
+  if (!stack_maps.empty() && stack_maps.back().offset == offset) {
+    // Nothing was emitted since the last map, e.g. at the end of a block.
+    stack_maps.back().ref_slots = ref_slots_;
+    return;
+  }
+  assert(stack_maps.empty() || stack_maps.back().offset < offset);
+  if (stack_maps.empty() ? ref_slots_.empty()
+                         : stack_maps.back().ref_slots == ref_slots_) {
+    return;
+  }
+  stack_maps.push_back(StackMapDesc{offset, ref_slots_});
 }
 
 u32 BinaryReaderInterp::GetFuncOffset(Index func_index) {
   assert(func_index >= num_func_imports());
-  FuncDesc& func = module_.funcs[func_index - num_func_imports()];
+  if (lazy_) {
+    // Always go through the stub, since it also prepares the calling
+    // instance for the function's code.
+    return stub_offsets_[func_index - num_func_imports()];
+  }
+  FuncDesc& func = module_->funcs[func_index - num_func_imports()];
   if (func.code_offset == Istream::kInvalidOffset) {
-    func_fixups_.Append(func_index, istream_.end());
+    func_fixups_.Append(func_index, istream_->end());
   }
   return func.code_offset;
 }
@@ -482,7 +644,7 @@ Result BinaryReaderInterp::EndModule() {
 }
 
 Result BinaryReaderInterp::OnTypeCount(Index count) {
-  module_.func_types.reserve(count);
+  module_->func_types.reserve(count);
   return Result::Ok;
 }
 
@@ -493,8 +655,14 @@ Result BinaryReaderInterp::OnFuncType(Index index,
                                       Type* result_types) {
   CHECK_RESULT(validator_.OnFuncType(GetLocation(), param_count, param_types,
                                      result_count, result_types, index));
-  module_.func_types.push_back(FuncType(ToInterp(param_count, param_types),
+  module_->func_types.push_back(FuncType(ToInterp(param_count, param_types),
                                         ToInterp(result_count, result_types)));
+  for (Index i = 0; i < param_count; ++i) {
+    OnValueType(param_types[i]);
+  }
+  for (Index i = 0; i < result_count; ++i) {
+    OnValueType(result_types[i]);
+  }
   return Result::Ok;
 }
 
@@ -504,8 +672,8 @@ Result BinaryReaderInterp::OnImportFunc(Index import_index,
                                         Index func_index,
                                         Index sig_index) {
   CHECK_RESULT(validator_.OnFunction(GetLocation(), Var(sig_index)));
-  FuncType& func_type = module_.func_types[sig_index];
-  module_.imports.push_back(ImportDesc{ImportType(
+  FuncType& func_type = module_->func_types[sig_index];
+  module_->imports.push_back(ImportDesc{ImportType(
       std::string(module_name), std::string(field_name), func_type.Clone())});
   func_types_.push_back(func_type);
   return Result::Ok;
@@ -519,7 +687,7 @@ Result BinaryReaderInterp::OnImportTable(Index import_index,
                                          const Limits* elem_limits) {
   CHECK_RESULT(validator_.OnTable(GetLocation(), elem_type, *elem_limits));
   TableType table_type{elem_type, *elem_limits};
-  module_.imports.push_back(ImportDesc{ImportType(
+  module_->imports.push_back(ImportDesc{ImportType(
       std::string(module_name), std::string(field_name), table_type.Clone())});
   table_types_.push_back(table_type);
   return Result::Ok;
@@ -532,7 +700,7 @@ Result BinaryReaderInterp::OnImportMemory(Index import_index,
                                           const Limits* page_limits) {
   CHECK_RESULT(validator_.OnMemory(GetLocation(), *page_limits));
   MemoryType memory_type{*page_limits};
-  module_.imports.push_back(ImportDesc{ImportType(
+  module_->imports.push_back(ImportDesc{ImportType(
       std::string(module_name), std::string(field_name), memory_type.Clone())});
   memory_types_.push_back(memory_type);
   return Result::Ok;
@@ -545,8 +713,9 @@ Result BinaryReaderInterp::OnImportGlobal(Index import_index,
                                           Type type,
                                           bool mutable_) {
   CHECK_RESULT(validator_.OnGlobalImport(GetLocation(), type, mutable_));
+  OnValueType(type);
   GlobalType global_type{type, ToMutability(mutable_)};
-  module_.imports.push_back(ImportDesc{ImportType(
+  module_->imports.push_back(ImportDesc{ImportType(
       std::string(module_name), std::string(field_name), global_type.Clone())});
   global_types_.push_back(global_type);
   return Result::Ok;
@@ -558,29 +727,59 @@ Result BinaryReaderInterp::OnImportTag(Index import_index,
                                        Index tag_index,
                                        Index sig_index) {
   CHECK_RESULT(validator_.OnTag(GetLocation(), Var(sig_index)));
-  FuncType& func_type = module_.func_types[sig_index];
+  FuncType& func_type = module_->func_types[sig_index];
   TagType tag_type{TagAttr::Exception, func_type.params};
-  module_.imports.push_back(ImportDesc{ImportType(
+  module_->imports.push_back(ImportDesc{ImportType(
       std::string(module_name), std::string(field_name), tag_type.Clone())});
   tag_types_.push_back(tag_type);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnFunctionCount(Index count) {
-  module_.funcs.reserve(count);
+  module_->funcs.reserve(count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnFunction(Index index, Index sig_index) {
   CHECK_RESULT(validator_.OnFunction(GetLocation(), Var(sig_index)));
-  FuncType& func_type = module_.func_types[sig_index];
-  module_.funcs.push_back(FuncDesc{func_type, {}, Istream::kInvalidOffset, {}});
+  FuncType& func_type = module_->func_types[sig_index];
+  module_->funcs.push_back(
+      FuncDesc{func_type, {}, Istream::kInvalidOffset, {}, {}, {}});
   func_types_.push_back(func_type);
   return Result::Ok;
 }
 
+Result BinaryReaderInterp::OnFunctionBodyCount(Index count) {
+  if (lazy_) {
+    for (FuncDesc& func : module_->funcs) {
+      func.code_offset = istream_->end();
+      stub_offsets_.push_back(func.code_offset);
+      ref_slots_.clear();
+      for (Index i = 0; i < func.type.params.size(); ++i) {
+        if (func.type.params[i].IsRef()) {
+          ref_slots_.push_back(i);
+        }
+      }
+      RecordStackMap();
+      istream_->Emit(Opcode::InterpCompile,
+                     static_cast<u32>(stub_offsets_.size() - 1));
+    }
+    body_offsets_.resize(module_->funcs.size(), kInvalidOffset);
+  }
+  return Result::Ok;
+}
+
+bool BinaryReaderInterp::SkipFunctionBody(Index index) {
+  if (!lazy_) {
+    return false;
+  }
+  body_offsets_[index - num_func_imports()] = state->offset;
+  validate_only_ = lazy_validation_ == LazyValidation::Eager;
+  return !validate_only_;
+}
+
 Result BinaryReaderInterp::OnTableCount(Index count) {
-  module_.tables.reserve(count);
+  module_->tables.reserve(count);
   return Result::Ok;
 }
 
@@ -589,47 +788,49 @@ Result BinaryReaderInterp::OnTable(Index index,
                                    const Limits* elem_limits) {
   CHECK_RESULT(validator_.OnTable(GetLocation(), elem_type, *elem_limits));
   TableType table_type{elem_type, *elem_limits};
-  module_.tables.push_back(TableDesc{table_type});
+  module_->tables.push_back(TableDesc{table_type});
   table_types_.push_back(table_type);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemoryCount(Index count) {
-  module_.memories.reserve(count);
+  module_->memories.reserve(count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemory(Index index, const Limits* limits) {
   CHECK_RESULT(validator_.OnMemory(GetLocation(), *limits));
   MemoryType memory_type{*limits};
-  module_.memories.push_back(MemoryDesc{memory_type});
+  module_->memories.push_back(MemoryDesc{memory_type});
   memory_types_.push_back(memory_type);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnGlobalCount(Index count) {
-  module_.globals.reserve(count);
+  module_->globals.reserve(count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::BeginGlobal(Index index, Type type, bool mutable_) {
   CHECK_RESULT(validator_.OnGlobal(GetLocation(), type, mutable_));
+  OnValueType(type);
   GlobalType global_type{type, ToMutability(mutable_)};
-  FuncDesc init_func{FuncType{{}, {type}}, {}, Istream::kInvalidOffset, {}};
-  module_.globals.push_back(GlobalDesc{global_type, init_func});
+  FuncDesc init_func{
+      FuncType{{}, {type}}, {}, Istream::kInvalidOffset, {}, {}, {}};
+  module_->globals.push_back(GlobalDesc{global_type, init_func});
   global_types_.push_back(global_type);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::BeginGlobalInitExpr(Index index) {
-  GlobalDesc& global = module_.globals.back();
+  GlobalDesc& global = module_->globals.back();
   return BeginInitExpr(global.type.type, &global.init_func);
 }
 
 Result BinaryReaderInterp::EndInitExpr() {
   FixupTopLabel();
   CHECK_RESULT(validator_.EndInitExpr());
-  istream_.Emit(Opcode::Return);
+  istream_->Emit(Opcode::Return);
   PopLabel();
   return Result::Ok;
 }
@@ -637,8 +838,11 @@ Result BinaryReaderInterp::EndInitExpr() {
 Result BinaryReaderInterp::BeginInitExpr(Type type, FuncDesc* func) {
   label_stack_.clear();
   func_ = func;
-  func_->code_offset = istream_.end();
+  func_->code_offset = istream_->end();
   CHECK_RESULT(validator_.BeginInitExpr(GetLocation(), type));
+  local_ref_slots_.clear();
+  num_frame_locals_ = 0;
+  ResetStackMap();
   // Push implicit init func label (equivalent to return).
   PushLabel(LabelKind::Try, Istream::kInvalidOffset, Istream::kInvalidOffset);
   return Result::Ok;
@@ -649,15 +853,15 @@ Result BinaryReaderInterp::EndGlobalInitExpr(Index index) {
 }
 
 Result BinaryReaderInterp::OnTagCount(Index count) {
-  module_.tags.reserve(count);
+  module_->tags.reserve(count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTagType(Index index, Index sig_index) {
   CHECK_RESULT(validator_.OnTag(GetLocation(), Var(sig_index)));
-  FuncType& func_type = module_.func_types[sig_index];
+  FuncType& func_type = module_->func_types[sig_index];
   TagType tag_type{TagAttr::Exception, func_type.params};
-  module_.tags.push_back(TagDesc{tag_type});
+  module_->tags.push_back(TagDesc{tag_type});
   tag_types_.push_back(tag_type);
   return Result::Ok;
 }
@@ -676,19 +880,19 @@ Result BinaryReaderInterp::OnExport(Index index,
     case ExternalKind::Global: type = global_types_[item_index].Clone(); break;
     case ExternalKind::Tag:    type = tag_types_[item_index].Clone(); break;
   }
-  module_.exports.push_back(
+  module_->exports.push_back(
       ExportDesc{ExportType(std::string(name), std::move(type)), item_index});
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnStartFunction(Index func_index) {
   CHECK_RESULT(validator_.OnStart(GetLocation(), Var(func_index)));
-  module_.starts.push_back(StartDesc{func_index});
+  module_->starts.push_back(StartDesc{func_index});
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnElemSegmentCount(Index count) {
-  module_.elems.reserve(count);
+  module_->elems.reserve(count);
   return Result::Ok;
 }
 
@@ -699,14 +903,14 @@ Result BinaryReaderInterp::BeginElemSegment(Index index,
   CHECK_RESULT(validator_.OnElemSegment(GetLocation(), Var(table_index), mode));
 
   FuncDesc init_func{
-      FuncType{{}, {ValueType::I32}}, {}, Istream::kInvalidOffset, {}};
+      FuncType{{}, {ValueType::I32}}, {}, Istream::kInvalidOffset, {}, {}, {}};
   ElemDesc desc{{}, ValueType::Void, mode, table_index, init_func};
-  module_.elems.push_back(desc);
+  module_->elems.push_back(desc);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::BeginElemSegmentInitExpr(Index index) {
-  ElemDesc& elem = module_.elems.back();
+  ElemDesc& elem = module_->elems.back();
   return BeginInitExpr(Type::I32, &elem.init_func);
 }
 
@@ -716,14 +920,14 @@ Result BinaryReaderInterp::EndElemSegmentInitExpr(Index index) {
 
 Result BinaryReaderInterp::OnElemSegmentElemType(Index index, Type elem_type) {
   validator_.OnElemSegmentElemType(elem_type);
-  ElemDesc& elem = module_.elems.back();
+  ElemDesc& elem = module_->elems.back();
   elem.type = elem_type;
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnElemSegmentElemExprCount(Index index,
                                                       Index count) {
-  ElemDesc& elem = module_.elems.back();
+  ElemDesc& elem = module_->elems.back();
   elem.elements.reserve(count);
   return Result::Ok;
 }
@@ -731,7 +935,7 @@ Result BinaryReaderInterp::OnElemSegmentElemExprCount(Index index,
 Result BinaryReaderInterp::OnElemSegmentElemExpr_RefNull(Index segment_index,
                                                          Type type) {
   CHECK_RESULT(validator_.OnElemSegmentElemExpr_RefNull(GetLocation(), type));
-  ElemDesc& elem = module_.elems.back();
+  ElemDesc& elem = module_->elems.back();
   elem.elements.push_back(ElemExpr{ElemKind::RefNull, 0});
   return Result::Ok;
 }
@@ -740,21 +944,24 @@ Result BinaryReaderInterp::OnElemSegmentElemExpr_RefFunc(Index segment_index,
                                                          Index func_index) {
   CHECK_RESULT(
       validator_.OnElemSegmentElemExpr_RefFunc(GetLocation(), Var(func_index)));
-  ElemDesc& elem = module_.elems.back();
+  ElemDesc& elem = module_->elems.back();
   elem.elements.push_back(ElemExpr{ElemKind::RefFunc, func_index});
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnDataCount(Index count) {
   validator_.OnDataCount(count);
-  module_.datas.reserve(count);
+  data_count_ = count;
+  module_->datas.reserve(count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::BeginDataSegmentInitExpr(Index index) {
   MemoryType t = memory_types_[0];
-  DataDesc& data = module_.datas.back();
-  return BeginInitExpr(t.limits.is_64 ? Type::I64 : Type::I32, &data.init_func);
+  DataDesc& data = module_->datas.back();
+  Type type = t.limits.is_64 ? Type::I64 : Type::I32;
+  data.init_func.type.results = {type};
+  return BeginInitExpr(type, &data.init_func);
 }
 
 Result BinaryReaderInterp::EndDataSegmentInitExpr(Index index) {
@@ -769,16 +976,16 @@ Result BinaryReaderInterp::BeginDataSegment(Index index,
       validator_.OnDataSegment(GetLocation(), Var(memory_index), mode));
 
   FuncDesc init_func{
-      FuncType{{}, {ValueType::I32}}, {}, Istream::kInvalidOffset, {}};
+      FuncType{{}, {ValueType::I32}}, {}, Istream::kInvalidOffset, {}, {}, {}};
   DataDesc desc{{}, mode, memory_index, init_func};
-  module_.datas.push_back(desc);
+  module_->datas.push_back(desc);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnDataSegmentData(Index index,
                                              const void* src_data,
                                              Address size) {
-  DataDesc& dst_data = module_.datas.back();
+  DataDesc& dst_data = module_->datas.back();
   if (size > 0) {
     dst_data.data.resize(size);
     memcpy(dst_data.data.data(), src_data, size);
@@ -786,6 +993,13 @@ Result BinaryReaderInterp::OnDataSegmentData(Index index,
   return Result::Ok;
 }
 
+Result BinaryReaderInterp::OnFunctionName(Index index, std::string_view name) {
+  if (index >= num_func_imports() && index < func_types_.size()) {
+    module_->funcs[index - num_func_imports()].name = std::string(name);
+  }
+  return Result::Ok;
+}
+
 void BinaryReaderInterp::PushLabel(LabelKind kind,
                                    Istream::Offset offset,
                                    Istream::Offset fixup_offset,
@@ -799,16 +1013,35 @@ void BinaryReaderInterp::PopLabel() {
 
 Result BinaryReaderInterp::BeginFunctionBody(Index index, Offset size) {
   Index defined_index = index - num_func_imports();
-  func_ = &module_.funcs[defined_index];
-  func_->code_offset = istream_.end();
+  if (validate_only_) {
+    scratch_func_ = FuncDesc{module_->funcs[defined_index].type,
+                             {}, Istream::kInvalidOffset, {}, {}, {}};
+    scratch_istream_ = Istream();
+    saved_num_call_indirect_sites_ = module_->num_call_indirect_sites;
+    func_ = &scratch_func_;
+    istream_ = &scratch_istream_;
+  } else {
+    func_ = &module_->funcs[defined_index];
+  }
+  func_->code_offset = istream_->end();
 
   depth_fixups_.Clear();
   label_stack_.clear();
 
-  func_fixups_.Resolve(istream_, defined_index);
+  func_fixups_.Resolve(*istream_, defined_index);
 
   CHECK_RESULT(validator_.BeginFunctionBody(GetLocation(), index));
 
+  local_ref_slots_.clear();
+  for (Index i = 0; i < func_->type.params.size(); ++i) {
+    if (func_->type.params[i].IsRef()) {
+      local_ref_slots_.push_back(i);
+    }
+  }
+  num_frame_locals_ = func_->type.params.size();
+  max_stack_height_ = 0;
+  ResetStackMap();
+
   // Push implicit func label (equivalent to return).
   // With exception handling it acts as a catch-less try block, which is
   // needed to support delegating to the caller of a function using the
@@ -816,12 +1049,19 @@ Result BinaryReaderInterp::BeginFunctionBody(Index index, Offset size) {
   PushLabel(LabelKind::Try, Istream::kInvalidOffset, Istream::kInvalidOffset,
             func_->handlers.size());
   func_->handlers.push_back(HandlerDesc{HandlerKind::Catch,
-                                        istream_.end(),
+                                        istream_->end(),
                                         Istream::kInvalidOffset,
                                         {},
                                         {Istream::kInvalidOffset},
-                                        static_cast<u32>(func_->locals.size()),
                                         0});
+  // The epoch is checked on entry too, so that recursion and tail calls can be
+  // interrupted like loops.
+  BeginFuelBlock(Opcode::InterpLoopFuel);
+  // Allocates the locals and checks that the whole frame fits on the value
+  // stack. Both sizes are only known at the end of the body.
+  istream_->Emit(Opcode::InterpAlloca);
+  alloca_fixup_ = istream_->EmitFixupU32();
+  istream_->EmitFixupU32();
   return Result::Ok;
 }
 
@@ -830,15 +1070,25 @@ Result BinaryReaderInterp::EndFunctionBody(Index index) {
   Index drop_count, keep_count;
   CHECK_RESULT(GetReturnDropKeepCount(&drop_count, &keep_count));
   CHECK_RESULT(validator_.EndFunctionBody(GetLocation()));
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.Emit(Opcode::Return);
+  istream_->EmitDropKeep(drop_count, keep_count);
+  AdjustStackMap(drop_count, keep_count);
+  istream_->Emit(Opcode::Return);
+  EndFuelBlock();
   PopLabel();
+  istream_->ResolveFixupU32(alloca_fixup_, local_count_);
+  istream_->ResolveFixupU32(
+      alloca_fixup_ + sizeof(u32),
+      std::max(max_stack_height_, num_frame_locals_) - num_frame_locals_);
   func_ = nullptr;
+  if (validate_only_) {
+    istream_ = &module_->istream;
+    module_->num_call_indirect_sites = saved_num_call_indirect_sites_;
+    validate_only_ = false;
+  }
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnLocalDeclCount(Index count) {
-  local_decl_count_ = count;
   local_count_ = 0;
   return Result::Ok;
 }
@@ -847,18 +1097,21 @@ Result BinaryReaderInterp::OnLocalDecl(Index decl_index,
                                        Index count,
                                        Type type) {
   CHECK_RESULT(validator_.OnLocalDecl(GetLocation(), count, type));
+  OnValueType(type);
 
+  if (type.IsRef()) {
+    for (Index i = 0; i < count; ++i) {
+      local_ref_slots_.push_back(num_frame_locals_ + i);
+    }
+  }
+  num_frame_locals_ += count;
   local_count_ += count;
   func_->locals.push_back(LocalDesc{type, count, local_count_});
-
-  if (decl_index == local_decl_count_ - 1) {
-    istream_.Emit(Opcode::InterpAlloca, local_count_);
-  }
   return Result::Ok;
 }
 
 Index BinaryReaderInterp::num_func_imports() const {
-  return func_types_.size() - module_.funcs.size();
+  return func_types_.size() - module_->funcs.size();
 }
 
 Result BinaryReaderInterp::OnOpcode(Opcode opcode) {
@@ -866,24 +1119,37 @@ Result BinaryReaderInterp::OnOpcode(Opcode opcode) {
     PrintError("Unexpected instruction after end of function");
     return Result::Error;
   }
+  if (fuel_fixup_ != Istream::kInvalidOffset) {
+    fuel_cost_ += fuel_costs_->Get(opcode);
+  }
+  if (opcode.GetPrefix() == 0xfd) {
+    module_->uses_v128 = true;
+  }
+  ResetStackMap();
   return Result::Ok;
 }
 
+void BinaryReaderInterp::OnValueType(Type type) {
+  if (type == Type::V128) {
+    module_->uses_v128 = true;
+  }
+}
+
 Result BinaryReaderInterp::OnUnaryExpr(Opcode opcode) {
   CHECK_RESULT(validator_.OnUnary(GetLocation(), opcode));
-  istream_.Emit(opcode);
+  istream_->Emit(opcode);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTernaryExpr(Opcode opcode) {
   CHECK_RESULT(validator_.OnTernary(GetLocation(), opcode));
-  istream_.Emit(opcode);
+  istream_->Emit(opcode);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnSimdLaneOpExpr(Opcode opcode, uint64_t value) {
   CHECK_RESULT(validator_.OnSimdLaneOp(GetLocation(), opcode, value));
-  istream_.Emit(opcode, static_cast<u8>(value));
+  istream_->Emit(opcode, static_cast<u8>(value));
   return Result::Ok;
 }
 
@@ -898,7 +1164,7 @@ Result BinaryReaderInterp::OnSimdLoadLaneExpr(Opcode opcode,
                                               uint64_t value) {
   CHECK_RESULT(validator_.OnSimdLoadLane(GetLocation(), opcode,
                                          GetAlignment(alignment_log2), value));
-  istream_.Emit(opcode, memidx, offset, static_cast<u8>(value));
+  istream_->Emit(opcode, memidx, offset, static_cast<u8>(value));
   return Result::Ok;
 }
 
@@ -909,13 +1175,13 @@ Result BinaryReaderInterp::OnSimdStoreLaneExpr(Opcode opcode,
                                                uint64_t value) {
   CHECK_RESULT(validator_.OnSimdStoreLane(GetLocation(), opcode,
                                           GetAlignment(alignment_log2), value));
-  istream_.Emit(opcode, memidx, offset, static_cast<u8>(value));
+  istream_->Emit(opcode, memidx, offset, static_cast<u8>(value));
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnSimdShuffleOpExpr(Opcode opcode, v128 value) {
   CHECK_RESULT(validator_.OnSimdShuffleOp(GetLocation(), opcode, value));
-  istream_.Emit(opcode, value);
+  istream_->Emit(opcode, value);
   return Result::Ok;
 }
 
@@ -924,7 +1190,7 @@ Result BinaryReaderInterp::OnLoadSplatExpr(Opcode opcode,
                                            Address offset) {
   CHECK_RESULT(
       validator_.OnLoadSplat(GetLocation(), opcode, GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
@@ -933,7 +1199,7 @@ Result BinaryReaderInterp::OnLoadZeroExpr(Opcode opcode,
                                           Address offset) {
   CHECK_RESULT(
       validator_.OnLoadZero(GetLocation(), opcode, GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
@@ -942,7 +1208,7 @@ Result BinaryReaderInterp::OnAtomicLoadExpr(Opcode opcode,
                                             Address offset) {
   CHECK_RESULT(
       validator_.OnAtomicLoad(GetLocation(), opcode, GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
@@ -951,7 +1217,7 @@ Result BinaryReaderInterp::OnAtomicStoreExpr(Opcode opcode,
                                              Address offset) {
   CHECK_RESULT(validator_.OnAtomicStore(GetLocation(), opcode,
                                         GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
@@ -960,7 +1226,7 @@ Result BinaryReaderInterp::OnAtomicRmwExpr(Opcode opcode,
                                            Address offset) {
   CHECK_RESULT(
       validator_.OnAtomicRmw(GetLocation(), opcode, GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
@@ -969,13 +1235,13 @@ Result BinaryReaderInterp::OnAtomicRmwCmpxchgExpr(Opcode opcode,
                                                   Address offset) {
   CHECK_RESULT(validator_.OnAtomicRmwCmpxchg(GetLocation(), opcode,
                                              GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnBinaryExpr(Opcode opcode) {
   CHECK_RESULT(validator_.OnBinary(GetLocation(), opcode));
-  istream_.Emit(opcode);
+  istream_->Emit(opcode);
   return Result::Ok;
 }
 
@@ -987,15 +1253,17 @@ Result BinaryReaderInterp::OnBlockExpr(Type sig_type) {
 
 Result BinaryReaderInterp::OnLoopExpr(Type sig_type) {
   CHECK_RESULT(validator_.OnLoop(GetLocation(), sig_type));
-  PushLabel(LabelKind::Block, istream_.end());
+  PushLabel(LabelKind::Block, istream_->end());
+  BeginFuelBlock(Opcode::InterpLoopFuel);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnIfExpr(Type sig_type) {
   CHECK_RESULT(validator_.OnIf(GetLocation(), sig_type));
-  istream_.Emit(Opcode::InterpBrUnless);
-  auto fixup = istream_.EmitFixupU32();
+  istream_->Emit(Opcode::InterpBrUnless);
+  auto fixup = istream_->EmitFixupU32();
   PushLabel(LabelKind::Block, Istream::kInvalidOffset, fixup);
+  BeginFuelBlock();
   return Result::Ok;
 }
 
@@ -1003,9 +1271,10 @@ Result BinaryReaderInterp::OnElseExpr() {
   CHECK_RESULT(validator_.OnElse(GetLocation()));
   Label* label = TopLabel();
   Istream::Offset fixup_cond_offset = label->fixup_offset;
-  istream_.Emit(Opcode::Br);
-  label->fixup_offset = istream_.EmitFixupU32();
-  istream_.ResolveFixupU32(fixup_cond_offset);
+  istream_->Emit(Opcode::Br);
+  label->fixup_offset = istream_->EmitFixupU32();
+  istream_->ResolveFixupU32(fixup_cond_offset);
+  BeginFuelBlock();
   return Result::Ok;
 }
 
@@ -1016,43 +1285,49 @@ Result BinaryReaderInterp::OnEndExpr() {
   SharedValidator::Label* label;
   CHECK_RESULT(validator_.GetLabel(0, &label));
   LabelType label_type = label->label_type;
+  Index result_count = label->result_types.size();
   CHECK_RESULT(validator_.OnEnd(GetLocation()));
   if (label_type == LabelType::If || label_type == LabelType::Else) {
-    istream_.ResolveFixupU32(TopLabel()->fixup_offset);
+    istream_->ResolveFixupU32(TopLabel()->fixup_offset);
   } else if (label_type == LabelType::Try) {
     // Catch-less try blocks need to fill in the handler description
     // so that it can trigger an exception rethrow when it's reached.
     Label* local_label = TopLabel();
     HandlerDesc& desc = func_->handlers[local_label->handler_desc_index];
-    desc.try_end_offset = istream_.end();
+    desc.try_end_offset = istream_->end();
     assert(desc.catches.size() == 0);
   } else if (label_type == LabelType::Catch) {
-    istream_.EmitCatchDrop(1);
+    // Drop the caught exception from below the results.
+    istream_->EmitDropKeep(1, result_count);
+    AdjustStackMap(1, result_count);
   }
   FixupTopLabel();
   PopLabel();
+  BeginFuelBlock();
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnBrExpr(Index depth) {
-  Index drop_count, keep_count, catch_drop_count;
+  Index drop_count, keep_count;
   CHECK_RESULT(GetBrDropKeepCount(depth, &drop_count, &keep_count));
-  CHECK_RESULT(validator_.GetCatchCount(depth, &catch_drop_count));
   CHECK_RESULT(validator_.OnBr(GetLocation(), Var(depth)));
-  EmitBr(depth, drop_count, keep_count, catch_drop_count);
+  EmitBr(depth, drop_count, keep_count);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnBrIfExpr(Index depth) {
-  Index drop_count, keep_count, catch_drop_count;
+  Index drop_count, keep_count;
   CHECK_RESULT(validator_.OnBrIf(GetLocation(), Var(depth)));
   CHECK_RESULT(GetBrDropKeepCount(depth, &drop_count, &keep_count));
-  CHECK_RESULT(validator_.GetCatchCount(depth, &catch_drop_count));
+  // The condition is popped before the drop/keep.
+  ResetStackMap();
   // Flip the br_if so if <cond> is true it can drop values from the stack.
-  istream_.Emit(Opcode::InterpBrUnless);
-  auto fixup = istream_.EmitFixupU32();
-  EmitBr(depth, drop_count, keep_count, catch_drop_count);
-  istream_.ResolveFixupU32(fixup);
+  istream_->Emit(Opcode::InterpBrUnless);
+  auto fixup = istream_->EmitFixupU32();
+  EmitBr(depth, drop_count, keep_count);
+  istream_->ResolveFixupU32(fixup);
+  ResetStackMap();
+  BeginFuelBlock();
   return Result::Ok;
 }
 
@@ -1060,30 +1335,47 @@ Result BinaryReaderInterp::OnBrTableExpr(Index num_targets,
                                          Index* target_depths,
                                          Index default_target_depth) {
   CHECK_RESULT(validator_.BeginBrTable(GetLocation()));
-  Index drop_count, keep_count, catch_drop_count;
-  istream_.Emit(Opcode::BrTable, num_targets);
-
-  for (Index i = 0; i < num_targets; ++i) {
-    Index depth = target_depths[i];
+  Index drop_count, keep_count;
+  // The index is popped before jumping to one of the entries, which all start
+  // with the same stack.
+  ResetStackMap();
+  std::vector<u32> ref_slots = ref_slots_;
+  u32 stack_height = stack_height_;
+  istream_->Emit(Opcode::BrTable, num_targets);
+
+  // The instruction is followed by the offset of each target, and then of
+  // the default target. Targets that need to drop values point to a
+  // drop/keep after the table instead, which is shared by all entries with
+  // the same target.
+  struct DropKeepTarget {
+    Index drop_count;
+    Index keep_count;
+    std::vector<Istream::Offset> fixups;
+  };
+  std::map<Index, DropKeepTarget> drop_keep_targets;
+  for (Index i = 0; i <= num_targets; ++i) {
+    Index depth = i < num_targets ? target_depths[i] : default_target_depth;
     CHECK_RESULT(validator_.OnBrTableTarget(GetLocation(), Var(depth)));
     CHECK_RESULT(GetBrDropKeepCount(depth, &drop_count, &keep_count));
-    CHECK_RESULT(validator_.GetCatchCount(depth, &catch_drop_count));
-    // Emit DropKeep directly (instead of using EmitDropKeep) so the
-    // instruction has a fixed size. Same for CatchDrop as well.
-    istream_.Emit(Opcode::InterpDropKeep, drop_count, keep_count);
-    istream_.Emit(Opcode::InterpCatchDrop, catch_drop_count);
-    EmitBr(depth, 0, 0, 0);
+    if (drop_count == 0) {
+      EmitLabelOffset(depth);
+    } else {
+      DropKeepTarget& target = drop_keep_targets[depth];
+      target.drop_count = drop_count;
+      target.keep_count = keep_count;
+      target.fixups.push_back(istream_->EmitFixupU32());
+    }
+  }
+
+  for (auto& [depth, target] : drop_keep_targets) {
+    for (Istream::Offset fixup : target.fixups) {
+      istream_->ResolveFixupU32(fixup);
+    }
+    ref_slots_ = ref_slots;
+    stack_height_ = stack_height;
+    RecordStackMap();
+    EmitBr(depth, target.drop_count, target.keep_count);
   }
-  CHECK_RESULT(
-      validator_.OnBrTableTarget(GetLocation(), Var(default_target_depth)));
-  CHECK_RESULT(
-      GetBrDropKeepCount(default_target_depth, &drop_count, &keep_count));
-  CHECK_RESULT(
-      validator_.GetCatchCount(default_target_depth, &catch_drop_count));
-  // The default case doesn't need a fixed size, since it is never jumped over.
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.Emit(Opcode::InterpCatchDrop, catch_drop_count);
-  EmitBr(default_target_depth, 0, 0, 0);
 
   CHECK_RESULT(validator_.EndBrTable(GetLocation()));
   return Result::Ok;
@@ -1093,9 +1385,9 @@ Result BinaryReaderInterp::OnCallExpr(Index func_index) {
   CHECK_RESULT(validator_.OnCall(GetLocation(), Var(func_index)));
 
   if (func_index >= num_func_imports()) {
-    istream_.Emit(Opcode::Call, func_index);
+    istream_->Emit(Opcode::Call, func_index);
   } else {
-    istream_.Emit(Opcode::InterpCallImport, func_index);
+    istream_->Emit(Opcode::InterpCallImport, func_index);
   }
 
   return Result::Ok;
@@ -1105,33 +1397,32 @@ Result BinaryReaderInterp::OnCallIndirectExpr(Index sig_index,
                                               Index table_index) {
   CHECK_RESULT(validator_.OnCallIndirect(GetLocation(), Var(sig_index),
                                          Var(table_index)));
-  istream_.Emit(Opcode::CallIndirect, table_index, sig_index);
+  istream_->Emit(Opcode::CallIndirect, table_index, sig_index);
+  istream_->Emit(module_->num_call_indirect_sites++);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnReturnCallExpr(Index func_index) {
   FuncType& func_type = func_types_[func_index];
 
-  Index drop_count, keep_count, catch_drop_count;
+  Index drop_count, keep_count;
   CHECK_RESULT(
       GetReturnCallDropKeepCount(func_type, 0, &drop_count, &keep_count));
-  CHECK_RESULT(
-      validator_.GetCatchCount(label_stack_.size() - 1, &catch_drop_count));
   // The validator must be run after we get the drop/keep counts, since it
   // will change the type stack.
   CHECK_RESULT(validator_.OnReturnCall(GetLocation(), Var(func_index)));
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.EmitCatchDrop(catch_drop_count);
+  istream_->EmitDropKeep(drop_count, keep_count);
+  AdjustStackMap(drop_count, keep_count);
 
   if (func_index >= num_func_imports()) {
-    istream_.Emit(Opcode::InterpAdjustFrameForReturnCall, func_index);
-    istream_.Emit(Opcode::Br);
+    istream_->Emit(Opcode::InterpAdjustFrameForReturnCall, func_index);
+    istream_->Emit(Opcode::Br);
     // We emit this separately to ensure that the fixup generated by
     // GetFuncOffset comes after the Br opcode.
-    istream_.Emit(GetFuncOffset(func_index));
+    istream_->Emit(GetFuncOffset(func_index));
   } else {
-    istream_.Emit(Opcode::InterpCallImport, func_index);
-    istream_.Emit(Opcode::Return);
+    istream_->Emit(Opcode::InterpCallImport, func_index);
+    istream_->Emit(Opcode::Return);
   }
 
   return Result::Ok;
@@ -1139,87 +1430,91 @@ Result BinaryReaderInterp::OnReturnCallExpr(Index func_index) {
 
 Result BinaryReaderInterp::OnReturnCallIndirectExpr(Index sig_index,
                                                     Index table_index) {
-  FuncType& func_type = module_.func_types[sig_index];
+  FuncType& func_type = module_->func_types[sig_index];
 
-  Index drop_count, keep_count, catch_drop_count;
+  Index drop_count, keep_count;
   // +1 to include the index of the function.
   CHECK_RESULT(
       GetReturnCallDropKeepCount(func_type, +1, &drop_count, &keep_count));
-  CHECK_RESULT(
-      validator_.GetCatchCount(label_stack_.size() - 1, &catch_drop_count));
   // The validator must be run after we get the drop/keep counts, since it
   // changes the type stack.
   CHECK_RESULT(validator_.OnReturnCallIndirect(GetLocation(), Var(sig_index),
                                                Var(table_index)));
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.EmitCatchDrop(catch_drop_count);
-  istream_.Emit(Opcode::ReturnCallIndirect, table_index, sig_index);
+  istream_->EmitDropKeep(drop_count, keep_count);
+  AdjustStackMap(drop_count, keep_count);
+  istream_->Emit(Opcode::ReturnCallIndirect, table_index, sig_index);
+  istream_->Emit(module_->num_call_indirect_sites++);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnCompareExpr(Opcode opcode) {
   CHECK_RESULT(validator_.OnCompare(GetLocation(), opcode));
-  istream_.Emit(opcode);
+  istream_->Emit(opcode);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnConvertExpr(Opcode opcode) {
   CHECK_RESULT(validator_.OnConvert(GetLocation(), opcode));
-  istream_.Emit(opcode);
+  istream_->Emit(opcode);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnDropExpr() {
   CHECK_RESULT(validator_.OnDrop(GetLocation()));
-  istream_.Emit(Opcode::Drop);
+  istream_->Emit(Opcode::Drop);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnI32ConstExpr(uint32_t value) {
   CHECK_RESULT(validator_.OnConst(GetLocation(), Type::I32));
-  istream_.Emit(Opcode::I32Const, value);
+  istream_->Emit(Opcode::I32Const, value);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnI64ConstExpr(uint64_t value) {
   CHECK_RESULT(validator_.OnConst(GetLocation(), Type::I64));
-  istream_.Emit(Opcode::I64Const, value);
+  istream_->Emit(Opcode::I64Const, value);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnF32ConstExpr(uint32_t value_bits) {
   CHECK_RESULT(validator_.OnConst(GetLocation(), Type::F32));
-  istream_.Emit(Opcode::F32Const, value_bits);
+  istream_->Emit(Opcode::F32Const, value_bits);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnF64ConstExpr(uint64_t value_bits) {
   CHECK_RESULT(validator_.OnConst(GetLocation(), Type::F64));
-  istream_.Emit(Opcode::F64Const, value_bits);
+  istream_->Emit(Opcode::F64Const, value_bits);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnV128ConstExpr(v128 value_bits) {
   CHECK_RESULT(validator_.OnConst(GetLocation(), Type::V128));
-  istream_.Emit(Opcode::V128Const, value_bits);
+  istream_->Emit(Opcode::V128Const, value_bits);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnGlobalGetExpr(Index global_index) {
   CHECK_RESULT(validator_.OnGlobalGet(GetLocation(), Var(global_index)));
-  istream_.Emit(Opcode::GlobalGet, global_index);
+  istream_->Emit(Opcode::GlobalGet, global_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnGlobalSetExpr(Index global_index) {
   CHECK_RESULT(validator_.OnGlobalSet(GetLocation(), Var(global_index)));
-  istream_.Emit(Opcode::GlobalSet, global_index);
+  istream_->Emit(Opcode::GlobalSet, global_index);
   return Result::Ok;
 }
 
 Index BinaryReaderInterp::TranslateLocalIndex(Index local_index) {
-  return validator_.type_stack_size() + validator_.GetLocalCount() -
-         local_index;
+  Index catch_count;
+  Result result =
+      validator_.GetCatchCount(label_stack_.size() - 1, &catch_count);
+  assert(Succeeded(result));
+  WABT_USE(result);
+  return validator_.type_stack_size() + catch_count +
+         validator_.GetLocalCount() - local_index;
 }
 
 Result BinaryReaderInterp::OnLocalGetExpr(Index local_index) {
@@ -1228,7 +1523,7 @@ Result BinaryReaderInterp::OnLocalGetExpr(Index local_index) {
   // old stack size.
   Index translated_local_index = TranslateLocalIndex(local_index);
   CHECK_RESULT(validator_.OnLocalGet(GetLocation(), Var(local_index)));
-  istream_.Emit(Opcode::LocalGet, translated_local_index);
+  istream_->Emit(Opcode::LocalGet, translated_local_index);
   return Result::Ok;
 }
 
@@ -1236,13 +1531,13 @@ Result BinaryReaderInterp::OnLocalSetExpr(Index local_index) {
   // See comment in OnLocalGetExpr above.
   Index translated_local_index = TranslateLocalIndex(local_index);
   CHECK_RESULT(validator_.OnLocalSet(GetLocation(), Var(local_index)));
-  istream_.Emit(Opcode::LocalSet, translated_local_index);
+  istream_->Emit(Opcode::LocalSet, translated_local_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnLocalTeeExpr(Index local_index) {
   CHECK_RESULT(validator_.OnLocalTee(GetLocation(), Var(local_index)));
-  istream_.Emit(Opcode::LocalTee, TranslateLocalIndex(local_index));
+  istream_->Emit(Opcode::LocalTee, TranslateLocalIndex(local_index));
   return Result::Ok;
 }
 
@@ -1252,7 +1547,7 @@ Result BinaryReaderInterp::OnLoadExpr(Opcode opcode,
                                       Address offset) {
   CHECK_RESULT(validator_.OnLoad(GetLocation(), opcode, Var(memidx),
                                  GetAlignment(align_log2)));
-  istream_.Emit(opcode, memidx, offset);
+  istream_->Emit(opcode, memidx, offset);
   return Result::Ok;
 }
 
@@ -1262,55 +1557,55 @@ Result BinaryReaderInterp::OnStoreExpr(Opcode opcode,
                                        Address offset) {
   CHECK_RESULT(validator_.OnStore(GetLocation(), opcode, Var(memidx),
                                   GetAlignment(align_log2)));
-  istream_.Emit(opcode, memidx, offset);
+  istream_->Emit(opcode, memidx, offset);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemoryGrowExpr(Index memidx) {
   CHECK_RESULT(validator_.OnMemoryGrow(GetLocation(), Var(memidx)));
-  istream_.Emit(Opcode::MemoryGrow, memidx);
+  istream_->Emit(Opcode::MemoryGrow, memidx);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemorySizeExpr(Index memidx) {
   CHECK_RESULT(validator_.OnMemorySize(GetLocation(), Var(memidx)));
-  istream_.Emit(Opcode::MemorySize, memidx);
+  istream_->Emit(Opcode::MemorySize, memidx);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableGrowExpr(Index table_index) {
   CHECK_RESULT(validator_.OnTableGrow(GetLocation(), Var(table_index)));
-  istream_.Emit(Opcode::TableGrow, table_index);
+  istream_->Emit(Opcode::TableGrow, table_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableSizeExpr(Index table_index) {
   CHECK_RESULT(validator_.OnTableSize(GetLocation(), Var(table_index)));
-  istream_.Emit(Opcode::TableSize, table_index);
+  istream_->Emit(Opcode::TableSize, table_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableFillExpr(Index table_index) {
   CHECK_RESULT(validator_.OnTableFill(GetLocation(), Var(table_index)));
-  istream_.Emit(Opcode::TableFill, table_index);
+  istream_->Emit(Opcode::TableFill, table_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnRefFuncExpr(Index func_index) {
   CHECK_RESULT(validator_.OnRefFunc(GetLocation(), Var(func_index)));
-  istream_.Emit(Opcode::RefFunc, func_index);
+  istream_->Emit(Opcode::RefFunc, func_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnRefNullExpr(Type type) {
   CHECK_RESULT(validator_.OnRefNull(GetLocation(), type));
-  istream_.Emit(Opcode::RefNull);
+  istream_->Emit(Opcode::RefNull);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnRefIsNullExpr() {
   CHECK_RESULT(validator_.OnRefIsNull(GetLocation()));
-  istream_.Emit(Opcode::RefIsNull);
+  istream_->Emit(Opcode::RefIsNull);
   return Result::Ok;
 }
 
@@ -1320,27 +1615,25 @@ Result BinaryReaderInterp::OnNopExpr() {
 }
 
 Result BinaryReaderInterp::OnReturnExpr() {
-  Index drop_count, keep_count, catch_drop_count;
+  Index drop_count, keep_count;
   CHECK_RESULT(GetReturnDropKeepCount(&drop_count, &keep_count));
-  CHECK_RESULT(
-      validator_.GetCatchCount(label_stack_.size() - 1, &catch_drop_count));
   CHECK_RESULT(validator_.OnReturn(GetLocation()));
-  istream_.EmitDropKeep(drop_count, keep_count);
-  istream_.EmitCatchDrop(catch_drop_count);
-  istream_.Emit(Opcode::Return);
+  istream_->EmitDropKeep(drop_count, keep_count);
+  AdjustStackMap(drop_count, keep_count);
+  istream_->Emit(Opcode::Return);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnSelectExpr(Index result_count,
                                         Type* result_types) {
   CHECK_RESULT(validator_.OnSelect(GetLocation(), result_count, result_types));
-  istream_.Emit(Opcode::Select);
+  istream_->Emit(Opcode::Select);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnUnreachableExpr() {
   CHECK_RESULT(validator_.OnUnreachable(GetLocation()));
-  istream_.Emit(Opcode::Unreachable);
+  istream_->Emit(Opcode::Unreachable);
   return Result::Ok;
 }
 
@@ -1349,13 +1642,13 @@ Result BinaryReaderInterp::OnAtomicWaitExpr(Opcode opcode,
                                             Address offset) {
   CHECK_RESULT(
       validator_.OnAtomicWait(GetLocation(), opcode, GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnAtomicFenceExpr(uint32_t consistency_model) {
   CHECK_RESULT(validator_.OnAtomicFence(GetLocation(), consistency_model));
-  istream_.Emit(Opcode::AtomicFence, consistency_model);
+  istream_->Emit(Opcode::AtomicFence, consistency_model);
   return Result::Ok;
 }
 
@@ -1364,58 +1657,58 @@ Result BinaryReaderInterp::OnAtomicNotifyExpr(Opcode opcode,
                                               Address offset) {
   CHECK_RESULT(validator_.OnAtomicNotify(GetLocation(), opcode,
                                          GetAlignment(align_log2)));
-  istream_.Emit(opcode, kMemoryIndex0, offset);
+  istream_->Emit(opcode, kMemoryIndex0, offset);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemoryCopyExpr(Index srcmemidx, Index destmemidx) {
   CHECK_RESULT(
       validator_.OnMemoryCopy(GetLocation(), Var(srcmemidx), Var(destmemidx)));
-  istream_.Emit(Opcode::MemoryCopy, srcmemidx, destmemidx);
+  istream_->Emit(Opcode::MemoryCopy, srcmemidx, destmemidx);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnDataDropExpr(Index segment_index) {
   CHECK_RESULT(validator_.OnDataDrop(GetLocation(), Var(segment_index)));
-  istream_.Emit(Opcode::DataDrop, segment_index);
+  istream_->Emit(Opcode::DataDrop, segment_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemoryFillExpr(Index memidx) {
   CHECK_RESULT(validator_.OnMemoryFill(GetLocation(), Var(memidx)));
-  istream_.Emit(Opcode::MemoryFill, memidx);
+  istream_->Emit(Opcode::MemoryFill, memidx);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnMemoryInitExpr(Index segment_index, Index memidx) {
   CHECK_RESULT(
       validator_.OnMemoryInit(GetLocation(), Var(segment_index), Var(memidx)));
-  istream_.Emit(Opcode::MemoryInit, memidx, segment_index);
+  istream_->Emit(Opcode::MemoryInit, memidx, segment_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableGetExpr(Index table_index) {
   CHECK_RESULT(validator_.OnTableGet(GetLocation(), Var(table_index)));
-  istream_.Emit(Opcode::TableGet, table_index);
+  istream_->Emit(Opcode::TableGet, table_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableSetExpr(Index table_index) {
   CHECK_RESULT(validator_.OnTableSet(GetLocation(), Var(table_index)));
-  istream_.Emit(Opcode::TableSet, table_index);
+  istream_->Emit(Opcode::TableSet, table_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTableCopyExpr(Index dst_index, Index src_index) {
   CHECK_RESULT(
       validator_.OnTableCopy(GetLocation(), Var(dst_index), Var(src_index)));
-  istream_.Emit(Opcode::TableCopy, dst_index, src_index);
+  istream_->Emit(Opcode::TableCopy, dst_index, src_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnElemDropExpr(Index segment_index) {
   CHECK_RESULT(validator_.OnElemDrop(GetLocation(), Var(segment_index)));
-  istream_.Emit(Opcode::ElemDrop, segment_index);
+  istream_->Emit(Opcode::ElemDrop, segment_index);
   return Result::Ok;
 }
 
@@ -1423,92 +1716,113 @@ Result BinaryReaderInterp::OnTableInitExpr(Index segment_index,
                                            Index table_index) {
   CHECK_RESULT(validator_.OnTableInit(GetLocation(), Var(segment_index),
                                       Var(table_index)));
-  istream_.Emit(Opcode::TableInit, table_index, segment_index);
+  istream_->Emit(Opcode::TableInit, table_index, segment_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnThrowExpr(Index tag_index) {
   CHECK_RESULT(validator_.OnThrow(GetLocation(), Var(tag_index)));
-  istream_.Emit(Opcode::Throw, tag_index);
+  istream_->Emit(Opcode::Throw, tag_index);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnRethrowExpr(Index depth) {
-  Index catch_depth;
+  SharedValidator::Label* label;
+  Index catch_count;
+  // Get the type stack size before it is reset by validator_.OnRethrow.
+  u32 type_stack_size = validator_.type_stack_size();
   CHECK_RESULT(validator_.OnRethrow(GetLocation(), Var(depth)));
-  CHECK_RESULT(validator_.GetCatchCount(depth, &catch_depth));
-  // The rethrow opcode takes an index into the exception stack rather than
-  // the number of catch nestings, so we subtract one here.
-  istream_.Emit(Opcode::Rethrow, catch_depth - 1);
+  CHECK_RESULT(validator_.GetLabel(depth, &label));
+  CHECK_RESULT(validator_.GetCatchCount(depth, &catch_count));
+  // The rethrow opcode takes the depth of the exception on the value stack,
+  // where it is kept below the values of its catch block, and below the
+  // exceptions of the catch blocks nested in it.
+  u32 exn_depth = type_stack_size - label->type_stack_limit + catch_count;
+  istream_->Emit(Opcode::Rethrow, exn_depth);
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnTryExpr(Type sig_type) {
-  u32 exn_stack_height;
+  Index catch_count;
   CHECK_RESULT(
-      validator_.GetCatchCount(label_stack_.size() - 1, &exn_stack_height));
-  u32 value_stack_height = validator_.type_stack_size();
+      validator_.GetCatchCount(label_stack_.size() - 1, &catch_count));
   CHECK_RESULT(validator_.OnTry(GetLocation(), sig_type));
+  SharedValidator::Label* label;
+  CHECK_RESULT(validator_.GetLabel(0, &label));
+  // The handler restores the stack below the try block's params, which
+  // includes the function's non-param locals and the exceptions of the
+  // enclosing catch blocks.
+  u32 value_stack_height = num_frame_locals_ - func_->type.params.size() +
+                           label->type_stack_limit + catch_count;
   // Push a label that tracks mapping of exn -> catch
   PushLabel(LabelKind::Try, Istream::kInvalidOffset, Istream::kInvalidOffset,
             func_->handlers.size());
   func_->handlers.push_back(HandlerDesc{HandlerKind::Catch,
-                                        istream_.end(),
+                                        istream_->end(),
                                         Istream::kInvalidOffset,
                                         {},
                                         {Istream::kInvalidOffset},
-                                        value_stack_height,
-                                        exn_stack_height});
+                                        value_stack_height});
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnCatchExpr(Index tag_index) {
+  SharedValidator::Label* validator_label;
+  CHECK_RESULT(validator_.GetLabel(0, &validator_label));
+  Index result_count = validator_label->result_types.size();
   CHECK_RESULT(validator_.OnCatch(GetLocation(), Var(tag_index), false));
   Label* label = TopLabel();
   HandlerDesc& desc = func_->handlers[label->handler_desc_index];
   desc.kind = HandlerKind::Catch;
   // Drop the previous block's exception if it was a catch.
   if (label->kind == LabelKind::Block) {
-    istream_.EmitCatchDrop(1);
+    istream_->EmitDropKeep(1, result_count);
+    AdjustStackMap(1, result_count);
   }
   // Jump to the end of the block at the end of the previous try or catch.
   Istream::Offset offset = label->offset;
-  istream_.Emit(Opcode::Br);
+  istream_->Emit(Opcode::Br);
   assert(offset == Istream::kInvalidOffset);
-  depth_fixups_.Append(label_stack_.size() - 1, istream_.end());
-  istream_.Emit(offset);
+  depth_fixups_.Append(label_stack_.size() - 1, istream_->end());
+  istream_->Emit(offset);
   // The offset is only set after the first catch block, as the offset range
   // should only cover the try block itself.
   if (desc.try_end_offset == Istream::kInvalidOffset) {
-    desc.try_end_offset = istream_.end();
+    desc.try_end_offset = istream_->end();
   }
   // The label kind is switched to Block from Try in order to distinguish
   // catch blocks from try blocks. This is used to ensure that a try-delegate
   // inside this catch will not delegate to the catch, and instead find outer
   // try blocks to use as a delegate target.
   label->kind = LabelKind::Block;
-  desc.catches.push_back(CatchDesc{tag_index, istream_.end()});
+  desc.catches.push_back(CatchDesc{tag_index, istream_->end()});
+  BeginFuelBlock();
   return Result::Ok;
 }
 
 Result BinaryReaderInterp::OnCatchAllExpr() {
+  SharedValidator::Label* validator_label;
+  CHECK_RESULT(validator_.GetLabel(0, &validator_label));
+  Index result_count = validator_label->result_types.size();
   CHECK_RESULT(validator_.OnCatch(GetLocation(), Var(), true));
   Label* label = TopLabel();
   HandlerDesc& desc = func_->handlers[label->handler_desc_index];
   desc.kind = HandlerKind::Catch;
   if (label->kind == LabelKind::Block) {
-    istream_.EmitCatchDrop(1);
+    istream_->EmitDropKeep(1, result_count);
+    AdjustStackMap(1, result_count);
   }
   Istream::Offset offset = label->offset;
-  istream_.Emit(Opcode::Br);
+  istream_->Emit(Opcode::Br);
   assert(offset == Istream::kInvalidOffset);
-  depth_fixups_.Append(label_stack_.size() - 1, istream_.end());
-  istream_.Emit(offset);
+  depth_fixups_.Append(label_stack_.size() - 1, istream_->end());
+  istream_->Emit(offset);
   if (desc.try_end_offset == Istream::kInvalidOffset) {
-    desc.try_end_offset = istream_.end();
+    desc.try_end_offset = istream_->end();
   }
   label->kind = LabelKind::Block;
-  desc.catch_all_offset = istream_.end();
+  desc.catch_all_offset = istream_->end();
+  BeginFuelBlock();
   return Result::Ok;
 }
 
@@ -1519,30 +1833,158 @@ Result BinaryReaderInterp::OnDelegateExpr(Index depth) {
   HandlerDesc& desc = func_->handlers[label->handler_desc_index];
   desc.kind = HandlerKind::Delegate;
   Istream::Offset offset = label->offset;
-  istream_.Emit(Opcode::Br);
+  istream_->Emit(Opcode::Br);
   assert(offset == Istream::kInvalidOffset);
-  depth_fixups_.Append(label_stack_.size() - 1, istream_.end());
-  istream_.Emit(offset);
-  desc.try_end_offset = istream_.end();
+  depth_fixups_.Append(label_stack_.size() - 1, istream_->end());
+  istream_->Emit(offset);
+  desc.try_end_offset = istream_->end();
   Label* target_label = GetNearestTryLabel(depth + 1);
   assert(target_label);
   desc.delegate_handler_index = target_label->handler_desc_index;
   FixupTopLabel();
   PopLabel();
+  BeginFuelBlock();
   return Result::Ok;
 }
 
+// Compiles the functions of a module read by ReadBinaryInterpLazy. It keeps a
+// copy of the binary, and the reader that read it, since the reader's
+// validator has all of the module's declarations.
+class LazyCompilerInterp : public LazyCompiler {
+ public:
+  LazyCompilerInterp(ModuleDesc* module,
+                     std::string_view filename,
+                     const void* data,
+                     size_t size,
+                     const ReadBinaryOptions& options,
+                     LazyValidation validation,
+                     const FuelCosts* fuel_costs);
+
+  Result ReadModule(Errors*);
+  Result Compile(ModuleDesc*,
+                 Index defined_index,
+                 std::string* out_msg) override;
+
+ private:
+  std::string filename_;
+  std::vector<u8> data_;
+  ReadBinaryOptions options_;
+  std::unique_ptr<FuelCosts> fuel_costs_;
+  Errors errors_;
+  BinaryReaderInterp reader_;
+  BinaryReaderModuleState module_state_;
+};
+
+LazyCompilerInterp::LazyCompilerInterp(ModuleDesc* module,
+                                       std::string_view filename,
+                                       const void* data,
+                                       size_t size,
+                                       const ReadBinaryOptions& options,
+                                       LazyValidation validation,
+                                       const FuelCosts* fuel_costs)
+    : filename_(filename),
+      data_(static_cast<const u8*>(data),
+            static_cast<const u8*>(data) + size),
+      options_(options),
+      fuel_costs_(fuel_costs ? std::make_unique<FuelCosts>(*fuel_costs)
+                             : nullptr),
+      reader_(module,
+              filename_,
+              &errors_,
+              options.features,
+              fuel_costs_.get()) {
+  reader_.lazy_ = true;
+  reader_.lazy_validation_ = validation;
+}
+
+Result LazyCompilerInterp::ReadModule(Errors* errors) {
+  Result result = ReadBinary(data_.data(), data_.size(), &reader_, options_,
+                             &module_state_);
+  errors->insert(errors->end(), std::make_move_iterator(errors_.begin()),
+                 std::make_move_iterator(errors_.end()));
+  errors_.clear();
+  // The caller's log stream may not outlive the module.
+  options_.log_stream = nullptr;
+  return result;
+}
+
+Result LazyCompilerInterp::Compile(ModuleDesc* module,
+                                   Index defined_index,
+                                   std::string* out_msg) {
+  // The module may have been moved or copied since it was read.
+  reader_.module_ = module;
+  reader_.istream_ = &module->istream;
+  reader_.fuel_fixup_ = Istream::kInvalidOffset;
+  reader_.fuel_cost_ = 0;
+
+  FuncDesc stub = module->funcs[defined_index];
+  Result result = ReadBinaryFunction(
+      data_.data(), data_.size(), reader_.body_offsets_[defined_index],
+      reader_.num_func_imports() + defined_index, module_state_, &reader_,
+      options_);
+  if (Failed(result)) {
+    module->funcs[defined_index] = std::move(stub);
+    // Later errors are usually caused by the first one.
+    *out_msg = errors_.empty() ? "invalid function body" : errors_[0].message;
+    errors_.clear();
+  }
+  return result;
+}
+
 }  // namespace
 
+FuelCosts::FuelCosts() : costs_(Opcode::Invalid, 1) {
+  for (Opcode op : {Opcode::Nop, Opcode::Block, Opcode::Loop, Opcode::Else,
+                    Opcode::End, Opcode::Try}) {
+    Set(op, 0);
+  }
+}
+
+u32 FuelCosts::Get(Opcode op) const {
+  return costs_[op];
+}
+
+void FuelCosts::Set(Opcode op, u32 cost) {
+  costs_[op] = cost;
+}
+
+Result ReadBinaryInterp(std::string_view filename,
+                        const void* data,
+                        size_t size,
+                        const ReadBinaryOptions& options,
+                        Errors* errors,
+                        ModuleDesc* out_module) {
+  BinaryReaderInterp reader(out_module, filename, errors, options.features,
+                            nullptr);
+  return ReadBinary(data, size, &reader, options);
+}
+
 Result ReadBinaryInterp(std::string_view filename,
                         const void* data,
                         size_t size,
                         const ReadBinaryOptions& options,
+                        const FuelCosts& fuel_costs,
                         Errors* errors,
                         ModuleDesc* out_module) {
-  BinaryReaderInterp reader(out_module, filename, errors, options.features);
+  BinaryReaderInterp reader(out_module, filename, errors, options.features,
+                            &fuel_costs);
   return ReadBinary(data, size, &reader, options);
 }
 
+Result ReadBinaryInterpLazy(std::string_view filename,
+                            const void* data,
+                            size_t size,
+                            const ReadBinaryOptions& options,
+                            LazyValidation validation,
+                            const FuelCosts* fuel_costs,
+                            Errors* errors,
+                            ModuleDesc* out_module) {
+  auto compiler = std::make_shared<LazyCompilerInterp>(
+      out_module, filename, data, size, options, validation, fuel_costs);
+  CHECK_RESULT(compiler->ReadModule(errors));
+  out_module->lazy_compiler = std::move(compiler);
+  return Result::Ok;
+}
+
 }  // namespace interp
 }  // namespace wabt
@@ -17,9 +17,12 @@
 #ifndef WABT_BINARY_READER_INTERP_H_
 #define WABT_BINARY_READER_INTERP_H_
 
+#include <vector>
+
 #include "src/common.h"
 #include "src/error.h"
 #include "src/interp/interp.h"
+#include "src/opcode.h"
 
 namespace wabt {
 
@@ -27,6 +30,20 @@ struct ReadBinaryOptions;
 
 namespace interp {
 
+// The amount of fuel each opcode consumes when fuel metering is enabled. Nop
+// and the structured control opcodes (block, loop, else, end, try) are free by
+// default; all other opcodes cost 1.
+class FuelCosts {
+ public:
+  FuelCosts();
+
+  u32 Get(Opcode) const;
+  void Set(Opcode, u32 cost);
+
+ private:
+  std::vector<u32> costs_;
+};
+
 Result ReadBinaryInterp(std::string_view filename,
                         const void* data,
                         size_t size,
@@ -34,6 +51,35 @@ Result ReadBinaryInterp(std::string_view filename,
                         Errors*,
                         ModuleDesc* out_module);
 
+// Same as above, but the generated code also consumes fuel from the running
+// Thread, and checks the Store's epoch at each loop header. The cost of each
+// basic block is charged once on entry to the block.
+Result ReadBinaryInterp(std::string_view filename,
+                        const void* data,
+                        size_t size,
+                        const ReadBinaryOptions& options,
+                        const FuelCosts& fuel_costs,
+                        Errors*,
+                        ModuleDesc* out_module);
+
+enum class LazyValidation {
+  Eager,  // Function bodies are validated when the module is read.
+  Lazy,   // Function bodies are validated when they are compiled.
+};
+
+// Same as above, but each function is only compiled into the istream on its
+// first call. With LazyValidation::Lazy the module may load even if a function
+// body is invalid; calling that function then traps. `fuel_costs` may be null,
+// in which case the code is generated without fuel metering.
+Result ReadBinaryInterpLazy(std::string_view filename,
+                            const void* data,
+                            size_t size,
+                            const ReadBinaryOptions& options,
+                            LazyValidation validation,
+                            const FuelCosts* fuel_costs,
+                            Errors*,
+                            ModuleDesc* out_module);
+
 }  // namespace interp
 }  // namespace wabt
 
@@ -127,13 +127,11 @@ inline ExportType& ExportType::operator=(const ExportType& other) {
 //// Frame ////
 inline Frame::Frame(Ref func,
                     u32 values,
-                    u32 exceptions,
                     u32 offset,
                     Instance* inst,
                     Module* mod)
     : func(func),
       values(values),
-      exceptions(exceptions),
       offset(offset),
       inst(inst),
       mod(mod) {}
@@ -416,6 +414,13 @@ template <> inline bool HasType<f32>(ValueType type) { return type == ValueType:
 template <> inline bool HasType<f64>(ValueType type) { return type == ValueType::F64; }
 template <> inline bool HasType<Ref>(ValueType type) { return IsReference(type); }
 
+template <> inline ValueType GetValueType<s32>() { return ValueType::I32; }
+template <> inline ValueType GetValueType<u32>() { return ValueType::I32; }
+template <> inline ValueType GetValueType<s64>() { return ValueType::I64; }
+template <> inline ValueType GetValueType<u64>() { return ValueType::I64; }
+template <> inline ValueType GetValueType<f32>() { return ValueType::F32; }
+template <> inline ValueType GetValueType<f64>() { return ValueType::F64; }
+
 template <typename T>
 void RequireType(ValueType type) {
   assert(HasType<T>(type));
@@ -477,6 +482,21 @@ template <> inline void WABT_VECTORCALL Value::Set<f64>(f64 val) { f64_ = val; S
 template <> inline void WABT_VECTORCALL Value::Set<v128>(v128 val) { v128_ = val; SetType(ValueType::V128); }
 template <> inline void WABT_VECTORCALL Value::Set<Ref>(Ref val) { ref_ = val; SetType(ValueType::ExternRef); }
 
+inline Value WABT_VECTORCALL Value::MakeBits(u64 low, u64 high) {
+  Value res;
+  res.v128_.set_u64(0, low);
+  res.v128_.set_u64(1, high);
+  return res;
+}
+
+inline u64 WABT_VECTORCALL Value::GetLowBits() const {
+  return v128_.u64(0);
+}
+
+inline u64 WABT_VECTORCALL Value::GetHighBits() const {
+  return v128_.u64(1);
+}
+
 //// Store ////
 inline bool Store::IsValid(Ref ref) const {
   return objects_.IsUsed(ref.index) && objects_.Get(ref.index);
@@ -501,6 +521,12 @@ RefPtr<T> Store::UnsafeGet(Ref ref) {
   return RefPtr<T>(*this, ref);
 }
 
+template <typename T>
+T* Store::UnsafeGetRaw(Ref ref) {
+  assert(Is<T>(ref));
+  return cast<T>(objects_.Get(ref.index));
+}
+
 template <typename T, typename... Args>
 RefPtr<T> Store::Alloc(Args&&... args) {
   Ref ref{objects_.New(new T(std::forward<Args>(args)...))};
@@ -521,6 +547,14 @@ inline std::set<Thread*>& Store::threads() {
   return threads_;
 }
 
+inline u64 Store::epoch() const {
+  return epoch_.load(std::memory_order_relaxed);
+}
+
+inline void Store::IncrementEpoch() {
+  epoch_.fetch_add(1, std::memory_order_relaxed);
+}
+
 //// Object ////
 // static
 inline bool Object::classof(const Object* obj) {
@@ -638,6 +672,10 @@ inline const ExternType& Func::extern_type() {
   return type_;
 }
 
+inline Index Func::type_id() const {
+  return type_id_;
+}
+
 inline const FuncType& Func::type() const {
   return type_;
 }
@@ -651,8 +689,9 @@ inline bool DefinedFunc::classof(const Object* obj) {
 // static
 inline DefinedFunc::Ptr DefinedFunc::New(Store& store,
                                          Ref instance,
-                                         FuncDesc desc) {
-  return store.Alloc<DefinedFunc>(store, instance, desc);
+                                         FuncDesc desc,
+                                         Index index) {
+  return store.Alloc<DefinedFunc>(store, instance, desc, index);
 }
 
 inline Ref DefinedFunc::instance() const {
@@ -663,6 +702,10 @@ inline const FuncDesc& DefinedFunc::desc() const {
   return desc_;
 }
 
+inline Index DefinedFunc::index() const {
+  return index_;
+}
+
 //// HostFunc ////
 // static
 inline bool HostFunc::classof(const Object* obj) {
@@ -674,6 +717,74 @@ inline HostFunc::Ptr HostFunc::New(Store& store, FuncType type, Callback cb) {
   return store.Alloc<HostFunc>(store, type, cb);
 }
 
+// static
+inline HostFunc::Ptr HostFunc::New(Store& store,
+                                   FuncType type,
+                                   FastCallback cb,
+                                   void* user_data) {
+  return store.Alloc<HostFunc>(store, type, cb, user_data);
+}
+
+template <typename R, typename... Args>
+struct HostFunc::TypedCallback<R(Args...)> {
+  static FuncType GetType() {
+    return FuncType{{GetValueType<Args>()...}, {GetValueType<R>()}};
+  }
+
+  static Result Call(Thread& thread,
+                     const HostFunc& func,
+                     Span<const Value> params,
+                     Span<Value> results,
+                     Trap::Ptr* out_trap) {
+    results[0] = Value::Make(
+        Invoke(reinterpret_cast<R (*)(Args...)>(func.typed_fn_), params,
+               std::index_sequence_for<Args...>{}));
+    return Result::Ok;
+  }
+
+  template <size_t... I>
+  static R Invoke(R (*fn)(Args...),
+                  Span<const Value> params,
+                  std::index_sequence<I...>) {
+    return fn(params[I].template Get<Args>()...);
+  }
+};
+
+template <typename... Args>
+struct HostFunc::TypedCallback<void(Args...)> {
+  static FuncType GetType() { return FuncType{{GetValueType<Args>()...}, {}}; }
+
+  static Result Call(Thread& thread,
+                     const HostFunc& func,
+                     Span<const Value> params,
+                     Span<Value> results,
+                     Trap::Ptr* out_trap) {
+    Invoke(reinterpret_cast<void (*)(Args...)>(func.typed_fn_), params,
+           std::index_sequence_for<Args...>{});
+    return Result::Ok;
+  }
+
+  template <size_t... I>
+  static void Invoke(void (*fn)(Args...),
+                     Span<const Value> params,
+                     std::index_sequence<I...>) {
+    fn(params[I].template Get<Args>()...);
+  }
+};
+
+// static
+template <typename Sig>
+HostFunc::Ptr HostFunc::New(Store& store, Sig* fn) {
+  HostFunc::Ptr func =
+      New(store, TypedCallback<Sig>::GetType(), &TypedCallback<Sig>::Call);
+  func->typed_fn_ = reinterpret_cast<GenericFn>(fn);
+  return func;
+}
+
+inline void* HostFunc::user_data() const {
+  return user_data_;
+}
+
 //// Table ////
 // static
 inline bool Table::classof(const Object* obj) {
@@ -701,6 +812,10 @@ inline u32 Table::size() const {
   return static_cast<u32>(elements_.size());
 }
 
+inline u32 Table::generation() const {
+  return generation_;
+}
+
 //// Memory ////
 // static
 inline bool Memory::classof(const Object* obj) {
@@ -714,8 +829,8 @@ inline Memory::Ptr Memory::New(interp::Store& store, MemoryType type) {
 
 inline bool Memory::IsValidAccess(u64 offset, u64 addend, u64 size) const {
   // FIXME: make this faster.
-  return offset <= data_.size() && addend <= data_.size() &&
-         size <= data_.size() && offset + addend + size <= data_.size();
+  return offset <= size_ && addend <= size_ && size <= size_ &&
+         offset + addend + size <= size_;
 }
 
 inline bool Memory::IsValidAtomicAccess(u64 offset,
@@ -730,8 +845,8 @@ Result Memory::Load(u64 offset, u64 addend, T* out) const {
   if (!IsValidAccess(offset, addend, sizeof(T))) {
     return Result::Error;
   }
-  wabt::MemcpyEndianAware(out, data_.data(), sizeof(T), data_.size(), 0,
-                          offset + addend, sizeof(T));
+  wabt::MemcpyEndianAware(out, data_, sizeof(T), size_, 0, offset + addend,
+                          sizeof(T));
   return Result::Ok;
 }
 
@@ -739,8 +854,8 @@ template <typename T>
 T WABT_VECTORCALL Memory::UnsafeLoad(u64 offset, u64 addend) const {
   assert(IsValidAccess(offset, addend, sizeof(T)));
   T val;
-  wabt::MemcpyEndianAware(&val, data_.data(), sizeof(T), data_.size(), 0,
-                          offset + addend, sizeof(T));
+  wabt::MemcpyEndianAware(&val, data_, sizeof(T), size_, 0, offset + addend,
+                          sizeof(T));
   return val;
 }
 
@@ -749,8 +864,8 @@ Result WABT_VECTORCALL Memory::Store(u64 offset, u64 addend, T val) {
   if (!IsValidAccess(offset, addend, sizeof(T))) {
     return Result::Error;
   }
-  wabt::MemcpyEndianAware(data_.data(), &val, data_.size(), sizeof(T),
-                          offset + addend, 0, sizeof(T));
+  wabt::MemcpyEndianAware(data_, &val, size_, sizeof(T), offset + addend, 0,
+                          sizeof(T));
   return Result::Ok;
 }
 
@@ -759,8 +874,8 @@ Result Memory::AtomicLoad(u64 offset, u64 addend, T* out) const {
   if (!IsValidAtomicAccess(offset, addend, sizeof(T))) {
     return Result::Error;
   }
-  wabt::MemcpyEndianAware(out, data_.data(), sizeof(T), data_.size(), 0,
-                          offset + addend, sizeof(T));
+  wabt::MemcpyEndianAware(out, data_, sizeof(T), size_, 0, offset + addend,
+                          sizeof(T));
   return Result::Ok;
 }
 
@@ -769,8 +884,8 @@ Result Memory::AtomicStore(u64 offset, u64 addend, T val) {
   if (!IsValidAtomicAccess(offset, addend, sizeof(T))) {
     return Result::Error;
   }
-  wabt::MemcpyEndianAware(data_.data(), &val, data_.size(), sizeof(T),
-                          offset + addend, 0, sizeof(T));
+  wabt::MemcpyEndianAware(data_, &val, size_, sizeof(T), offset + addend, 0,
+                          sizeof(T));
   return Result::Ok;
 }
 
@@ -799,11 +914,11 @@ Result Memory::AtomicRmwCmpxchg(u64 offset,
 }
 
 inline u8* Memory::UnsafeData() {
-  return data_.data();
+  return data_;
 }
 
 inline u64 Memory::ByteSize() const {
-  return data_.size();
+  return size_;
 }
 
 inline u64 Memory::PageSize() const {
@@ -937,6 +1052,10 @@ inline const std::vector<ExportType>& Module::export_types() const {
   return export_types_;
 }
 
+inline Index Module::func_type_id(Index index) const {
+  return func_type_ids_[index];
+}
+
 //// Instance ////
 // static
 inline bool Instance::classof(const Object* obj) {
@@ -991,10 +1110,51 @@ inline std::vector<DataSegment>& Instance::datas() {
   return datas_;
 }
 
+inline Func* Instance::func_ptr(Index index) const {
+  return func_ptrs_[index];
+}
+
+inline Table* Instance::table_ptr(Index index) const {
+  return table_ptrs_[index];
+}
+
+inline Memory* Instance::memory_ptr(Index index) const {
+  return memory_ptrs_[index];
+}
+
+inline Global* Instance::global_ptr(Index index) const {
+  return global_ptrs_[index];
+}
+
+inline Instance::CallIndirectCache& Instance::call_indirect_cache(
+    Index index) {
+  return call_indirect_caches_[index];
+}
+
 //// Thread ////
 inline Store& Thread::store() {
   return store_;
 }
 
+inline void Thread::Suspend() {
+  suspend_requested_ = true;
+}
+
+inline bool Thread::suspended() const {
+  return suspended_;
+}
+
+inline u64 Thread::fuel() const {
+  return fuel_;
+}
+
+inline void Thread::set_fuel(u64 fuel) {
+  fuel_ = fuel;
+}
+
+inline void Thread::set_epoch_deadline(u64 deadline) {
+  epoch_deadline_ = deadline;
+}
+
 }  // namespace interp
 }  // namespace wabt
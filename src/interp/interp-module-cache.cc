@@ -0,0 +1,912 @@
+/*
+ * Copyright 2026 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/interp/interp-module-cache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "src/binary-reader.h"
+#include "src/cast.h"
+#include "src/interp/binary-reader-interp.h"
+#include "src/make-unique.h"
+#include "src/stream.h"
+
+namespace wabt {
+namespace interp {
+
+namespace {
+
+const char kMagic[4] = {'\0', 'w', 'i', 'c'};
+// Must be incremented whenever the serialized format or the istream encoding
+// changes.
+const u32 kFormatVersion = 7;
+// Written in host byte order, so a cache created on a host with a different
+// byte order is rejected.
+const u32 kByteOrderMark = 0x01020304;
+
+class DescWriter {
+ public:
+  explicit DescWriter(Stream* stream) : stream_(stream) {}
+
+  void Write(const ModuleDesc&);
+
+ private:
+  void WriteU8(u8 value) { stream_->WriteU8(value); }
+  void WriteU32(u32 value) { stream_->WriteU32(value); }
+  void WriteU64(u64 value) { stream_->WriteU64(value); }
+  void WriteString(std::string_view);
+  void WriteBuffer(const Buffer&);
+  void WriteValueType(ValueType);
+  void WriteValueTypes(const ValueTypes&);
+  void WriteLimits(const Limits&);
+  void WriteExternType(const ExternType&);
+  void WriteFuncDesc(const FuncDesc&);
+
+  template <typename T, typename F>
+  void WriteVector(const std::vector<T>& vec, F&& write_elem) {
+    WriteU32(static_cast<u32>(vec.size()));
+    for (auto&& elem : vec) {
+      write_elem(elem);
+    }
+  }
+
+  Stream* stream_;
+};
+
+void DescWriter::WriteString(std::string_view str) {
+  WriteU32(static_cast<u32>(str.size()));
+  stream_->WriteData(str.data(), str.size());
+}
+
+void DescWriter::WriteBuffer(const Buffer& buffer) {
+  WriteU32(static_cast<u32>(buffer.size()));
+  stream_->WriteData(buffer.data(), buffer.size());
+}
+
+void DescWriter::WriteValueType(ValueType type) {
+  WriteU32(static_cast<u32>(static_cast<Type::Enum>(type)));
+  WriteU32(type.IsReferenceWithIndex() ? type.GetReferenceIndex()
+                                       : kInvalidIndex);
+}
+
+void DescWriter::WriteValueTypes(const ValueTypes& types) {
+  WriteVector(types, [&](ValueType type) { WriteValueType(type); });
+}
+
+void DescWriter::WriteLimits(const Limits& limits) {
+  WriteU64(limits.initial);
+  WriteU64(limits.max);
+  WriteU8(limits.has_max);
+  WriteU8(limits.is_shared);
+  WriteU8(limits.is_64);
+}
+
+void DescWriter::WriteExternType(const ExternType& type) {
+  WriteU8(static_cast<u8>(type.kind));
+  switch (type.kind) {
+    case ExternKind::Func: {
+      auto&& func_type = *cast<FuncType>(&type);
+      WriteValueTypes(func_type.params);
+      WriteValueTypes(func_type.results);
+      break;
+    }
+
+    case ExternKind::Table: {
+      auto&& table_type = *cast<TableType>(&type);
+      WriteValueType(table_type.element);
+      WriteLimits(table_type.limits);
+      break;
+    }
+
+    case ExternKind::Memory:
+      WriteLimits(cast<MemoryType>(&type)->limits);
+      break;
+
+    case ExternKind::Global: {
+      auto&& global_type = *cast<GlobalType>(&type);
+      WriteValueType(global_type.type);
+      WriteU8(static_cast<u8>(global_type.mut));
+      break;
+    }
+
+    case ExternKind::Tag: {
+      auto&& tag_type = *cast<TagType>(&type);
+      WriteU8(static_cast<u8>(tag_type.attr));
+      WriteValueTypes(tag_type.signature);
+      break;
+    }
+  }
+}
+
+void DescWriter::WriteFuncDesc(const FuncDesc& func) {
+  WriteExternType(func.type);
+  WriteVector(func.locals, [&](const LocalDesc& local) {
+    WriteValueType(local.type);
+    WriteU32(local.count);
+    WriteU32(local.end);
+  });
+  WriteU32(func.code_offset);
+  WriteVector(func.handlers, [&](const HandlerDesc& handler) {
+    WriteU8(static_cast<u8>(handler.kind));
+    WriteU32(handler.try_start_offset);
+    WriteU32(handler.try_end_offset);
+    WriteVector(handler.catches, [&](const CatchDesc& catch_) {
+      WriteU32(catch_.tag_index);
+      WriteU32(catch_.offset);
+    });
+    // Same storage as delegate_handler_index.
+    WriteU32(handler.catch_all_offset);
+    WriteU32(handler.values);
+  });
+  WriteVector(func.block_offsets, [&](u32 offset) { WriteU32(offset); });
+  WriteString(func.name);
+}
+
+void DescWriter::Write(const ModuleDesc& module) {
+  stream_->WriteData(kMagic, sizeof(kMagic));
+  WriteU32(kFormatVersion);
+  WriteU32(kByteOrderMark);
+
+  WriteVector(module.func_types,
+              [&](const FuncType& type) { WriteExternType(type); });
+  WriteVector(module.imports, [&](const ImportDesc& import) {
+    WriteString(import.type.module);
+    WriteString(import.type.name);
+    WriteExternType(*import.type.type);
+  });
+  WriteVector(module.funcs,
+              [&](const FuncDesc& func) { WriteFuncDesc(func); });
+  WriteVector(module.tables,
+              [&](const TableDesc& table) { WriteExternType(table.type); });
+  WriteVector(module.memories,
+              [&](const MemoryDesc& memory) { WriteExternType(memory.type); });
+  WriteVector(module.globals, [&](const GlobalDesc& global) {
+    WriteExternType(global.type);
+    WriteFuncDesc(global.init_func);
+  });
+  WriteVector(module.tags,
+              [&](const TagDesc& tag) { WriteExternType(tag.type); });
+  WriteVector(module.exports, [&](const ExportDesc& export_) {
+    WriteString(export_.type.name);
+    WriteExternType(*export_.type.type);
+    WriteU32(export_.index);
+  });
+  WriteVector(module.starts,
+              [&](const StartDesc& start) { WriteU32(start.func_index); });
+  WriteVector(module.elems, [&](const ElemDesc& elem) {
+    WriteVector(elem.elements, [&](const ElemExpr& expr) {
+      WriteU8(static_cast<u8>(expr.kind));
+      WriteU32(expr.index);
+    });
+    WriteValueType(elem.type);
+    WriteU8(static_cast<u8>(elem.mode));
+    WriteU32(elem.table_index);
+    WriteFuncDesc(elem.init_func);
+  });
+  WriteVector(module.datas, [&](const DataDesc& data) {
+    WriteBuffer(data.data);
+    WriteU8(static_cast<u8>(data.mode));
+    WriteU32(data.memory_index);
+    WriteFuncDesc(data.init_func);
+  });
+  WriteBuffer(module.istream.data());
+  WriteU32(module.num_call_indirect_sites);
+  WriteVector(module.stack_maps, [&](const StackMapDesc& map) {
+    WriteU32(map.offset);
+    WriteVector(map.ref_slots, [&](u32 slot) { WriteU32(slot); });
+  });
+  WriteU8(module.uses_v128);
+}
+
+// Checks that the offsets and indices in a ModuleDesc are in range, since the
+// interpreter trusts them.
+class DescChecker {
+ public:
+  explicit DescChecker(const ModuleDesc& module) : module_(module) {}
+
+  Result Check();
+
+ private:
+  bool IsValidOffset(u32 offset) const {
+    return offset <= module_.istream.end();
+  }
+  Result CheckValueType(ValueType);
+  Result CheckValueTypes(const ValueTypes&);
+  Result CheckFuncDesc(const FuncDesc&, bool has_code);
+  Index NumImports(ExternKind) const;
+
+  const ModuleDesc& module_;
+};
+
+Result DescChecker::CheckValueType(ValueType type) {
+  if (type.IsReferenceWithIndex() &&
+      type.GetReferenceIndex() >= module_.func_types.size()) {
+    return Result::Error;
+  }
+  return Result::Ok;
+}
+
+Result DescChecker::CheckValueTypes(const ValueTypes& types) {
+  for (ValueType type : types) {
+    CHECK_RESULT(CheckValueType(type));
+  }
+  return Result::Ok;
+}
+
+Result DescChecker::CheckFuncDesc(const FuncDesc& func, bool has_code) {
+  CHECK_RESULT(CheckValueTypes(func.type.params));
+  CHECK_RESULT(CheckValueTypes(func.type.results));
+  for (const LocalDesc& local : func.locals) {
+    CHECK_RESULT(CheckValueType(local.type));
+  }
+  // The code of an init expression is optional, e.g. for a passive segment.
+  if (func.code_offset == Istream::kInvalidOffset) {
+    return has_code ? Result::Error : Result::Ok;
+  }
+  if (func.code_offset >= module_.istream.end()) {
+    return Result::Error;
+  }
+  Index num_tags = NumImports(ExternKind::Tag) + module_.tags.size();
+  for (const HandlerDesc& handler : func.handlers) {
+    // The implicit handler of a function body has no end offset.
+    if (!IsValidOffset(handler.try_start_offset) ||
+        (handler.try_end_offset != Istream::kInvalidOffset &&
+         !IsValidOffset(handler.try_end_offset))) {
+      return Result::Error;
+    }
+    for (const CatchDesc& catch_ : handler.catches) {
+      if (catch_.tag_index >= num_tags || !IsValidOffset(catch_.offset)) {
+        return Result::Error;
+      }
+    }
+    if (handler.kind == HandlerKind::Delegate) {
+      if (handler.delegate_handler_index != kInvalidIndex &&
+          handler.delegate_handler_index >= func.handlers.size()) {
+        return Result::Error;
+      }
+    } else if (handler.catch_all_offset != Istream::kInvalidOffset &&
+               !IsValidOffset(handler.catch_all_offset)) {
+      return Result::Error;
+    }
+  }
+  for (u32 offset : func.block_offsets) {
+    if (!IsValidOffset(offset)) {
+      return Result::Error;
+    }
+  }
+  return Result::Ok;
+}
+
+Index DescChecker::NumImports(ExternKind kind) const {
+  Index count = 0;
+  for (const ImportDesc& import : module_.imports) {
+    if (import.type.type->kind == kind) {
+      count++;
+    }
+  }
+  return count;
+}
+
+Result DescChecker::Check() {
+  for (const FuncType& type : module_.func_types) {
+    CHECK_RESULT(CheckValueTypes(type.params));
+    CHECK_RESULT(CheckValueTypes(type.results));
+  }
+  Index num_funcs = NumImports(ExternKind::Func) + module_.funcs.size();
+  Index num_tables = NumImports(ExternKind::Table) + module_.tables.size();
+  Index num_memories =
+      NumImports(ExternKind::Memory) + module_.memories.size();
+  Index num_globals = NumImports(ExternKind::Global) + module_.globals.size();
+  Index num_tags = NumImports(ExternKind::Tag) + module_.tags.size();
+
+  for (const FuncDesc& func : module_.funcs) {
+    CHECK_RESULT(CheckFuncDesc(func, true));
+  }
+  for (const GlobalDesc& global : module_.globals) {
+    CHECK_RESULT(CheckValueType(global.type.type));
+    CHECK_RESULT(CheckFuncDesc(global.init_func, false));
+  }
+  for (const ExportDesc& export_ : module_.exports) {
+    Index count = 0;
+    switch (export_.type.type->kind) {
+      case ExternKind::Func:
+        count = num_funcs;
+        break;
+      case ExternKind::Table:
+        count = num_tables;
+        break;
+      case ExternKind::Memory:
+        count = num_memories;
+        break;
+      case ExternKind::Global:
+        count = num_globals;
+        break;
+      case ExternKind::Tag:
+        count = num_tags;
+        break;
+    }
+    if (export_.index >= count) {
+      return Result::Error;
+    }
+  }
+  for (const StartDesc& start : module_.starts) {
+    if (start.func_index >= num_funcs) {
+      return Result::Error;
+    }
+  }
+  for (const ElemDesc& elem : module_.elems) {
+    for (const ElemExpr& expr : elem.elements) {
+      if (expr.kind == ElemKind::RefFunc && expr.index >= num_funcs) {
+        return Result::Error;
+      }
+    }
+    if (elem.mode == SegmentMode::Active && elem.table_index >= num_tables) {
+      return Result::Error;
+    }
+    CHECK_RESULT(CheckFuncDesc(elem.init_func, false));
+  }
+  for (const DataDesc& data : module_.datas) {
+    if (data.mode == SegmentMode::Active &&
+        data.memory_index >= num_memories) {
+      return Result::Error;
+    }
+    CHECK_RESULT(CheckFuncDesc(data.init_func, false));
+  }
+  // Thread::Mark looks up the stack maps with a binary search.
+  u32 last_offset = 0;
+  for (const StackMapDesc& map : module_.stack_maps) {
+    if (map.offset < last_offset || !IsValidOffset(map.offset)) {
+      return Result::Error;
+    }
+    last_offset = map.offset;
+  }
+  return Result::Ok;
+}
+
+class DescReader {
+ public:
+  DescReader(const void* data, size_t size)
+      : data_(static_cast<const u8*>(data)), end_(data_ + size) {}
+
+  Result Read(ModuleDesc*);
+
+ private:
+  template <typename T>
+  Result ReadRaw(T* out) {
+    if (static_cast<size_t>(end_ - data_) < sizeof(T)) {
+      return Result::Error;
+    }
+    memcpy(out, data_, sizeof(T));
+    data_ += sizeof(T);
+    return Result::Ok;
+  }
+
+  template <typename T>
+  Result ReadEnum(T* out, T last) {
+    u8 value;
+    CHECK_RESULT(ReadRaw(&value));
+    if (value > static_cast<u8>(last)) {
+      return Result::Error;
+    }
+    *out = static_cast<T>(value);
+    return Result::Ok;
+  }
+
+  Result ReadBool(bool* out);
+  Result ReadString(std::string* out);
+  Result ReadBuffer(Buffer* out);
+  Result ReadValueType(ValueType* out);
+  Result ReadValueTypes(ValueTypes* out);
+  Result ReadLimits(Limits* out);
+  Result ReadExternType(std::unique_ptr<ExternType>* out);
+  template <typename T>
+  Result ReadExternType(std::unique_ptr<T>* out);
+  Result ReadFuncDesc(std::unique_ptr<FuncDesc>* out);
+
+  template <typename T, typename F>
+  Result ReadVector(std::vector<T>* out, F&& read_elem) {
+    u32 count;
+    CHECK_RESULT(ReadRaw(&count));
+    // Each element takes at least one byte, so this also rejects counts that
+    // are too large before reserving any memory for them.
+    if (count > static_cast<size_t>(end_ - data_)) {
+      return Result::Error;
+    }
+    out->reserve(count);
+    for (u32 i = 0; i < count; ++i) {
+      CHECK_RESULT(read_elem());
+    }
+    return Result::Ok;
+  }
+
+  const u8* data_;
+  const u8* end_;
+};
+
+Result DescReader::ReadBool(bool* out) {
+  u8 value;
+  CHECK_RESULT(ReadRaw(&value));
+  *out = value != 0;
+  return Result::Ok;
+}
+
+Result DescReader::ReadString(std::string* out) {
+  u32 size;
+  CHECK_RESULT(ReadRaw(&size));
+  if (size > static_cast<size_t>(end_ - data_)) {
+    return Result::Error;
+  }
+  out->assign(reinterpret_cast<const char*>(data_), size);
+  data_ += size;
+  return Result::Ok;
+}
+
+Result DescReader::ReadBuffer(Buffer* out) {
+  u32 size;
+  CHECK_RESULT(ReadRaw(&size));
+  if (size > static_cast<size_t>(end_ - data_)) {
+    return Result::Error;
+  }
+  out->assign(data_, data_ + size);
+  data_ += size;
+  return Result::Ok;
+}
+
+Result DescReader::ReadValueType(ValueType* out) {
+  u32 code;
+  u32 type_index;
+  CHECK_RESULT(ReadRaw(&code));
+  CHECK_RESULT(ReadRaw(&type_index));
+  auto type_enum = static_cast<Type::Enum>(code);
+  if (type_enum == Type::Reference) {
+    *out = ValueType(type_enum, type_index);
+  } else {
+    *out = ValueType(type_enum);
+  }
+  return Result::Ok;
+}
+
+Result DescReader::ReadValueTypes(ValueTypes* out) {
+  return ReadVector(out, [&]() {
+    ValueType type;
+    CHECK_RESULT(ReadValueType(&type));
+    out->push_back(type);
+    return Result::Ok;
+  });
+}
+
+Result DescReader::ReadLimits(Limits* out) {
+  CHECK_RESULT(ReadRaw(&out->initial));
+  CHECK_RESULT(ReadRaw(&out->max));
+  CHECK_RESULT(ReadBool(&out->has_max));
+  CHECK_RESULT(ReadBool(&out->is_shared));
+  CHECK_RESULT(ReadBool(&out->is_64));
+  return Result::Ok;
+}
+
+Result DescReader::ReadExternType(std::unique_ptr<ExternType>* out) {
+  ExternKind kind;
+  CHECK_RESULT(ReadEnum(&kind, ExternKind::Last));
+  switch (kind) {
+    case ExternKind::Func: {
+      ValueTypes params;
+      ValueTypes results;
+      CHECK_RESULT(ReadValueTypes(&params));
+      CHECK_RESULT(ReadValueTypes(&results));
+      *out = MakeUnique<FuncType>(std::move(params), std::move(results));
+      break;
+    }
+
+    case ExternKind::Table: {
+      ValueType element;
+      Limits limits;
+      CHECK_RESULT(ReadValueType(&element));
+      CHECK_RESULT(ReadLimits(&limits));
+      *out = MakeUnique<TableType>(element, limits);
+      break;
+    }
+
+    case ExternKind::Memory: {
+      Limits limits;
+      CHECK_RESULT(ReadLimits(&limits));
+      *out = MakeUnique<MemoryType>(limits);
+      break;
+    }
+
+    case ExternKind::Global: {
+      ValueType type;
+      Mutability mut;
+      CHECK_RESULT(ReadValueType(&type));
+      CHECK_RESULT(ReadEnum(&mut, Mutability::Var));
+      *out = MakeUnique<GlobalType>(type, mut);
+      break;
+    }
+
+    case ExternKind::Tag: {
+      TagAttr attr;
+      ValueTypes signature;
+      CHECK_RESULT(ReadEnum(&attr, TagAttr::Exception));
+      CHECK_RESULT(ReadValueTypes(&signature));
+      *out = MakeUnique<TagType>(attr, signature);
+      break;
+    }
+  }
+  return Result::Ok;
+}
+
+template <typename T>
+Result DescReader::ReadExternType(std::unique_ptr<T>* out) {
+  std::unique_ptr<ExternType> type;
+  CHECK_RESULT(ReadExternType(&type));
+  if (!isa<T>(type.get())) {
+    return Result::Error;
+  }
+  out->reset(cast<T>(type.release()));
+  return Result::Ok;
+}
+
+Result DescReader::ReadFuncDesc(std::unique_ptr<FuncDesc>* out) {
+  std::unique_ptr<FuncType> type;
+  CHECK_RESULT(ReadExternType(&type));
+  *out = MakeUnique<FuncDesc>(
+      FuncDesc{*type, {}, Istream::kInvalidOffset, {}, {}, {}});
+  FuncDesc& func = **out;
+  CHECK_RESULT(ReadVector(&func.locals, [&]() {
+    LocalDesc local;
+    CHECK_RESULT(ReadValueType(&local.type));
+    CHECK_RESULT(ReadRaw(&local.count));
+    CHECK_RESULT(ReadRaw(&local.end));
+    func.locals.push_back(local);
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadRaw(&func.code_offset));
+  CHECK_RESULT(ReadVector(&func.handlers, [&]() {
+    HandlerDesc handler;
+    CHECK_RESULT(ReadEnum(&handler.kind, HandlerKind::Delegate));
+    CHECK_RESULT(ReadRaw(&handler.try_start_offset));
+    CHECK_RESULT(ReadRaw(&handler.try_end_offset));
+    CHECK_RESULT(ReadVector(&handler.catches, [&]() {
+      CatchDesc catch_;
+      CHECK_RESULT(ReadRaw(&catch_.tag_index));
+      CHECK_RESULT(ReadRaw(&catch_.offset));
+      handler.catches.push_back(catch_);
+      return Result::Ok;
+    }));
+    CHECK_RESULT(ReadRaw(&handler.catch_all_offset));
+    CHECK_RESULT(ReadRaw(&handler.values));
+    func.handlers.push_back(std::move(handler));
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&func.block_offsets, [&]() {
+    u32 offset;
+    CHECK_RESULT(ReadRaw(&offset));
+    func.block_offsets.push_back(offset);
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadString(&func.name));
+  return Result::Ok;
+}
+
+Result DescReader::Read(ModuleDesc* out) {
+  char magic[sizeof(kMagic)];
+  u32 version;
+  u32 byte_order_mark;
+  CHECK_RESULT(ReadRaw(&magic));
+  CHECK_RESULT(ReadRaw(&version));
+  CHECK_RESULT(ReadRaw(&byte_order_mark));
+  if (memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      version != kFormatVersion || byte_order_mark != kByteOrderMark) {
+    return Result::Error;
+  }
+
+  CHECK_RESULT(ReadVector(&out->func_types, [&]() {
+    std::unique_ptr<FuncType> type;
+    CHECK_RESULT(ReadExternType(&type));
+    out->func_types.push_back(*type);
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->imports, [&]() {
+    std::string module;
+    std::string name;
+    std::unique_ptr<ExternType> type;
+    CHECK_RESULT(ReadString(&module));
+    CHECK_RESULT(ReadString(&name));
+    CHECK_RESULT(ReadExternType(&type));
+    out->imports.push_back(
+        ImportDesc{ImportType(std::move(module), std::move(name),
+                              std::move(type))});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->funcs, [&]() {
+    std::unique_ptr<FuncDesc> func;
+    CHECK_RESULT(ReadFuncDesc(&func));
+    out->funcs.push_back(std::move(*func));
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->tables, [&]() {
+    std::unique_ptr<TableType> type;
+    CHECK_RESULT(ReadExternType(&type));
+    out->tables.push_back(TableDesc{*type});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->memories, [&]() {
+    std::unique_ptr<MemoryType> type;
+    CHECK_RESULT(ReadExternType(&type));
+    out->memories.push_back(MemoryDesc{*type});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->globals, [&]() {
+    std::unique_ptr<GlobalType> type;
+    std::unique_ptr<FuncDesc> init_func;
+    CHECK_RESULT(ReadExternType(&type));
+    CHECK_RESULT(ReadFuncDesc(&init_func));
+    out->globals.push_back(GlobalDesc{*type, std::move(*init_func)});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->tags, [&]() {
+    std::unique_ptr<TagType> type;
+    CHECK_RESULT(ReadExternType(&type));
+    out->tags.push_back(TagDesc{*type});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->exports, [&]() {
+    std::string name;
+    std::unique_ptr<ExternType> type;
+    Index index;
+    CHECK_RESULT(ReadString(&name));
+    CHECK_RESULT(ReadExternType(&type));
+    CHECK_RESULT(ReadRaw(&index));
+    out->exports.push_back(
+        ExportDesc{ExportType(std::move(name), std::move(type)), index});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->starts, [&]() {
+    StartDesc start;
+    CHECK_RESULT(ReadRaw(&start.func_index));
+    out->starts.push_back(start);
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->elems, [&]() {
+    std::vector<ElemExpr> elements;
+    CHECK_RESULT(ReadVector(&elements, [&]() {
+      ElemExpr expr;
+      CHECK_RESULT(ReadEnum(&expr.kind, ElemKind::RefFunc));
+      CHECK_RESULT(ReadRaw(&expr.index));
+      elements.push_back(expr);
+      return Result::Ok;
+    }));
+    ValueType type;
+    SegmentMode mode;
+    Index table_index;
+    std::unique_ptr<FuncDesc> init_func;
+    CHECK_RESULT(ReadValueType(&type));
+    CHECK_RESULT(ReadEnum(&mode, SegmentMode::Declared));
+    CHECK_RESULT(ReadRaw(&table_index));
+    CHECK_RESULT(ReadFuncDesc(&init_func));
+    out->elems.push_back(ElemDesc{std::move(elements), type, mode, table_index,
+                                  std::move(*init_func)});
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadVector(&out->datas, [&]() {
+    Buffer data;
+    SegmentMode mode;
+    Index memory_index;
+    std::unique_ptr<FuncDesc> init_func;
+    CHECK_RESULT(ReadBuffer(&data));
+    CHECK_RESULT(ReadEnum(&mode, SegmentMode::Declared));
+    CHECK_RESULT(ReadRaw(&memory_index));
+    CHECK_RESULT(ReadFuncDesc(&init_func));
+    out->datas.push_back(
+        DataDesc{std::move(data), mode, memory_index, std::move(*init_func)});
+    return Result::Ok;
+  }));
+  Buffer istream;
+  CHECK_RESULT(ReadBuffer(&istream));
+  out->istream = Istream(std::move(istream));
+  CHECK_RESULT(ReadRaw(&out->num_call_indirect_sites));
+  CHECK_RESULT(ReadVector(&out->stack_maps, [&]() {
+    StackMapDesc map;
+    CHECK_RESULT(ReadRaw(&map.offset));
+    CHECK_RESULT(ReadVector(&map.ref_slots, [&]() {
+      u32 slot;
+      CHECK_RESULT(ReadRaw(&slot));
+      map.ref_slots.push_back(slot);
+      return Result::Ok;
+    }));
+    out->stack_maps.push_back(std::move(map));
+    return Result::Ok;
+  }));
+  CHECK_RESULT(ReadBool(&out->uses_v128));
+  if (data_ != end_) {
+    return Result::Error;
+  }
+  return DescChecker(*out).Check();
+}
+
+// 64-bit FNV-1a.
+class Hasher {
+ public:
+  void Add(const void* data, size_t size) {
+    auto* bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 0x100000001b3;
+    }
+  }
+
+  template <typename T>
+  void Add(T value) {
+    Add(&value, sizeof(value));
+  }
+
+  u64 hash() const { return hash_; }
+
+ private:
+  u64 hash_ = 0xcbf29ce484222325;
+};
+
+// The options that affect how a module is read, in a form that can be hashed
+// and compared.
+std::vector<u8> GetOptionsKey(const ReadBinaryOptions& options,
+                              const FuelCosts* fuel_costs) {
+  MemoryStream stream;
+#define WABT_FEATURE(variable, flag, default_, help) \
+  stream.WriteU8(options.features.variable##_enabled());
+#include "src/feature.def"
+#undef WABT_FEATURE
+  stream.WriteU8(options.read_debug_names);
+  stream.WriteU8(fuel_costs != nullptr);
+  if (fuel_costs) {
+    for (u32 i = 0; i < Opcode::Invalid; ++i) {
+      stream.WriteU32(fuel_costs->Get(Opcode(static_cast<Opcode::Enum>(i))));
+    }
+  }
+  return std::move(stream.output_buffer().data);
+}
+
+u64 GetCacheKey(const void* data,
+                size_t size,
+                const std::vector<u8>& options_key) {
+  Hasher hasher;
+  hasher.Add(kFormatVersion);
+  hasher.Add(u64{size});
+  hasher.Add(data, size);
+  hasher.Add(options_key.data(), options_key.size());
+  return hasher.hash();
+}
+
+// A cache entry starts with the module binary and the options it was read
+// with, followed by the ModuleDesc. The file name is only a hash of them, so
+// they are compared in full before the entry is used.
+void WriteCacheEntryHeader(Stream* stream,
+                           const void* data,
+                           size_t size,
+                           const std::vector<u8>& options_key) {
+  stream->WriteU64(size);
+  stream->WriteU32(static_cast<u32>(options_key.size()));
+  stream->WriteData(options_key.data(), options_key.size());
+  stream->WriteData(data, size);
+}
+
+// Returns the size of the header if it matches, or 0 otherwise.
+size_t MatchCacheEntryHeader(const std::vector<u8>& entry,
+                             const void* data,
+                             size_t size,
+                             const std::vector<u8>& options_key) {
+  u64 entry_size;
+  u32 entry_options_size;
+  const size_t kFixedSize = sizeof(entry_size) + sizeof(entry_options_size);
+  if (entry.size() < kFixedSize) {
+    return 0;
+  }
+  memcpy(&entry_size, entry.data(), sizeof(entry_size));
+  memcpy(&entry_options_size, entry.data() + sizeof(entry_size),
+         sizeof(entry_options_size));
+  if (entry_size != size || entry_options_size != options_key.size() ||
+      entry.size() - kFixedSize < options_key.size() + size) {
+    return 0;
+  }
+  const u8* entry_options = entry.data() + kFixedSize;
+  const u8* entry_data = entry_options + options_key.size();
+  if (memcmp(entry_options, options_key.data(), options_key.size()) != 0 ||
+      memcmp(entry_data, data, size) != 0) {
+    return 0;
+  }
+  return kFixedSize + options_key.size() + size;
+}
+
+// Unlike wabt::ReadFile, a missing file is not an error worth reporting.
+bool ReadCacheFile(const std::string& path, std::vector<u8>* out_data) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fseek(file, 0, SEEK_END) == 0;
+  long size = ok ? ftell(file) : -1;
+  ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+  if (ok) {
+    out_data->resize(size);
+    ok = size == 0 || fread(out_data->data(), size, 1, file) == 1;
+  }
+  fclose(file);
+  return ok;
+}
+
+}  // namespace
+
+void WriteModuleDesc(Stream* stream, const ModuleDesc& module) {
+  DescWriter(stream).Write(module);
+}
+
+Result ReadModuleDesc(const void* data, size_t size, ModuleDesc* out_module) {
+  return DescReader(data, size).Read(out_module);
+}
+
+ModuleCache::ModuleCache(std::string dir) : dir_(std::move(dir)) {}
+
+Result ModuleCache::ReadBinaryInterp(std::string_view filename,
+                                     const void* data,
+                                     size_t size,
+                                     const ReadBinaryOptions& options,
+                                     const FuelCosts* fuel_costs,
+                                     Errors* errors,
+                                     ModuleDesc* out_module) {
+  std::vector<u8> options_key = GetOptionsKey(options, fuel_costs);
+  u64 key = GetCacheKey(data, size, options_key);
+  std::string path = dir_ + StringPrintf("/%016" PRIx64 ".wic", key);
+
+  // Any mismatch, e.g. an entry for another module whose key has the same
+  // hash, falls back to reading the module and replacing the entry.
+  std::vector<u8> cached;
+  if (ReadCacheFile(path, &cached)) {
+    size_t header_size =
+        MatchCacheEntryHeader(cached, data, size, options_key);
+    ModuleDesc module;
+    if (header_size != 0 &&
+        Succeeded(ReadModuleDesc(cached.data() + header_size,
+                                 cached.size() - header_size, &module))) {
+      *out_module = std::move(module);
+      return Result::Ok;
+    }
+  }
+
+  if (fuel_costs) {
+    CHECK_RESULT(interp::ReadBinaryInterp(filename, data, size, options,
+                                          *fuel_costs, errors, out_module));
+  } else {
+    CHECK_RESULT(interp::ReadBinaryInterp(filename, data, size, options,
+                                          errors, out_module));
+  }
+
+  // Write to a temporary file first, so other processes sharing the cache
+  // never see a partially written entry.
+  MemoryStream stream;
+  WriteCacheEntryHeader(&stream, data, size, options_key);
+  WriteModuleDesc(&stream, *out_module);
+  std::string temp_path =
+      path + StringPrintf(".%08x.tmp", std::random_device()());
+  if (Succeeded(stream.WriteToFile(temp_path))) {
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+      std::remove(temp_path.c_str());
+    }
+  }
+  return Result::Ok;
+}
+
+}  // namespace interp
+}  // namespace wabt
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2026 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WABT_INTERP_MODULE_CACHE_H_
+#define WABT_INTERP_MODULE_CACHE_H_
+
+#include <string>
+#include <string_view>
+
+#include "src/common.h"
+#include "src/error.h"
+#include "src/interp/interp.h"
+
+namespace wabt {
+
+struct ReadBinaryOptions;
+class Stream;
+
+namespace interp {
+
+class FuelCosts;
+
+// Serializes a ModuleDesc, so it can be loaded again without parsing,
+// validating and lowering the module binary. The format uses the host's byte
+// order and changes between versions of the interpreter, so it is only meant
+// to be used as a local cache.
+void WriteModuleDesc(Stream*, const ModuleDesc&);
+
+// Fails if the data is truncated, was written in a different format, or has
+// an offset or index that is out of range. The code in the istream itself is
+// not checked, so the data must come from a trusted source.
+Result ReadModuleDesc(const void* data, size_t size, ModuleDesc* out_module);
+
+// A directory of serialized ModuleDescs. Each file is named after a hash of
+// the module binary and of the options that affect how it is read. It also
+// holds the binary and the options, which are compared before the entry is
+// used, so an entry is only used to load the exact same module with the same
+// options. The directory should only be writable by trusted users.
+class ModuleCache {
+ public:
+  explicit ModuleCache(std::string dir);
+
+  // Same as ReadBinaryInterp, but the ModuleDesc is loaded from the cache if
+  // it has an entry for this module. Otherwise the module is read as usual,
+  // and added to the cache if it is valid. `fuel_costs` may be null, in which
+  // case the code is generated without fuel metering.
+  Result ReadBinaryInterp(std::string_view filename,
+                          const void* data,
+                          size_t size,
+                          const ReadBinaryOptions& options,
+                          const FuelCosts* fuel_costs,
+                          Errors*,
+                          ModuleDesc* out_module);
+
+ private:
+  std::string dir_;
+};
+
+}  // namespace interp
+}  // namespace wabt
+
+#endif  // WABT_INTERP_MODULE_CACHE_H_
@@ -0,0 +1,278 @@
+/*
+ * Copyright 2026 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/interp/interp-profiler.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <utility>
+
+#include "src/stream.h"
+
+namespace wabt {
+namespace interp {
+
+Profiler::Profiler(Store& store) : store_(store) {}
+
+Profiler::~Profiler() {
+  StopSampling();
+}
+
+void Profiler::StartSampling(std::chrono::microseconds interval) {
+  StopSampling();
+  stop_sampling_ = false;
+  sampler_ = std::thread([this, interval]() {
+    std::unique_lock<std::mutex> lock(sampler_mutex_);
+    while (!sampler_cv_.wait_for(lock, interval,
+                                 [this]() { return stop_sampling_; })) {
+      RequestSample();
+    }
+  });
+}
+
+void Profiler::StopSampling() {
+  if (!sampler_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sampler_mutex_);
+    stop_sampling_ = true;
+  }
+  sampler_cv_.notify_all();
+  sampler_.join();
+}
+
+void Profiler::RequestSample() {
+  sample_requested_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::WriteFoldedStacks(Stream* stream) const {
+  for (auto&& [stack, count] : folded_stacks_) {
+    stream->Writef("%s %" PRIu64 "\n", stack.c_str(), count);
+  }
+}
+
+void Profiler::WriteCounts(Stream* stream) const {
+  for (auto&& [index, counts] : func_counts_) {
+    // Every call runs the entry block exactly once.
+    stream->Writef("%s: %" PRIu64 "\n", counts.name.c_str(),
+                   counts.block_counts[0]);
+    for (size_t i = 0; i < counts.block_counts.size(); ++i) {
+      stream->Writef("  @%u: %" PRIu64 "\n", counts.block_offsets[i],
+                     counts.block_counts[i]);
+    }
+  }
+}
+
+void Profiler::OnBlock(const Thread& thread, Index block) {
+  const Frame& frame = thread.frames_.back();
+  FuncKey key = GetFuncKey(frame);
+  if (key != last_func_) {
+    last_func_counts_ = GetFuncCounts(key, frame);
+    last_func_ = key;
+  }
+  ++last_func_counts_->block_counts[block];
+
+  if (WABT_UNLIKELY(sample_requested_.load(std::memory_order_relaxed)) &&
+      sample_requested_.exchange(false)) {
+    Sample(thread);
+  }
+}
+
+void Profiler::Sample(const Thread& thread) {
+  std::string stack;
+  for (const Frame& frame : thread.frames_) {
+    if (!stack.empty()) {
+      stack += ';';
+    }
+    stack += GetFuncName(frame);
+  }
+  ++folded_stacks_[stack];
+}
+
+Profiler::FuncKey Profiler::GetFuncKey(const Frame& frame) {
+  // Host functions have no module.
+  if (!frame.mod) {
+    return {kInvalidIndex, kInvalidIndex};
+  }
+  return {frame.mod->self().index,
+          store_.UnsafeGetRaw<DefinedFunc>(frame.func)->index()};
+}
+
+Profiler::FuncCounts* Profiler::GetFuncCounts(const FuncKey& key,
+                                              const Frame& frame) {
+  auto iter = func_counts_.find(key);
+  if (iter != func_counts_.end()) {
+    return &iter->second;
+  }
+
+  auto* func = store_.UnsafeGetRaw<DefinedFunc>(frame.func);
+  FuncCounts& counts = func_counts_[key];
+  counts.name = GetFuncName(frame);
+  counts.block_offsets = func->desc().block_offsets;
+  counts.block_counts.resize(counts.block_offsets.size());
+  return &counts;
+}
+
+const std::string& Profiler::GetFuncName(const Frame& frame) {
+  static const std::string kHostFuncName = "<host>";
+  if (!frame.mod) {
+    return kHostFuncName;
+  }
+
+  FuncKey key = GetFuncKey(frame);
+  auto iter = func_names_.find(key);
+  if (iter != func_names_.end()) {
+    return iter->second;
+  }
+
+  if (modules_.find(key.first) == modules_.end()) {
+    modules_.emplace(key.first, Module::Ptr(store_, frame.mod->self()));
+  }
+  std::string& name = func_names_[key];
+  name = store_.UnsafeGetRaw<DefinedFunc>(frame.func)->desc().name;
+  if (name.empty()) {
+    // Fall back to the export name, or the function index.
+    for (auto&& export_ : frame.mod->desc().exports) {
+      if (export_.type.type->kind == ExternKind::Func &&
+          export_.index == key.second) {
+        name = export_.type.name;
+        break;
+      }
+    }
+    if (name.empty()) {
+      name = StringPrintf("func[%u]", key.second);
+    }
+  }
+  return name;
+}
+
+DispatchStats::DispatchStats(Store& store)
+    : opcode_counts_(Opcode::Invalid),
+      pair_counts_(Opcode::Invalid * Opcode::Invalid),
+      store_(store) {}
+
+void DispatchStats::OnInstr(Opcode opcode) {
+  ++opcode_counts_[opcode];
+  if (prev_opcode_ != Opcode::Invalid) {
+    ++pair_counts_[prev_opcode_ * Opcode::Invalid + opcode];
+  }
+  prev_opcode_ = opcode;
+}
+
+void DispatchStats::OnBranch(Opcode opcode, bool taken) {
+  auto& counts = branch_counts_[opcode];
+  ++(taken ? counts.first : counts.second);
+}
+
+void DispatchStats::OnCallIndirect(Module* mod, u32 offset, Ref func) {
+  KeepModule(mod->self());
+  std::pair<size_t, Index> target;
+  if (store_.Is<DefinedFunc>(func)) {
+    auto* defined = store_.UnsafeGetRaw<DefinedFunc>(func);
+    Ref target_mod =
+        store_.UnsafeGetRaw<Instance>(defined->instance())->module();
+    KeepModule(target_mod);
+    target = {target_mod.index, defined->index()};
+  } else {
+    if (host_funcs_.find(func.index) == host_funcs_.end()) {
+      host_funcs_.emplace(func.index, Func::Ptr(store_, func));
+    }
+    target = {kInvalidIndex, func.index};
+  }
+  call_targets_[{mod->self().index, offset}].insert(target);
+}
+
+void DispatchStats::KeepModule(Ref mod) {
+  if (modules_.find(mod.index) == modules_.end()) {
+    modules_.emplace(mod.index, Module::Ptr(store_, mod));
+  }
+}
+
+namespace {
+
+using NameCountPairs = std::vector<std::pair<std::string, u64>>;
+
+void WriteSortedCounts(Stream* stream,
+                       NameCountPairs pairs,
+                       u64 cutoff,
+                       const char* separator) {
+  // Use a stable sort to keep the elements with the same count in the order
+  // they were added.
+  std::stable_sort(pairs.begin(), pairs.end(),
+                   [](const auto& lhs, const auto& rhs) {
+                     return lhs.second > rhs.second;
+                   });
+  for (auto&& [name, count] : pairs) {
+    if (count >= cutoff) {
+      stream->Writef("%s%s%" PRIu64 "\n", name.c_str(), separator, count);
+    }
+  }
+}
+
+}  // namespace
+
+void DispatchStats::Write(Stream* stream,
+                          u64 cutoff,
+                          const char* separator) const {
+  u64 total = 0;
+  NameCountPairs opcodes;
+  for (u32 i = 0; i < Opcode::Invalid; ++i) {
+    if (opcode_counts_[i]) {
+      Opcode opcode(static_cast<Opcode::Enum>(i));
+      opcodes.emplace_back(opcode.GetName(), opcode_counts_[i]);
+      total += opcode_counts_[i];
+    }
+  }
+  stream->Writef("Total opcodes: %" PRIu64 "\n\n", total);
+  stream->Writef("Opcode counts:\n");
+  WriteSortedCounts(stream, std::move(opcodes), cutoff, separator);
+
+  NameCountPairs pairs;
+  for (u32 i = 0; i < pair_counts_.size(); ++i) {
+    if (pair_counts_[i]) {
+      Opcode fst(static_cast<Opcode::Enum>(i / Opcode::Invalid));
+      Opcode snd(static_cast<Opcode::Enum>(i % Opcode::Invalid));
+      pairs.emplace_back(
+          StringPrintf("%s %s", fst.GetName(), snd.GetName()),
+          pair_counts_[i]);
+    }
+  }
+  stream->Writef("\nOpcode pair counts:\n");
+  WriteSortedCounts(stream, std::move(pairs), cutoff, separator);
+
+  NameCountPairs branches;
+  for (auto&& [opcode, counts] : branch_counts_) {
+    branches.emplace_back(StringPrintf("%s taken", opcode.GetName()),
+                          counts.first);
+    branches.emplace_back(StringPrintf("%s not taken", opcode.GetName()),
+                          counts.second);
+  }
+  stream->Writef("\nBranch counts:\n");
+  WriteSortedCounts(stream, std::move(branches), cutoff, separator);
+
+  NameCountPairs call_targets;
+  for (auto&& [location, targets] : call_targets_) {
+    call_targets.emplace_back(
+        StringPrintf("call_indirect @%u targets", location.second),
+        targets.size());
+  }
+  stream->Writef("\ncall_indirect target counts:\n");
+  WriteSortedCounts(stream, std::move(call_targets), cutoff, separator);
+}
+
+}  // namespace interp
+}  // namespace wabt
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2026 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WABT_INTERP_PROFILER_H_
+#define WABT_INTERP_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/interp/interp.h"
+
+namespace wabt {
+
+class Stream;
+
+namespace interp {
+
+// Collects execution counts and call stack samples from the Threads that have
+// this profiler in their Thread::Options. Counts are kept per function of a
+// module, so the instances of a module share them.
+//
+// Profiling only works if fuel metering is on: only code read with fuel
+// metering (see ReadBinaryInterp) starts each basic block with an interp_fuel
+// instruction, which is where blocks are counted and where pending sample
+// requests are handled. Code read without it is never counted or sampled.
+class Profiler {
+ public:
+  explicit Profiler(Store&);
+  ~Profiler();
+
+  // Starts a thread that calls RequestSample every `interval`.
+  void StartSampling(std::chrono::microseconds interval);
+  void StopSampling();
+  // Can be called from any thread. The call stack is sampled when the running
+  // Thread enters its next basic block.
+  void RequestSample();
+
+  // Writes one line per distinct call stack and the number of times it was
+  // sampled, in the "folded" format used by flamegraph.pl and speedscope.
+  void WriteFoldedStacks(Stream*) const;
+  // Writes the number of calls to each function that was run, followed by the
+  // execution count and istream offset of each of its basic blocks.
+  void WriteCounts(Stream*) const;
+
+ private:
+  friend Thread;
+
+  struct FuncCounts {
+    std::string name;
+    std::vector<u32> block_offsets;
+    std::vector<u64> block_counts;
+  };
+
+  // The Ref index of the function's module, and the function's index in it.
+  using FuncKey = std::pair<size_t, Index>;
+
+  void OnBlock(const Thread&, Index block);
+  void Sample(const Thread&);
+  FuncKey GetFuncKey(const Frame&);
+  FuncCounts* GetFuncCounts(const FuncKey&, const Frame&);
+  const std::string& GetFuncName(const Frame&);
+
+  Store& store_;
+
+  // The modules of the functions that were seen are kept alive, so that their
+  // Ref indexes aren't reused by other modules after a garbage collection.
+  std::map<size_t, Module::Ptr> modules_;
+  std::map<FuncKey, FuncCounts> func_counts_;
+  std::map<FuncKey, std::string> func_names_;
+  // The function whose block was counted last; usually the next block is in
+  // the same function.
+  FuncKey last_func_{kInvalidIndex, kInvalidIndex};
+  FuncCounts* last_func_counts_ = nullptr;
+
+  std::map<std::string, u64> folded_stacks_;
+  std::atomic<bool> sample_requested_{false};
+
+  std::thread sampler_;
+  std::mutex sampler_mutex_;
+  std::condition_variable sampler_cv_;
+  bool stop_sampling_ = false;
+};
+
+// Counts the instructions executed by the Threads that have this in their
+// Thread::Options: each opcode, each pair of consecutive opcodes, whether
+// conditional branches were taken, and the distinct functions called by each
+// call_indirect. Unlike Profiler this works for any code, but it slows down
+// every instruction, so it is meant for collecting data offline.
+class DispatchStats {
+ public:
+  explicit DispatchStats(Store&);
+
+  // Writes the counts in the format used by wasm-opcodecnt, sorted by count.
+  // Counts less than `cutoff` are skipped.
+  void Write(Stream*, u64 cutoff = 0, const char* separator = ": ") const;
+
+ private:
+  friend Thread;
+
+  void OnInstr(Opcode);
+  void OnBranch(Opcode, bool taken);
+  void OnCallIndirect(Module*, u32 offset, Ref func);
+  void KeepModule(Ref mod);
+
+  std::vector<u64> opcode_counts_;
+  // Indexed by the previous opcode times Opcode::Invalid, plus the opcode.
+  std::vector<u64> pair_counts_;
+  Opcode prev_opcode_ = Opcode::Invalid;
+  // The number of times each opcode's branch was taken, and not taken.
+  std::map<Opcode, std::pair<u64, u64>> branch_counts_;
+
+  Store& store_;
+
+  // The modules of the call sites and called functions, and the called host
+  // functions, are kept alive so that their Ref indexes aren't reused after a
+  // garbage collection.
+  std::map<size_t, Module::Ptr> modules_;
+  std::map<size_t, Func::Ptr> host_funcs_;
+  // The called functions, keyed by the Ref index of the call_indirect's module
+  // and its offset. A function is the Ref index of its module and its index in
+  // it, or kInvalidIndex and its own Ref index for a host function.
+  std::map<std::pair<size_t, u32>, std::set<std::pair<size_t, Index>>>
+      call_targets_;
+};
+
+}  // namespace interp
+}  // namespace wabt
+
+#endif  // WABT_INTERP_PROFILER_H_
@@ -36,6 +36,7 @@
 #include "uvwasi.h"
 
 #include <cinttypes>
+#include <cstring>
 #include <unordered_map>
 
 using namespace wabt;
@@ -158,37 +159,149 @@ static_assert(offsetof(__wasi_filestat_t, ctim) == 56,
 
 // END wasi.h types from wasi-lib
 
+typedef uint64_t __wasi_dircookie_t;
+typedef uint64_t __wasi_userdata_t;
+
+// The subscription and event unions are only read and written by uvwasi's
+// serdes functions, so only their sizes are needed here.
+typedef struct __wasi_subscription_t {
+  __wasi_userdata_t userdata;
+  uint8_t u[40];
+} __wasi_subscription_t;
+
+static_assert(sizeof(__wasi_subscription_t) == 48, "witx calculated size");
+static_assert(alignof(__wasi_subscription_t) == 8, "witx calculated align");
+
+typedef struct __wasi_event_t {
+  __wasi_userdata_t userdata;
+  uint8_t u[24];
+} __wasi_event_t;
+
+static_assert(sizeof(__wasi_event_t) == 32, "witx calculated size");
+static_assert(alignof(__wasi_event_t) == 8, "witx calculated align");
+
+// WASI functions use the HostFunc::FastCallback calling convention, so they
+// can be called without allocating.
+using Params = Span<const Value>;
+using Results = Span<Value>;
+
+// The uvwasi iovecs for a single call. Most calls only pass a few iovecs, so
+// those are stored inline instead of being allocated.
+template <typename Iovec>
+class IovecBuffer {
+ public:
+  Iovec* Resize(uint32_t size) {
+    size_ = size;
+    if (size <= kInlineSize) {
+      return inline_;
+    }
+    heap_.resize(size);
+    return heap_.data();
+  }
+
+  const Iovec* data() const {
+    return size_ <= kInlineSize ? inline_ : heap_.data();
+  }
+  uint32_t size() const { return size_; }
+  const Iovec& operator[](uint32_t index) const { return data()[index]; }
+
+ private:
+  static const uint32_t kInlineSize = 16;
+
+  Iovec inline_[kInlineSize];
+  std::vector<Iovec> heap_;
+  uint32_t size_ = 0;
+};
+
 class WasiInstance {
  public:
   WasiInstance(Instance::Ptr instance,
                uvwasi_s* uvwasi,
                Memory* memory,
-               Stream* trace_stream)
+               Stream* trace_stream,
+               Stream* err_stream)
       : trace_stream(trace_stream),
+        err_stream(err_stream),
         instance(instance),
         uvwasi(uvwasi),
         memory(memory) {}
 
-  Result random_get(const Values& params, Values& results, Trap::Ptr* trap) {
+  // Writes the buffered output for stdout and stderr, and reports any error
+  // from writing buffered output that the guest hasn't been told about.
+  Result FlushOutput() {
+    flushAllOutput();
+    Result result = Result::Ok;
+    for (PendingOutput& pending : pending_output) {
+      if (pending.error != __WASI_ERRNO_SUCCESS) {
+        err_stream->Writef("wasi error: writing to %s failed: errno %d\n",
+                           &pending == pending_output ? "stdout" : "stderr",
+                           pending.error);
+        pending.error = __WASI_ERRNO_SUCCESS;
+        result = Result::Error;
+      }
+    }
+    return result;
+  }
+
+  Result random_get(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_random_get(uint8_t * buf, __wasi_size_t buf_len) */
     assert(false);
     return Result::Ok;
   }
 
-  Result proc_exit(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result proc_exit(Params params, Results results, Trap::Ptr* trap) {
     const Value arg0 = params[0];
-    uvwasi_proc_exit(uvwasi, arg0.Get<u32>());
+    uvwasi_exitcode_t code = arg0.Get<u32>();
+    if (Failed(FlushOutput()) && code == 0) {
+      code = 1;
+    }
+    uvwasi_proc_exit(uvwasi, code);
     return Result::Ok;
   }
 
-  Result poll_oneoff(const Values& params, Values& results, Trap::Ptr* trap) {
-    assert(false);
+  Result poll_oneoff(Params params, Results results, Trap::Ptr* trap) {
+    /* __wasi_errno_t __wasi_poll_oneoff(const __wasi_subscription_t *in,
+     *                                   __wasi_event_t *out,
+     *                                   __wasi_size_t nsubscriptions,
+     *                                   __wasi_size_t *nevents)
+     */
+    uint32_t in_ptr = params[0].Get<u32>();
+    uint32_t out_ptr = params[1].Get<u32>();
+    __wasi_size_t nsubscriptions = params[2].Get<u32>();
+    uint32_t nevents_ptr = params[3].Get<u32>();
+    if (trace_stream) {
+      trace_stream->Writef("poll_oneoff [%d]\n", nsubscriptions);
+    }
+    __wasi_subscription_t* wasm_in;
+    __wasi_event_t* wasm_out;
+    CHECK_RESULT(getMemPtr<__wasi_subscription_t>(in_ptr, nsubscriptions,
+                                                  &wasm_in, trap));
+    CHECK_RESULT(
+        getMemPtr<__wasi_event_t>(out_ptr, nsubscriptions, &wasm_out, trap));
+    CHECK_RESULT(getMemPtr<__wasi_size_t>(nevents_ptr, 1, nullptr, trap));
+    std::vector<uvwasi_subscription_t> in(nsubscriptions);
+    for (__wasi_size_t i = 0; i < nsubscriptions; i++) {
+      uvwasi_serdes_read_subscription_t(wasm_in, i * sizeof(*wasm_in), &in[i]);
+    }
+    // uvwasi waits on its libuv event loop, so a sleeping guest doesn't use
+    // any CPU until one of the subscriptions is ready.
+    flushAllOutput();
+    std::vector<uvwasi_event_t> out(nsubscriptions);
+    uvwasi_size_t nevents = 0;
+    results[0].Set<u32>(uvwasi_poll_oneoff(uvwasi, in.data(), out.data(),
+                                           nsubscriptions, &nevents));
+    for (uvwasi_size_t i = 0; i < nevents; i++) {
+      uvwasi_serdes_write_event_t(wasm_out, i * sizeof(*wasm_out), &out[i]);
+    }
+    CHECK_RESULT(writeValue<__wasi_size_t>(nevents, nevents_ptr, trap));
+    if (trace_stream) {
+      trace_stream->Writef("poll_oneoff -> %d [%d]\n", results[0].Get<u32>(),
+                           nevents);
+    }
     return Result::Ok;
   }
 
-  Result clock_time_get(const Values& params,
-                        Values& results,
-                        Trap::Ptr* trap) {
+  Result clock_time_get(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_clock_time_get(__wasi_clockid_t id,
      *                                      __wasi_timestamp_t precision,
      *                                      __wasi_timestamp_t *time)
@@ -201,12 +314,12 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result path_rename(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result path_rename(Params params, Results results, Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result path_open(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result path_open(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_path_open(__wasi_fd_t fd,
                                        __wasi_lookupflags_t dirflags,
                                        const char *path,
@@ -241,9 +354,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result path_filestat_get(const Values& params,
-                           Values& results,
-                           Trap::Ptr* trap) {
+  Result path_filestat_get(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_path_filestat_get(__wasi_fd_t fd,
      *                                         __wasi_lookupflags_t flags,
      *                                         const char *path,
@@ -274,7 +385,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result path_symlink(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result path_symlink(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_path_symlink(const char *old_path,
      *                                    size_t old_path_len,
      *                                    __wasi_fd_t fd,
@@ -302,28 +413,26 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result path_readlink(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result path_readlink(Params params, Results results, Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result path_create_directory(const Values& params,
-                               Values& results,
+  Result path_create_directory(Params params,
+                               Results results,
                                Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result path_remove_directory(const Values& params,
-                               Values& results,
+  Result path_remove_directory(Params params,
+                               Results results,
                                Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result path_unlink_file(const Values& params,
-                          Values& results,
-                          Trap::Ptr* trap) {
+  Result path_unlink_file(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_path_unlink_file(__wasi_fd_t fd,
      *                                        const char *path,
      *                                        size_t path_len)
@@ -340,9 +449,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_prestat_get(const Values& params,
-                        Values& results,
-                        Trap::Ptr* trap) {
+  Result fd_prestat_get(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_fd_prestat_get(__wasi_fd_t fd,
      *                                      __wasi_prestat_t *buf))
      */
@@ -362,9 +469,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_prestat_dir_name(const Values& params,
-                             Values& results,
-                             Trap::Ptr* trap) {
+  Result fd_prestat_dir_name(Params params, Results results, Trap::Ptr* trap) {
     uvwasi_fd_t fd = params[0].Get<u32>();
     uint32_t path_ptr = params[1].Get<u32>();
     uvwasi_size_t path_len = params[2].Get<u32>();
@@ -382,13 +487,12 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_filestat_get(const Values& params,
-                         Values& results,
-                         Trap::Ptr* trap) {
+  Result fd_filestat_get(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_fd_filestat_get(__wasi_fd_t f, __wasi_filestat_t *buf) */
     uvwasi_fd_t fd = params[0].Get<u32>();
     uint32_t filestat_ptr = params[1].Get<u32>();
     uvwasi_filestat_t buf;
+    flushOutputFor(fd);
     results[0].Set<u32>(uvwasi_fd_filestat_get(uvwasi, fd, &buf));
     __wasi_filestat_t* filestat;
     CHECK_RESULT(getMemPtr<__wasi_filestat_t>(
@@ -401,14 +505,12 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_fdstat_set_flags(const Values& params,
-                             Values& results,
-                             Trap::Ptr* trap) {
+  Result fd_fdstat_set_flags(Params params, Results results, Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result fd_fdstat_get(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_fdstat_get(Params params, Results results, Trap::Ptr* trap) {
     int32_t fd = params[0].Get<u32>();
     uint32_t stat_ptr = params[1].Get<u32>();
     if (trace_stream) {
@@ -416,6 +518,7 @@ class WasiInstance {
     }
     CHECK_RESULT(getMemPtr<__wasi_fdstat_t>(stat_ptr, 1, nullptr, trap));
     uvwasi_fdstat_t host_statbuf;
+    flushOutputFor(fd);
     results[0].Set<u32>(uvwasi_fd_fdstat_get(uvwasi, fd, &host_statbuf));
 
     // Write the host statbuf into the target wasm memory
@@ -425,26 +528,20 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_read(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_read(Params params, Results results, Trap::Ptr* trap) {
     int32_t fd = params[0].Get<u32>();
     int32_t iovptr = params[1].Get<u32>();
     int32_t iovcnt = params[2].Get<u32>();
-    int32_t out_ptr = params[2].Get<u32>();
+    int32_t out_ptr = params[3].Get<u32>();
     if (trace_stream) {
       trace_stream->Writef("fd_read %d [%d]\n", fd, iovcnt);
     }
-    __wasi_iovec_t* wasm_iovs;
-    CHECK_RESULT(getMemPtr<__wasi_iovec_t>(iovptr, iovcnt, &wasm_iovs, trap));
-    std::vector<uvwasi_iovec_t> iovs(iovcnt);
-    for (int i = 0; i < iovcnt; i++) {
-      iovs[i].buf_len = wasm_iovs[i].buf_len;
-
-      CHECK_RESULT(getMemPtr<uint8_t>(wasm_iovs[i].buf, wasm_iovs[i].buf_len,
-                                      reinterpret_cast<uint8_t**>(&iovs[i].buf),
-                                      trap));
-    }
+    IovecBuffer<uvwasi_iovec_t> iovs;
+    CHECK_RESULT(getIovecs(iovptr, iovcnt, &iovs, trap));
     __wasi_ptr_t* out_addr;
     CHECK_RESULT(getMemPtr<__wasi_ptr_t>(out_ptr, 1, &out_addr, trap));
+    // The guest may be waiting for input after writing a prompt.
+    flushAllOutput();
     results[0].Set<u32>(
         uvwasi_fd_read(uvwasi, fd, iovs.data(), iovs.size(), out_addr));
     if (trace_stream) {
@@ -453,48 +550,116 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result fd_pread(const Values& params, Values& results, Trap::Ptr* trap) {
-    assert(false);
+  Result fd_pread(Params params, Results results, Trap::Ptr* trap) {
+    /* __wasi_errno_t __wasi_fd_pread(__wasi_fd_t fd,
+     *                                const __wasi_iovec_t *iovs,
+     *                                size_t iovs_len,
+     *                                __wasi_filesize_t offset,
+     *                                __wasi_size_t *nread)
+     */
+    int32_t fd = params[0].Get<u32>();
+    int32_t iovptr = params[1].Get<u32>();
+    int32_t iovcnt = params[2].Get<u32>();
+    __wasi_filesize_t offset = params[3].Get<u64>();
+    int32_t out_ptr = params[4].Get<u32>();
+    if (trace_stream) {
+      trace_stream->Writef("fd_pread %d [%d] %" PRIu64 "\n", fd, iovcnt,
+                           offset);
+    }
+    IovecBuffer<uvwasi_iovec_t> iovs;
+    CHECK_RESULT(getIovecs(iovptr, iovcnt, &iovs, trap));
+    __wasi_size_t* out_addr;
+    CHECK_RESULT(getMemPtr<__wasi_size_t>(out_ptr, 1, &out_addr, trap));
+    results[0].Set<u32>(uvwasi_fd_pread(uvwasi, fd, iovs.data(), iovs.size(),
+                                        offset, out_addr));
+    if (trace_stream) {
+      trace_stream->Writef("fd_pread -> %d\n", results[0].Get<u32>());
+    }
     return Result::Ok;
   }
 
-  Result fd_readdir(const Values& params, Values& results, Trap::Ptr* trap) {
-    assert(false);
+  Result fd_readdir(Params params, Results results, Trap::Ptr* trap) {
+    /* __wasi_errno_t __wasi_fd_readdir(__wasi_fd_t fd,
+     *                                  uint8_t *buf,
+     *                                  __wasi_size_t buf_len,
+     *                                  __wasi_dircookie_t cookie,
+     *                                  __wasi_size_t *bufused)
+     */
+    uvwasi_fd_t fd = params[0].Get<u32>();
+    uint32_t buf_ptr = params[1].Get<u32>();
+    __wasi_size_t buf_len = params[2].Get<u32>();
+    __wasi_dircookie_t cookie = params[3].Get<u64>();
+    uint32_t bufused_ptr = params[4].Get<u32>();
+    if (trace_stream) {
+      trace_stream->Writef("fd_readdir %d %d %" PRIu64 "\n", fd, buf_len,
+                           cookie);
+    }
+    // uvwasi writes the dirents in the WASI layout itself.
+    uint8_t* buf;
+    CHECK_RESULT(getMemPtr<uint8_t>(buf_ptr, buf_len, &buf, trap));
+    __wasi_size_t* bufused;
+    CHECK_RESULT(getMemPtr<__wasi_size_t>(bufused_ptr, 1, &bufused, trap));
+    results[0].Set<u32>(
+        uvwasi_fd_readdir(uvwasi, fd, buf, buf_len, cookie, bufused));
+    if (trace_stream) {
+      trace_stream->Writef("fd_readdir -> %d %d\n", results[0].Get<u32>(),
+                           *bufused);
+    }
     return Result::Ok;
   }
 
-  Result fd_write(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_write(Params params, Results results, Trap::Ptr* trap) {
     int32_t fd = params[0].Get<u32>();
     int32_t iovptr = params[1].Get<u32>();
     int32_t iovcnt = params[2].Get<u32>();
-    __wasi_iovec_t* wasm_iovs;
-    CHECK_RESULT(getMemPtr<__wasi_iovec_t>(iovptr, iovcnt, &wasm_iovs, trap));
-    std::vector<uvwasi_ciovec_t> iovs(iovcnt);
-    for (int i = 0; i < iovcnt; i++) {
-      iovs[i].buf_len = wasm_iovs[i].buf_len;
-      CHECK_RESULT(getMemPtr<const uint8_t>(
-          wasm_iovs[i].buf, wasm_iovs[i].buf_len,
-          reinterpret_cast<const uint8_t**>(&iovs[i].buf), trap));
-    }
+    IovecBuffer<uvwasi_ciovec_t> iovs;
+    CHECK_RESULT(getIovecs(iovptr, iovcnt, &iovs, trap));
     __wasi_ptr_t* out_addr;
     CHECK_RESULT(
         getMemPtr<__wasi_ptr_t>(params[3].Get<u32>(), 1, &out_addr, trap));
+    if (fd == 1 || fd == 2) {
+      PendingOutput* pending = &pending_output[fd - 1];
+      if (pending->error != __WASI_ERRNO_SUCCESS) {
+        // An earlier write to this stream was buffered, then failed.
+        results[0].Set<u32>(pending->error);
+        pending->error = __WASI_ERRNO_SUCCESS;
+        return Result::Ok;
+      }
+      u64 size = 0;
+      for (uint32_t i = 0; i < iovs.size(); i++) {
+        size += iovs[i].buf_len;
+      }
+      if (size <= PendingOutput::kCapacity) {
+        uvwasi_errno_t err = bufferOutput(fd, iovs, size);
+        if (err == __WASI_ERRNO_SUCCESS) {
+          *out_addr = size;
+        }
+        results[0].Set<u32>(err);
+        return Result::Ok;
+      }
+      flushOutputKeepingError(&pending_output[2 - fd]);
+      uvwasi_errno_t err = flushOutput(pending);
+      if (err != __WASI_ERRNO_SUCCESS) {
+        results[0].Set<u32>(err);
+        return Result::Ok;
+      }
+    }
     results[0].Set<u32>(
         uvwasi_fd_write(uvwasi, fd, iovs.data(), iovs.size(), out_addr));
     return Result::Ok;
   }
 
-  Result fd_pwrite(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_pwrite(Params params, Results results, Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result fd_close(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_close(Params params, Results results, Trap::Ptr* trap) {
     assert(false);
     return Result::Ok;
   }
 
-  Result fd_seek(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result fd_seek(Params params, Results results, Trap::Ptr* trap) {
     /* __wasi_errno_t __wasi_fd_seek(__wasi_fd_t fd,
      *                               __wasi_filedelta_t offset,
      *                               __wasi_whence_t whence,
@@ -505,12 +670,13 @@ class WasiInstance {
     __wasi_whence_t whence = params[2].Get<u32>();
     uint32_t newoffset_ptr = params[3].Get<u32>();
     uvwasi_filesize_t newoffset;
+    flushOutputFor(fd);
     results[0].Set<u32>(uvwasi_fd_seek(uvwasi, fd, offset, whence, &newoffset));
     CHECK_RESULT(writeValue<__wasi_filesize_t>(newoffset, newoffset_ptr, trap));
     return Result::Ok;
   }
 
-  Result environ_get(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result environ_get(Params params, Results results, Trap::Ptr* trap) {
     uvwasi_size_t environc;
     uvwasi_size_t environ_buf_size;
     uvwasi_environ_sizes_get(uvwasi, &environc, &environ_buf_size);
@@ -531,9 +697,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result environ_sizes_get(const Values& params,
-                           Values& results,
-                           Trap::Ptr* trap) {
+  Result environ_sizes_get(Params params, Results results, Trap::Ptr* trap) {
     uvwasi_size_t environc;
     uvwasi_size_t environ_buf_size;
     uvwasi_environ_sizes_get(uvwasi, &environc, &environ_buf_size);
@@ -548,7 +712,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result args_get(const Values& params, Values& results, Trap::Ptr* trap) {
+  Result args_get(Params params, Results results, Trap::Ptr* trap) {
     uvwasi_size_t argc;
     uvwasi_size_t arg_buf_size;
     uvwasi_args_sizes_get(uvwasi, &argc, &arg_buf_size);
@@ -568,9 +732,7 @@ class WasiInstance {
     return Result::Ok;
   }
 
-  Result args_sizes_get(const Values& params,
-                        Values& results,
-                        Trap::Ptr* trap) {
+  Result args_sizes_get(Params params, Results results, Trap::Ptr* trap) {
     uvwasi_size_t argc;
     uvwasi_size_t arg_buf_size;
     uvwasi_args_sizes_get(uvwasi, &argc, &arg_buf_size);
@@ -586,10 +748,111 @@ class WasiInstance {
 
   // The trace stream accosiated with the instance.
   Stream* trace_stream;
+  // Where errors the guest can no longer be told about are written.
+  Stream* err_stream;
 
   Instance::Ptr instance;
 
  private:
+  // Small writes to stdout and stderr are collected here, so a guest that
+  // writes a line in many pieces only makes one write. The output is written
+  // at the end of each line, when the buffer is full, and before the guest
+  // blocks, exits, or writes to the other stream.
+  struct PendingOutput {
+    static const uint32_t kCapacity = 4096;
+
+    uint8_t data[kCapacity];
+    uint32_t size = 0;
+    // The last error from writing this buffer when no fd_write was waiting
+    // for it. The next fd_write to the stream returns it instead.
+    uvwasi_errno_t error = __WASI_ERRNO_SUCCESS;
+  };
+
+  uvwasi_errno_t bufferOutput(uvwasi_fd_t fd,
+                              const IovecBuffer<uvwasi_ciovec_t>& iovs,
+                              uint32_t size) {
+    PendingOutput* pending = &pending_output[fd - 1];
+    flushOutputKeepingError(&pending_output[2 - fd]);
+    if (pending->size + size > PendingOutput::kCapacity) {
+      uvwasi_errno_t err = flushOutput(pending);
+      if (err != __WASI_ERRNO_SUCCESS) {
+        return err;
+      }
+    }
+    bool has_newline = false;
+    for (uint32_t i = 0; i < iovs.size(); i++) {
+      const uvwasi_ciovec_t& iov = iovs[i];
+      memcpy(pending->data + pending->size, iov.buf, iov.buf_len);
+      has_newline |= memchr(iov.buf, '\n', iov.buf_len) != nullptr;
+      pending->size += iov.buf_len;
+    }
+    if (has_newline || pending->size == PendingOutput::kCapacity) {
+      return flushOutput(pending);
+    }
+    return __WASI_ERRNO_SUCCESS;
+  }
+
+  uvwasi_errno_t flushOutput(PendingOutput* pending) {
+    uvwasi_fd_t fd = pending - pending_output + 1;
+    uint32_t offset = 0;
+    while (offset < pending->size) {
+      uvwasi_ciovec_t iov;
+      iov.buf = pending->data + offset;
+      iov.buf_len = pending->size - offset;
+      uvwasi_size_t nwritten = 0;
+      uvwasi_errno_t err = uvwasi_fd_write(uvwasi, fd, &iov, 1, &nwritten);
+      if (err != __WASI_ERRNO_SUCCESS || nwritten == 0) {
+        // The output is dropped, as it would be for an unbuffered write.
+        pending->size = 0;
+        return err;
+      }
+      offset += nwritten;
+    }
+    pending->size = 0;
+    return __WASI_ERRNO_SUCCESS;
+  }
+
+  // Flushes a stream outside of an fd_write to it, keeping any error for the
+  // next one.
+  void flushOutputKeepingError(PendingOutput* pending) {
+    uvwasi_errno_t err = flushOutput(pending);
+    if (err != __WASI_ERRNO_SUCCESS) {
+      pending->error = err;
+    }
+  }
+
+  void flushAllOutput() {
+    flushOutputKeepingError(&pending_output[0]);
+    flushOutputKeepingError(&pending_output[1]);
+  }
+
+  // Any other operation on stdout or stderr sees the output written so far.
+  void flushOutputFor(uvwasi_fd_t fd) {
+    if (fd == 1 || fd == 2) {
+      flushOutputKeepingError(&pending_output[fd - 1]);
+    }
+  }
+
+  // Converts an array of __wasi_iovec_t in wasm-memory to uvwasi iovecs that
+  // point into wasm-memory.
+  template <typename Iovec>
+  Result getIovecs(uint32_t iovptr,
+                   uint32_t iovcnt,
+                   IovecBuffer<Iovec>* out_iovs,
+                   Trap::Ptr* trap) {
+    __wasi_iovec_t* wasm_iovs;
+    CHECK_RESULT(getMemPtr<__wasi_iovec_t>(iovptr, iovcnt, &wasm_iovs, trap));
+    Iovec* iovs = out_iovs->Resize(iovcnt);
+    for (uint32_t i = 0; i < iovcnt; i++) {
+      uint8_t* buf;
+      CHECK_RESULT(getMemPtr<uint8_t>(wasm_iovs[i].buf, wasm_iovs[i].buf_len,
+                                      &buf, trap));
+      iovs[i].buf = buf;
+      iovs[i].buf_len = wasm_iovs[i].buf_len;
+    }
+    return Result::Ok;
+  }
+
   // Write a value into wasm-memory and the given memory offset.
   template <typename T>
   Result writeValue(T value, uint32_t target_address, Trap::Ptr* trap) {
@@ -624,23 +887,25 @@ class WasiInstance {
   // The memory accociated with the instance.  Looked up once on startup
   // and cached here.
   Memory* memory;
+  // For stdout and stderr.
+  PendingOutput pending_output[2];
 };
 
 std::unordered_map<Instance*, WasiInstance*> wasiInstances;
 
 // TODO(sbc): Auto-generate this.
 
-#define WASI_CALLBACK(NAME)                                                 \
-  static Result NAME(Thread& thread, const Values& params, Values& results, \
-                     Trap::Ptr* trap) {                                     \
-    Instance* instance = thread.GetCallerInstance();                        \
-    assert(instance);                                                       \
-    WasiInstance* wasi_instance = wasiInstances[instance];                  \
-    if (wasi_instance->trace_stream) {                                      \
-      wasi_instance->trace_stream->Writef(                                  \
-          ">>> running wasi function \"%s\":\n", #NAME);                    \
-    }                                                                       \
-    return wasi_instance->NAME(params, results, trap);                      \
+#define WASI_CALLBACK(NAME)                                                \
+  static Result NAME(Thread& thread, const HostFunc& func, Params params,  \
+                     Results results, Trap::Ptr* trap) {                   \
+    Instance* instance = thread.GetCallerInstance();                       \
+    assert(instance);                                                      \
+    WasiInstance* wasi_instance = wasiInstances[instance];                 \
+    if (wasi_instance->trace_stream) {                                     \
+      wasi_instance->trace_stream->Writef(                                 \
+          ">>> running wasi function \"%s\":\n", #NAME);                   \
+    }                                                                      \
+    return wasi_instance->NAME(params, results, trap);                     \
   }
 
 #define WASI_FUNC(NAME) WASI_CALLBACK(NAME)
@@ -698,6 +963,16 @@ Result WasiRunStart(const Instance::Ptr& instance,
                     uvwasi_s* uvwasi,
                     Stream* err_stream,
                     Stream* trace_stream) {
+  Thread::Options thread_options;
+  thread_options.trace_stream = trace_stream;
+  return WasiRunStart(instance, uvwasi, err_stream, thread_options);
+}
+
+Result WasiRunStart(const Instance::Ptr& instance,
+                    uvwasi_s* uvwasi,
+                    Stream* err_stream,
+                    const Thread::Options& thread_options) {
+  Stream* trace_stream = thread_options.trace_stream;
   Store* store = instance.store();
   auto module = store->UnsafeGet<Module>(instance->module());
   auto&& module_desc = module->desc();
@@ -740,14 +1015,18 @@ Result WasiRunStart(const Instance::Ptr& instance,
   }
 
   // Register memory
-  WasiInstance wasi(instance, uvwasi, memory.get(), trace_stream);
+  WasiInstance wasi(instance, uvwasi, memory.get(), trace_stream, err_stream);
   wasiInstances[instance.get()] = &wasi;
 
   // Call start ([] -> [])
   Values params;
   Values results;
   Trap::Ptr trap;
-  Result res = start->Call(*store, params, results, &trap, trace_stream);
+  Thread thread(*store, thread_options);
+  Result res = start->Call(thread, params, results, &trap);
+  if (Failed(wasi.FlushOutput())) {
+    res = Result::Error;
+  }
   if (trap) {
     WriteTrap(err_stream, "error", trap);
   }
@@ -38,6 +38,13 @@ Result WasiRunStart(const Instance::Ptr& instance,
                     Stream* stream,
                     Stream* trace_stream);
 
+// Same as above, but runs _start on a Thread created with `thread_options`.
+// Its trace_stream is also used to trace the WASI calls.
+Result WasiRunStart(const Instance::Ptr& instance,
+                    uvwasi_s* uvwasi,
+                    Stream* stream,
+                    const Thread::Options& thread_options);
+
 }  // namespace interp
 }  // namespace wabt
 
@@ -19,8 +19,20 @@
 #include <algorithm>
 #include <cassert>
 #include <cinttypes>
+#include <cstring>
+#include <unordered_map>
+
+#if HAVE_MADVISE || HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if HAVE_MEMFD_CREATE
+#include <fcntl.h>
+#endif
 
 #include "src/interp/interp-math.h"
+#include "src/interp/interp-profiler.h"
 #include "src/make-unique.h"
 
 namespace wabt {
@@ -230,6 +242,32 @@ bool Store::HasValueType(Ref ref, ValueType type) const {
   }
 }
 
+std::unique_ptr<Thread> Store::AcquireThread() {
+  if (idle_threads_.empty()) {
+    return MakeUnique<Thread>(*this);
+  }
+  std::unique_ptr<Thread> thread = std::move(idle_threads_.back());
+  idle_threads_.pop_back();
+  return thread;
+}
+
+void Store::ReleaseThread(std::unique_ptr<Thread> thread) {
+  assert(&thread->store() == this);
+  thread->Reset();
+  idle_threads_.push_back(std::move(thread));
+}
+
+Index Store::InternFuncType(const FuncType& type) {
+  auto key = std::make_pair(type.params, type.results);
+  auto iter = func_type_ids_.find(key);
+  if (iter != func_type_ids_.end()) {
+    return iter->second;
+  }
+  Index id = func_type_ids_.size();
+  func_type_ids_.emplace(std::move(key), id);
+  return id;
+}
+
 Store::RootList::Index Store::NewRoot(Ref ref) {
   return roots_.New(ref);
 }
@@ -382,15 +420,22 @@ Result Extern::MatchImpl(Store& store,
 }
 
 //// Func ////
-Func::Func(ObjectKind kind, FuncType type) : Extern(kind), type_(type) {}
+Func::Func(Store& store, ObjectKind kind, FuncType type)
+    : Extern(kind), type_(type), type_id_(store.InternFuncType(type_)) {}
 
 Result Func::Call(Store& store,
                   const Values& params,
                   Values& results,
                   Trap::Ptr* out_trap,
                   Stream* trace_stream) {
-  Thread thread(store, trace_stream);
-  return DoCall(thread, params, results, out_trap);
+  if (trace_stream) {
+    Thread thread(store, trace_stream);
+    return DoCall(thread, params, results, out_trap);
+  }
+  std::unique_ptr<Thread> thread = store.AcquireThread();
+  Result result = DoCall(*thread, params, results, out_trap);
+  store.ReleaseThread(std::move(thread));
+  return result;
 }
 
 Result Func::Call(Thread& thread,
@@ -401,8 +446,14 @@ Result Func::Call(Thread& thread,
 }
 
 //// DefinedFunc ////
-DefinedFunc::DefinedFunc(Store& store, Ref instance, FuncDesc desc)
-    : Func(skind, desc.type), instance_(instance), desc_(desc) {}
+DefinedFunc::DefinedFunc(Store& store,
+                         Ref instance,
+                         FuncDesc desc,
+                         Index index)
+    : Func(store, skind, desc.type),
+      instance_(instance),
+      desc_(desc),
+      index_(index) {}
 
 void DefinedFunc::Mark(Store& store) {
   store.Mark(instance_);
@@ -419,14 +470,27 @@ Result DefinedFunc::DoCall(Thread& thread,
                            Values& results,
                            Trap::Ptr* out_trap) {
   assert(params.size() == type_.params.size());
+  size_t num_frames = thread.frames_.size();
+  size_t num_values = thread.values_.size();
   thread.PushValues(type_.params, params);
   RunResult result = thread.PushCall(*this, out_trap);
   if (result == RunResult::Trap) {
+    thread.UnwindCall(num_frames, num_values);
     return Result::Error;
   }
   result = thread.Run(out_trap);
+  if (result != RunResult::Ok && result != RunResult::Return) {
+    thread.UnwindCall(num_frames, num_values);
+  }
   if (result == RunResult::Trap) {
     return Result::Error;
+  } else if (result == RunResult::Suspended) {
+    // The host function that suspended the thread was called from C++ code
+    // further up the native stack, which can't be suspended.
+    thread.suspend_requested_ = false;
+    thread.suspended_ = false;
+    *out_trap = Trap::New(thread.store(), "can't suspend a nested call");
+    return Result::Error;
   } else if (result == RunResult::Exception) {
     // While this is not actually a trap, it is a convenient way
     // to report an uncaught exception.
@@ -438,8 +502,16 @@ Result DefinedFunc::DoCall(Thread& thread,
 }
 
 //// HostFunc ////
-HostFunc::HostFunc(Store&, FuncType type, Callback callback)
-    : Func(skind, type), callback_(callback) {}
+HostFunc::HostFunc(Store& store, FuncType type, Callback callback)
+    : Func(store, skind, type), callback_(callback) {}
+
+HostFunc::HostFunc(Store& store,
+                   FuncType type,
+                   FastCallback callback,
+                   void* user_data)
+    : Func(store, skind, type),
+      fast_callback_(callback),
+      user_data_(user_data) {}
 
 void HostFunc::Mark(Store&) {}
 
@@ -453,6 +525,14 @@ Result HostFunc::DoCall(Thread& thread,
                         const Values& params,
                         Values& results,
                         Trap::Ptr* out_trap) {
+  if (fast_callback_) {
+    // The callback can't resize the span, so size the results for it.
+    results.resize(type_.results.size());
+    return fast_callback_(thread, *this,
+                          Span<const Value>(params.data(), params.size()),
+                          Span<Value>(results.data(), results.size()),
+                          out_trap);
+  }
   return callback_(thread, params, results, out_trap);
 }
 
@@ -492,6 +572,7 @@ Ref Table::UnsafeGet(u32 offset) const {
 Result Table::Set(Store& store, u32 offset, Ref ref) {
   if (IsValidRange(offset, 1) && store.HasValueType(ref, type_.element)) {
     elements_[offset] = ref;
+    ++generation_;
     return Result::Ok;
   }
   return Result::Error;
@@ -516,6 +597,7 @@ Result Table::Fill(Store& store, u32 offset, Ref ref, u32 size) {
   if (IsValidRange(offset, size) && store.HasValueType(ref, type_.element)) {
     std::fill(elements_.begin() + offset, elements_.begin() + offset + size,
               ref);
+    ++generation_;
     return Result::Ok;
   }
   return Result::Error;
@@ -531,6 +613,7 @@ Result Table::Init(Store& store,
     std::copy(src.elements().begin() + src_offset,
               src.elements().begin() + src_offset + size,
               elements_.begin() + dst_offset);
+    ++generation_;
     return Result::Ok;
   }
   return Result::Error;
@@ -555,15 +638,191 @@ Result Table::Copy(Store& store,
     } else {
       std::move(src_begin, src_end, dst_begin);
     }
+    ++dst.generation_;
     return Result::Ok;
   }
   return Result::Error;
 }
 
 //// Memory ////
+#if HAVE_MEMFD_CREATE
+// An immutable copy of the data of a memory, in a memfd. Memories map it
+// privately, so that its pages are shared until they are written.
+class MemoryImage {
+ public:
+  static std::shared_ptr<MemoryImage> New(const u8* data, u64 size);
+  ~MemoryImage() { close(fd_); }
+
+  int fd() const { return fd_; }
+  u64 size() const { return size_; }
+
+ private:
+  MemoryImage(int fd, u64 size) : fd_(fd), size_(size) {}
+
+  int fd_;
+  u64 size_;
+};
+
+// static
+std::shared_ptr<MemoryImage> MemoryImage::New(const u8* data, u64 size) {
+  int fd = memfd_create("wabt-memory-image", MFD_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  std::shared_ptr<MemoryImage> image(new MemoryImage(fd, size));
+  if (ftruncate(fd, size) != 0) {
+    return nullptr;
+  }
+  // The file reads as zero until it is written, so zero pages are skipped,
+  // and take no space.
+  static const u8 kZeroPage[WABT_PAGE_SIZE] = {};
+  for (u64 offset = 0; offset < size; offset += WABT_PAGE_SIZE) {
+    u64 page_size = std::min<u64>(WABT_PAGE_SIZE, size - offset);
+    if (memcmp(data + offset, kZeroPage, page_size) == 0) {
+      continue;
+    }
+    for (u64 written = 0; written < page_size;) {
+      ssize_t result = pwrite(fd, data + offset + written, page_size - written,
+                              offset + written);
+      if (result <= 0) {
+        return nullptr;
+      }
+      written += result;
+    }
+  }
+  return image;
+}
+#endif
+
 Memory::Memory(class Store&, MemoryType type)
     : Extern(skind), type_(type), pages_(type.limits.initial) {
-  data_.resize(pages_ * WABT_PAGE_SIZE);
+  if (Failed(Resize(pages_ * WABT_PAGE_SIZE))) {
+    WABT_FATAL("unable to allocate %" PRIu64 " pages of memory\n", pages_);
+  }
+}
+
+Memory::~Memory() {
+#if HAVE_MEMFD_CREATE
+  if (data_) {
+    munmap(data_, size_);
+  }
+#endif
+}
+
+Result Memory::Resize(u64 size) {
+  assert(size >= size_);
+#if HAVE_MEMFD_CREATE
+  if (size == size_) {
+    return Result::Ok;
+  }
+  // Map the new size, then move the old mapping over the start of it. This
+  // keeps its pages, even those that are still shared with image_, and the
+  // rest of the new mapping reads as zero.
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    return Result::Error;
+  }
+  if (data_ && mremap(data_, size_, size_, MREMAP_MAYMOVE | MREMAP_FIXED,
+                      data) == MAP_FAILED) {
+    munmap(data, size);
+    return Result::Error;
+  }
+  data_ = static_cast<u8*>(data);
+#else
+  buffer_.resize(size);
+  data_ = buffer_.data();
+#endif
+  size_ = size;
+  return Result::Ok;
+}
+
+#if HAVE_MEMFD_CREATE
+Result Memory::MapImage(std::shared_ptr<MemoryImage> image) {
+  assert(!data_ || size_ == image->size());
+  void* data = mmap(nullptr, image->size(), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_NORESERVE, image->fd(), 0);
+  if (data == MAP_FAILED) {
+    return Result::Error;
+  }
+  if (data_) {
+    munmap(data_, size_);
+  }
+  data_ = static_cast<u8*>(data);
+  size_ = image->size();
+  image_ = std::move(image);
+  return Result::Ok;
+}
+
+bool Memory::IsImageModified() const {
+  if (!image_ || image_->size() != size_) {
+    return true;
+  }
+  // A page of a private file mapping that has been written is replaced by an
+  // anonymous one, which /proc/self/pagemap tells apart from the file's pages.
+  // Each page has a 64-bit entry there, indexed by its address.
+  const u64 kPresent = u64{1} << 63;
+  const u64 kSwapped = u64{1} << 62;
+  const u64 kFilePage = u64{1} << 61;
+  int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return true;
+  }
+  static const u64 page_size = sysconf(_SC_PAGESIZE);
+  u64 first_page = reinterpret_cast<uintptr_t>(data_) / page_size;
+  u64 num_pages = (size_ + page_size - 1) / page_size;
+  u64 entries[512];
+  bool modified = false;
+  for (u64 page = 0; page < num_pages && !modified;) {
+    size_t count = std::min<u64>(WABT_ARRAY_SIZE(entries), num_pages - page);
+    size_t size = count * sizeof(u64);
+    if (pread(fd, entries, size, (first_page + page) * sizeof(u64)) !=
+        static_cast<ssize_t>(size)) {
+      modified = true;
+      break;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      if ((entries[i] & kSwapped) ||
+          ((entries[i] & kPresent) && !(entries[i] & kFilePage))) {
+        modified = true;
+        break;
+      }
+    }
+    page += count;
+  }
+  close(fd);
+  return modified;
+}
+#endif
+
+Memory::Ptr Memory::Clone(class Store& store) {
+  // Create the copy empty, so it doesn't allocate data that is replaced.
+  MemoryType empty_type = type_;
+  empty_type.limits.initial = 0;
+  Memory::Ptr copy = Memory::New(store, empty_type);
+  copy->type_ = type_;
+  copy->pages_ = pages_;
+#if HAVE_MEMFD_CREATE
+  if (size_ > 0 && IsImageModified()) {
+    // This memory maps the new image too, so that it can be reused as long as
+    // none of this memory's pages are written. If it can't be created, the
+    // data is copied instead.
+    std::shared_ptr<MemoryImage> image = MemoryImage::New(data_, size_);
+    if (!image || Failed(MapImage(std::move(image)))) {
+      image_.reset();
+    }
+  }
+  if (image_ && Succeeded(copy->MapImage(image_))) {
+    return copy;
+  }
+#endif
+  if (Failed(copy->Resize(size_))) {
+    WABT_FATAL("unable to allocate %" PRIu64 " pages of memory\n", pages_);
+  }
+  if (size_ > 0) {
+    memcpy(copy->data_, data_, size_);
+  }
+  return copy;
 }
 
 void Memory::Mark(class Store&) {}
@@ -577,30 +836,71 @@ Result Memory::Match(class Store& store,
 Result Memory::Grow(u64 count) {
   u64 new_pages;
   if (CanGrow<u64>(type_.limits, pages_, count, &new_pages)) {
+#if WABT_BIG_ENDIAN
+    auto old_size = size_;
+#endif
+    CHECK_RESULT(Resize(new_pages * WABT_PAGE_SIZE));
     // Grow the limits of the memory too, so that if it is used as an
     // import to another module its new size is honored.
     type_.limits.initial += count;
-#if WABT_BIG_ENDIAN
-    auto old_size = data_.size();
-#endif
     pages_ = new_pages;
-    data_.resize(new_pages * WABT_PAGE_SIZE);
 #if WABT_BIG_ENDIAN
-    std::move_backward(data_.begin(), data_.begin() + old_size, data_.end());
-    std::fill(data_.begin(), data_.end() - old_size, 0);
+    std::move_backward(data_, data_ + old_size, data_ + size_);
+    std::fill(data_, data_ + size_ - old_size, 0);
 #endif
     return Result::Ok;
   }
   return Result::Error;
 }
 
+// Zero fills at least this large give the pages they cover back to the OS
+// instead of writing to them, see ZeroFill.
+static const u64 kMadviseFillThreshold = 1 << 20;
+
+static void ZeroFill(u8* data, u64 size, bool can_discard) {
+#if HAVE_MADVISE
+  if (can_discard && size >= kMadviseFillThreshold) {
+    // The memory is anonymous and private, either because it is allocated by
+    // the C++ runtime or because of Memory::Resize, so its pages read as zero
+    // again once they are discarded. Only the pages that are entirely inside
+    // the range can be discarded.
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+    uintptr_t end = begin + size;
+    uintptr_t page_begin = (begin + page_size - 1) & ~(page_size - 1);
+    uintptr_t page_end = end & ~(page_size - 1);
+    if (page_begin < page_end &&
+        madvise(reinterpret_cast<void*>(page_begin), page_end - page_begin,
+                MADV_DONTNEED) == 0) {
+      memset(data, 0, page_begin - begin);
+      memset(reinterpret_cast<void*>(page_end), 0, end - page_end);
+      return;
+    }
+  }
+#endif
+  memset(data, 0, size);
+}
+
 Result Memory::Fill(u64 offset, u8 value, u64 size) {
   if (IsValidAccess(offset, 0, size)) {
 #if WABT_BIG_ENDIAN
-    std::fill(data_.end() - offset - size, data_.end() - offset, value);
+    u8* dst = data_ + size_ - offset - size;
+#else
+    u8* dst = data_ + offset;
+#endif
+    if (size == 0) {
+      // Nothing to do, and `dst` may be null.
+    } else if (value == 0) {
+#if HAVE_MEMFD_CREATE
+      // Discarded pages of an image mapping read as the image again.
+      bool can_discard = !image_;
 #else
-    std::fill(data_.begin() + offset, data_.begin() + offset + size, value);
+      bool can_discard = true;
 #endif
+      ZeroFill(dst, size, can_discard);
+    } else {
+      memset(dst, value, size);
+    }
     return Result::Ok;
   }
   return Result::Error;
@@ -612,12 +912,14 @@ Result Memory::Init(u64 dst_offset,
                     u64 size) {
   if (IsValidAccess(dst_offset, 0, size) &&
       src.IsValidRange(src_offset, size)) {
+#if WABT_BIG_ENDIAN
     std::copy(src.desc().data.begin() + src_offset,
               src.desc().data.begin() + src_offset + size,
-#if WABT_BIG_ENDIAN
-              data_.rbegin() + dst_offset);
+              std::reverse_iterator<u8*>(data_ + size_) + dst_offset);
 #else
-              data_.begin() + dst_offset);
+    if (size > 0) {
+      memcpy(data_ + dst_offset, src.desc().data.data() + src_offset, size);
+    }
 #endif
     return Result::Ok;
   }
@@ -633,18 +935,17 @@ Result Memory::Copy(Memory& dst,
   if (dst.IsValidAccess(dst_offset, 0, size) &&
       src.IsValidAccess(src_offset, 0, size)) {
 #if WABT_BIG_ENDIAN
-    auto src_begin = src.data_.end() - src_offset - size;
-    auto dst_begin = dst.data_.end() - dst_offset - size;
+    const u8* src_begin = src.data_ + src.size_ - src_offset - size;
+    u8* dst_begin = dst.data_ + dst.size_ - dst_offset - size;
 #else
-    auto src_begin = src.data_.begin() + src_offset;
-    auto dst_begin = dst.data_.begin() + dst_offset;
+    const u8* src_begin = src.data_ + src_offset;
+    u8* dst_begin = dst.data_ + dst_offset;
 #endif
-    auto src_end = src_begin + size;
-    auto dst_end = dst_begin + size;
-    if (src.self() == dst.self() && src_begin < dst_begin) {
-      std::move_backward(src_begin, src_end, dst_end);
-    } else {
-      std::move(src_begin, src_end, dst_begin);
+    // The ranges may overlap if both are in the same memory. memmove picks the
+    // best way to copy for the size, e.g. glibc uses non-temporal stores for
+    // copies larger than the cache.
+    if (size > 0) {
+      memmove(dst_begin, src_begin, size);
     }
     return Result::Ok;
   }
@@ -736,8 +1037,12 @@ bool DataSegment::IsValidRange(u64 offset, u64 size) const {
 }
 
 //// Module ////
-Module::Module(Store&, ModuleDesc desc)
+Module::Module(Store& store, ModuleDesc desc)
     : Object(skind), desc_(std::move(desc)) {
+  for (auto&& func_type : desc_.func_types) {
+    func_type_ids_.push_back(store.InternFuncType(func_type));
+  }
+
   for (auto&& import : desc_.imports) {
     import_types_.emplace_back(import.type);
   }
@@ -749,6 +1054,15 @@ Module::Module(Store&, ModuleDesc desc)
 
 void Module::Mark(Store&) {}
 
+Result Module::CompileFunc(Index defined_index, std::string* out_msg) {
+  assert(desc_.lazy_compiler);
+  u32 offset = desc_.funcs[defined_index].code_offset;
+  if (desc_.istream.Read(&offset).op != Opcode::InterpCompile) {
+    return Result::Ok;
+  }
+  return desc_.lazy_compiler->Compile(&desc_, defined_index, out_msg);
+}
+
 //// ElemSegment ////
 void ElemSegment::Mark(Store& store) {
   store.Mark(elements_);
@@ -792,27 +1106,30 @@ Instance::Ptr Instance::Instantiate(Store& store,
     inst->imports_.push_back(extern_ref);
 
     switch (import_desc.type.type->kind) {
-      case ExternKind::Func:   inst->funcs_.push_back(extern_ref); break;
-      case ExternKind::Table:  inst->tables_.push_back(extern_ref); break;
-      case ExternKind::Memory: inst->memories_.push_back(extern_ref); break;
-      case ExternKind::Global: inst->globals_.push_back(extern_ref); break;
+      case ExternKind::Func:   inst->AddFunc(store, extern_ref); break;
+      case ExternKind::Table:  inst->AddTable(store, extern_ref); break;
+      case ExternKind::Memory: inst->AddMemory(store, extern_ref); break;
+      case ExternKind::Global: inst->AddGlobal(store, extern_ref); break;
       case ExternKind::Tag:    inst->tags_.push_back(extern_ref); break;
     }
   }
 
   // Funcs.
   for (auto&& desc : mod->desc().funcs) {
-    inst->funcs_.push_back(DefinedFunc::New(store, inst.ref(), desc).ref());
+    Index index = inst->funcs_.size();
+    inst->AddFunc(store,
+                  DefinedFunc::New(store, inst.ref(), desc, index).ref());
   }
+  inst->call_indirect_caches_.resize(mod->desc().num_call_indirect_sites);
 
   // Tables.
   for (auto&& desc : mod->desc().tables) {
-    inst->tables_.push_back(Table::New(store, desc.type).ref());
+    inst->AddTable(store, Table::New(store, desc.type).ref());
   }
 
   // Memories.
   for (auto&& desc : mod->desc().memories) {
-    inst->memories_.push_back(Memory::New(store, desc.type).ref());
+    inst->AddMemory(store, Memory::New(store, desc.type).ref());
   }
 
   // Globals.
@@ -822,7 +1139,7 @@ Instance::Ptr Instance::Instantiate(Store& store,
     if (Failed(inst->CallInitFunc(store, func_ref, &value, out_trap))) {
       return {};
     }
-    inst->globals_.push_back(Global::New(store, desc.type, value).ref());
+    inst->AddGlobal(store, Global::New(store, desc.type, value).ref());
   }
 
   // Tags.
@@ -831,17 +1148,7 @@ Instance::Ptr Instance::Instantiate(Store& store,
   }
 
   // Exports.
-  for (auto&& desc : mod->desc().exports) {
-    Ref ref;
-    switch (desc.type.type->kind) {
-      case ExternKind::Func:   ref = inst->funcs_[desc.index]; break;
-      case ExternKind::Table:  ref = inst->tables_[desc.index]; break;
-      case ExternKind::Memory: ref = inst->memories_[desc.index]; break;
-      case ExternKind::Global: ref = inst->globals_[desc.index]; break;
-      case ExternKind::Tag:    ref = inst->tags_[desc.index]; break;
-    }
-    inst->exports_.push_back(ref);
-  }
+  inst->AddExports(mod->desc());
 
   // Elems.
   for (auto&& desc : mod->desc().elems) {
@@ -949,6 +1256,136 @@ Instance::Ptr Instance::Instantiate(Store& store,
   return inst;
 }
 
+void Instance::AddFunc(Store& store, Ref func) {
+  funcs_.push_back(func);
+  func_ptrs_.push_back(store.UnsafeGetRaw<Func>(func));
+}
+
+void Instance::AddTable(Store& store, Ref table) {
+  tables_.push_back(table);
+  table_ptrs_.push_back(store.UnsafeGetRaw<Table>(table));
+}
+
+void Instance::AddMemory(Store& store, Ref memory) {
+  memories_.push_back(memory);
+  memory_ptrs_.push_back(store.UnsafeGetRaw<Memory>(memory));
+}
+
+void Instance::AddGlobal(Store& store, Ref global) {
+  globals_.push_back(global);
+  global_ptrs_.push_back(store.UnsafeGetRaw<Global>(global));
+}
+
+void Instance::AddExports(const ModuleDesc& mod_desc) {
+  for (auto&& desc : mod_desc.exports) {
+    Ref ref;
+    switch (desc.type.type->kind) {
+      case ExternKind::Func:   ref = funcs_[desc.index]; break;
+      case ExternKind::Table:  ref = tables_[desc.index]; break;
+      case ExternKind::Memory: ref = memories_[desc.index]; break;
+      case ExternKind::Global: ref = globals_[desc.index]; break;
+      case ExternKind::Tag:    ref = tags_[desc.index]; break;
+    }
+    exports_.push_back(ref);
+  }
+}
+
+Instance::Ptr Instance::Clone(Store& store) const {
+  Module::Ptr mod{store, module_};
+  const ModuleDesc& mod_desc = mod->desc();
+  Instance::Ptr inst = store.Alloc<Instance>(store, module_);
+  inst->imports_ = imports_;
+
+  // Maps the objects defined by this instance to their copies.
+  std::unordered_map<size_t, Ref> copies;
+  auto add_copy = [&](Ref from, Ref to) { copies.emplace(from.index, to); };
+  auto remap = [&](Ref ref) {
+    auto iter = copies.find(ref.index);
+    return iter != copies.end() ? iter->second : ref;
+  };
+
+  // The defined objects come after the imported ones in each index space.
+  size_t first_func = funcs_.size() - mod_desc.funcs.size();
+  size_t first_table = tables_.size() - mod_desc.tables.size();
+  size_t first_memory = memories_.size() - mod_desc.memories.size();
+  size_t first_global = globals_.size() - mod_desc.globals.size();
+  size_t first_tag = tags_.size() - mod_desc.tags.size();
+
+  for (size_t i = 0; i < funcs_.size(); ++i) {
+    Ref ref = funcs_[i];
+    if (i >= first_func) {
+      ref = DefinedFunc::New(store, inst.ref(), mod_desc.funcs[i - first_func],
+                             i)
+                .ref();
+      add_copy(funcs_[i], ref);
+    }
+    inst->AddFunc(store, ref);
+  }
+  inst->call_indirect_caches_.resize(mod_desc.num_call_indirect_sites);
+
+  for (size_t i = 0; i < tags_.size(); ++i) {
+    Ref ref = tags_[i];
+    if (i >= first_tag) {
+      ref = Tag::New(store, store.UnsafeGetRaw<Tag>(ref)->type()).ref();
+      add_copy(tags_[i], ref);
+    }
+    inst->tags_.push_back(ref);
+  }
+
+  for (size_t i = 0; i < memories_.size(); ++i) {
+    Ref ref = memories_[i];
+    if (i >= first_memory) {
+      ref = store.UnsafeGetRaw<Memory>(ref)->Clone(store).ref();
+      add_copy(memories_[i], ref);
+    }
+    inst->AddMemory(store, ref);
+  }
+
+  // Tables and globals may refer to any of the objects above, so they are
+  // copied last.
+  for (size_t i = 0; i < globals_.size(); ++i) {
+    Ref ref = globals_[i];
+    if (i >= first_global) {
+      Global* global = store.UnsafeGetRaw<Global>(ref);
+      Value value = global->Get();
+      if (IsReference(global->type().type)) {
+        value.Set(remap(value.Get<Ref>()));
+      }
+      ref = Global::New(store, global->type(), value).ref();
+      add_copy(globals_[i], ref);
+    }
+    inst->AddGlobal(store, ref);
+  }
+
+  std::vector<Table::Ptr> table_copies;
+  for (size_t i = 0; i < tables_.size(); ++i) {
+    Ref ref = tables_[i];
+    if (i >= first_table) {
+      table_copies.push_back(
+          Table::New(store, store.UnsafeGetRaw<Table>(ref)->type()));
+      ref = table_copies.back().ref();
+      add_copy(tables_[i], ref);
+    }
+    inst->AddTable(store, ref);
+  }
+  for (size_t i = 0; i < table_copies.size(); ++i) {
+    const Table* table = store.UnsafeGetRaw<Table>(tables_[first_table + i]);
+    Table* copy = table_copies[i].get();
+    std::transform(table->elements_.begin(), table->elements_.end(),
+                   copy->elements_.begin(), remap);
+  }
+
+  inst->AddExports(mod_desc);
+
+  for (auto&& segment : elems_) {
+    inst->elems_.push_back(segment);
+    auto& elements = inst->elems_.back().elements_;
+    std::transform(elements.begin(), elements.end(), elements.begin(), remap);
+  }
+  inst->datas_ = datas_;
+  return inst;
+}
+
 void Instance::Mark(Store& store) {
   store.Mark(module_);
   store.Mark(imports_);
@@ -965,13 +1402,23 @@ void Instance::Mark(Store& store) {
 
 //// Thread ////
 Thread::Thread(Store& store, Stream* trace_stream)
-    : store_(store), trace_stream_(trace_stream) {
+    : Thread(store, Options{Options::kDefaultValueStackSize,
+                            Options::kDefaultCallStackSize, trace_stream}) {}
+
+Thread::Thread(Store& store, const Options& options)
+    : store_(store),
+      value_stack_size_(options.value_stack_size),
+      call_stack_size_(options.call_stack_size),
+      fuel_(options.fuel),
+      epoch_deadline_(options.epoch_deadline),
+      profiler_(options.profiler),
+      dispatch_stats_(options.dispatch_stats),
+      trace_stream_(options.trace_stream) {
   store.threads().insert(this);
 
-  Thread::Options options;
-  frames_.reserve(options.call_stack_size);
-  values_.reserve(options.value_stack_size);
-  if (trace_stream) {
+  frames_.reserve(std::min(call_stack_size_, kInitialCallStackSize));
+  values_.reserve(std::min(value_stack_size_, kInitialValueStackSize));
+  if (trace_stream_) {
     trace_source_ = MakeUnique<TraceSource>(this);
   }
 }
@@ -980,26 +1427,82 @@ Thread::~Thread() {
   store_.threads().erase(this);
 }
 
+void Thread::Reset() {
+  suspend_requested_ = false;
+  suspended_ = false;
+  frames_.clear();
+  values_.clear();
+  high_values_.clear();
+  inst_ = nullptr;
+  mod_ = nullptr;
+}
+
 void Thread::Mark() {
-  for (auto&& frame : frames_) {
+  if (call_func_ != Ref::Null) {
+    store_.Mark(call_func_);
+  }
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    Frame& frame = frames_[i];
     frame.Mark(store_);
+    if (!frame.mod) {
+      continue;
+    }
+
+    // Find the stack map for the frame's offset. It may list slots that
+    // haven't been pushed yet, e.g. the locals at the start of a function, or
+    // the results of a call; they are past the end of the frame's values.
+    auto&& stack_maps = frame.mod->desc().stack_maps;
+    auto iter = std::upper_bound(
+        stack_maps.begin(), stack_maps.end(), frame.offset,
+        [](u32 offset, const StackMapDesc& map) { return offset < map.offset; });
+    if (iter == stack_maps.begin()) {
+      continue;
+    }
+    --iter;
+    size_t base = GetFrameBase(frame);
+    size_t end = i + 1 < frames_.size() ? GetFrameBase(frames_[i + 1])
+                                        : values_.size();
+    for (u32 slot : iter->ref_slots) {
+      if (base + slot < end) {
+        store_.Mark(Ref(values_[base + slot]));
+      }
+    }
   }
-  for (auto index : refs_) {
-    store_.Mark(values_[index].Get<Ref>());
+}
+
+size_t Thread::GetFrameBase(const Frame& frame) const {
+  if (!frame.mod) {
+    // A host function's params are popped before its frame is pushed.
+    return frame.values;
   }
-  store_.Mark(exceptions_);
+  return frame.values -
+         store_.UnsafeGetRaw<DefinedFunc>(frame.func)->type().params.size();
 }
 
 void Thread::PushValues(const ValueTypes& types, const Values& values) {
   assert(types.size() == values.size());
   for (size_t i = 0; i < types.size(); ++i) {
-    if (IsReference(types[i])) {
-      refs_.push_back(values_.size());
-    }
-    values_.push_back(values[i]);
+    PushValue(types[i], values[i]);
+  }
+}
+
+void Thread::PushValue(ValueType type, Value value) {
+  values_.push_back(value.GetLowBits());
+  if (type == ValueType::V128) {
+    SetHighBits(values_.size() - 1, value.GetHighBits());
   }
 }
 
+Value Thread::GetValue(size_t index, ValueType type) const {
+  if (IsReference(type)) {
+    return Value::Make(Ref(values_[index]));
+  }
+  Value value = Value::MakeBits(
+      values_[index], type == ValueType::V128 ? GetHighBits(index) : 0);
+  value.SetType(type);
+  return value;
+}
+
 #define TRAP(msg) *out_trap = Trap::New(store_, (msg), frames_), RunResult::Trap
 #define TRAP_IF(cond, msg)     \
   if (WABT_UNLIKELY((cond))) { \
@@ -1014,34 +1517,29 @@ Instance* Thread::GetCallerInstance() {
 }
 
 RunResult Thread::PushCall(Ref func, u32 offset, Trap::Ptr* out_trap) {
-  TRAP_IF(frames_.size() == frames_.capacity(), "call stack exhausted");
-  frames_.emplace_back(func, values_.size(), exceptions_.size(), offset, inst_,
-                       mod_);
+  TRAP_IF(frames_.size() >= call_stack_size_, "call stack exhausted");
+  frames_.emplace_back(func, values_.size(), offset, inst_, mod_);
   return RunResult::Ok;
 }
 
 RunResult Thread::PushCall(const DefinedFunc& func, Trap::Ptr* out_trap) {
-  TRAP_IF(frames_.size() == frames_.capacity(), "call stack exhausted");
-  inst_ = store_.UnsafeGet<Instance>(func.instance()).get();
-  mod_ = store_.UnsafeGet<Module>(inst_->module()).get();
-  frames_.emplace_back(func.self(), values_.size(), exceptions_.size(),
-                       func.desc().code_offset, inst_, mod_);
+  TRAP_IF(frames_.size() >= call_stack_size_, "call stack exhausted");
+  inst_ = store_.UnsafeGetRaw<Instance>(func.instance());
+  mod_ = store_.UnsafeGetRaw<Module>(inst_->module());
+  frames_.emplace_back(func.self(), values_.size(), func.desc().code_offset,
+                       inst_, mod_);
   return RunResult::Ok;
 }
 
 RunResult Thread::PushCall(const HostFunc& func, Trap::Ptr* out_trap) {
-  TRAP_IF(frames_.size() == frames_.capacity(), "call stack exhausted");
+  TRAP_IF(frames_.size() >= call_stack_size_, "call stack exhausted");
   inst_ = nullptr;
   mod_ = nullptr;
-  frames_.emplace_back(func.self(), values_.size(), exceptions_.size(), 0,
-                       inst_, mod_);
+  frames_.emplace_back(func.self(), values_.size(), 0, inst_, mod_);
   return RunResult::Ok;
 }
 
 RunResult Thread::PopCall() {
-  // Sanity check that the exception stack was popped correctly.
-  assert(frames_.back().exceptions == exceptions_.size());
-
   frames_.pop_back();
   if (frames_.empty()) {
     return RunResult::Return;
@@ -1058,17 +1556,104 @@ RunResult Thread::PopCall() {
   return RunResult::Ok;
 }
 
-RunResult Thread::DoReturnCall(const Func::Ptr& func, Trap::Ptr* out_trap) {
+RunResult Thread::DoReturnCall(Func* func, Trap::Ptr* out_trap) {
   PopCall();
-  DoCall(func, out_trap);
+  if (DoCall(func, out_trap) == RunResult::Suspended) {
+    return RunResult::Suspended;
+  }
   return frames_.empty() ? RunResult::Return : RunResult::Ok;
 }
 
+RunResult Thread::Call(Func* func,
+                       const Values& params,
+                       Values& results,
+                       Trap::Ptr* out_trap) {
+  assert(!suspended_);
+  assert(params.size() == func->type().params.size());
+  call_num_frames_ = frames_.size();
+  call_num_values_ = values_.size();
+  PushValues(func->type().params, params);
+  call_func_ = func->self();
+  RunResult result = DoCall(func, out_trap);
+  if (result == RunResult::Ok && isa<DefinedFunc>(func)) {
+    result = Run(out_trap);
+  }
+  return FinishCall(result, results, out_trap);
+}
+
+RunResult Thread::Resume(const Values& host_results,
+                         Values& results,
+                         Trap::Ptr* out_trap) {
+  assert(suspended_);
+  suspended_ = false;
+  PushValues(suspended_result_types_, host_results);
+  // The host function's frame has been popped, so any frames left above the
+  // ones from before the call belong to the wasm code that called it.
+  // Otherwise it was the function passed to Call.
+  RunResult result =
+      frames_.size() > call_num_frames_ ? Run(out_trap) : RunResult::Return;
+  return FinishCall(result, results, out_trap);
+}
+
+RunResult Thread::FinishCall(RunResult result,
+                             Values& results,
+                             Trap::Ptr* out_trap) {
+  switch (result) {
+    case RunResult::Ok:
+    case RunResult::Return:
+      PopValues(store_.UnsafeGetRaw<Func>(call_func_)->type().results,
+                &results);
+      call_func_ = Ref::Null;
+      return RunResult::Return;
+
+    case RunResult::Exception:
+      // While this is not actually a trap, it is a convenient way to report
+      // an uncaught exception.
+      *out_trap = Trap::New(store_, "uncaught exception");
+      UnwindCall(call_num_frames_, call_num_values_);
+      call_func_ = Ref::Null;
+      return RunResult::Trap;
+
+    case RunResult::Trap:
+      UnwindCall(call_num_frames_, call_num_values_);
+      call_func_ = Ref::Null;
+      break;
+
+    case RunResult::Suspended:
+      break;
+  }
+  return result;
+}
+
+void Thread::UnwindCall(size_t num_frames, size_t num_values) {
+  if (frames_.size() > num_frames) {
+    frames_.erase(frames_.begin() + num_frames, frames_.end());
+  }
+  values_.resize(std::min(values_.size(), num_values));
+  if (frames_.empty()) {
+    inst_ = nullptr;
+    mod_ = nullptr;
+  } else {
+    inst_ = frames_.back().inst;
+    mod_ = frames_.back().mod;
+  }
+}
+
+RunResult Thread::FinishHostCall(const ValueTypes& result_types) {
+  suspend_requested_ = false;
+  suspended_ = true;
+  suspended_result_types_ = result_types;
+  return RunResult::Suspended;
+}
+
 void Thread::PopValues(const ValueTypes& types, Values* out_values) {
   assert(values_.size() >= types.size());
+  size_t base = values_.size() - types.size();
   out_values->resize(types.size());
-  std::copy(values_.end() - types.size(), values_.end(), out_values->begin());
-  values_.resize(values_.size() - types.size());
+  for (size_t i = 0; i < types.size(); ++i) {
+    (*out_values)[i] = GetValue(base + i, types[i]);
+  }
+  values_.resize(base);
 }
 
 RunResult Thread::Run(Trap::Ptr* out_trap) {
@@ -1082,6 +1667,15 @@ RunResult Thread::Run(Trap::Ptr* out_trap) {
 
 RunResult Thread::Run(int num_instructions, Trap::Ptr* out_trap) {
   DefinedFunc::Ptr func{store_, frames_.back().func};
+  if (WABT_UNLIKELY(dispatch_stats_)) {
+    for (; num_instructions > 0; --num_instructions) {
+      auto result = StepWithStats(out_trap);
+      if (result != RunResult::Ok) {
+        return result;
+      }
+    }
+    return RunResult::Ok;
+  }
   for (; num_instructions > 0; --num_instructions) {
     auto result = StepInternal(out_trap);
     if (result != RunResult::Ok) {
@@ -1093,49 +1687,114 @@ RunResult Thread::Run(int num_instructions, Trap::Ptr* out_trap) {
 
 RunResult Thread::Step(Trap::Ptr* out_trap) {
   DefinedFunc::Ptr func{store_, frames_.back().func};
+  return dispatch_stats_ ? StepWithStats(out_trap) : StepInternal(out_trap);
+}
+
+RunResult Thread::StepWithStats(Trap::Ptr* out_trap) {
+  using O = Opcode;
+
+  u32 pc = frames_.back().offset;
+  auto instr = mod_->desc().istream.Read(&pc);
+  dispatch_stats_->OnInstr(instr.op);
+  switch (instr.op) {
+    case O::BrIf:
+      dispatch_stats_->OnBranch(instr.op, Pick(1).Get<u32>() != 0);
+      break;
+
+    case O::InterpBrUnless:
+      dispatch_stats_->OnBranch(instr.op, Pick(1).Get<u32>() == 0);
+      break;
+
+    case O::CallIndirect:
+    case O::ReturnCallIndirect: {
+      const Table* table = inst_->table_ptr(instr.imm_u32x3.fst);
+      u32 entry = Pick(1).Get<u32>();
+      if (entry < table->elements().size() &&
+          table->elements()[entry] != Ref::Null) {
+        dispatch_stats_->OnCallIndirect(mod_, frames_.back().offset,
+                                        table->elements()[entry]);
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
   return StepInternal(out_trap);
 }
 
-Value& Thread::Pick(Index index) {
+bool Thread::UsesV128() const {
+  return mod_ && mod_->desc().uses_v128;
+}
+
+Value Thread::Pick(Index index) {
+  assert(index > 0 && index <= values_.size());
+  size_t i = values_.size() - index;
+  return Value::MakeBits(values_[i], UsesV128() ? GetHighBits(i) : 0);
+}
+
+void Thread::Poke(Index index, Value value) {
   assert(index > 0 && index <= values_.size());
-  return values_[values_.size() - index];
+  size_t i = values_.size() - index;
+  values_[i] = value.GetLowBits();
+  if (UsesV128()) {
+    SetHighBits(i, value.GetHighBits());
+  }
 }
 
 template <typename T>
 T WABT_VECTORCALL Thread::Pop() {
-  return Pop().Get<T>();
+  size_t i = values_.size() - 1;
+  u64 high = sizeof(T) > sizeof(u64) ? GetHighBits(i) : 0;
+  Value value = Value::MakeBits(values_[i], high);
+  values_.pop_back();
+  return value.Get<T>();
 }
 
 Value Thread::Pop() {
-  if (!refs_.empty() && refs_.back() >= values_.size()) {
-    refs_.pop_back();
-  }
-  auto value = values_.back();
+  Value value = Pick(1);
   values_.pop_back();
   return value;
 }
 
-u64 Thread::PopPtr(const Memory::Ptr& memory) {
+u64 Thread::PopPtr(const Memory* memory) {
   return memory->type().limits.is_64 ? Pop<u64>() : Pop<u32>();
 }
 
 template <typename T>
 void WABT_VECTORCALL Thread::Push(T value) {
-  Push(Value::Make(value));
+  Value v = Value::Make(value);
+  values_.push_back(v.GetLowBits());
+  if (sizeof(T) > sizeof(u64)) {
+    SetHighBits(values_.size() - 1, v.GetHighBits());
+  }
 }
 
 template <>
 void Thread::Push<bool>(bool value) {
-  Push(Value::Make(static_cast<u32>(value ? 1 : 0)));
+  values_.push_back(value ? 1 : 0);
 }
 
 void Thread::Push(Value value) {
-  values_.push_back(value);
+  values_.push_back(value.GetLowBits());
+  if (UsesV128()) {
+    SetHighBits(values_.size() - 1, value.GetHighBits());
+  }
 }
 
 void Thread::Push(Ref ref) {
-  refs_.push_back(values_.size());
-  values_.push_back(Value::Make(ref));
+  values_.push_back(ref.index);
+}
+
+u64 Thread::GetHighBits(size_t index) const {
+  return index < high_values_.size() ? high_values_[index] : 0;
+}
+
+void Thread::SetHighBits(size_t index, u64 bits) {
+  if (index >= high_values_.size()) {
+    high_values_.resize(index + 1);
+  }
+  high_values_[index] = bits;
 }
 
 RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
@@ -1168,7 +1827,7 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
       if (key >= instr.imm_u32) {
         key = instr.imm_u32;
       }
-      pc += key * Istream::kBrTableEntrySize;
+      pc = istream.ReadBrTableTarget(pc, key);
       break;
     }
 
@@ -1177,7 +1836,7 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
 
     case O::Call: {
       Ref new_func_ref = inst_->funcs()[instr.imm_u32];
-      DefinedFunc::Ptr new_func{store_, new_func_ref};
+      auto* new_func = cast<DefinedFunc>(inst_->func_ptr(instr.imm_u32));
       if (PushCall(new_func_ref, new_func->desc().code_offset, out_trap) ==
           RunResult::Trap) {
         return RunResult::Trap;
@@ -1187,16 +1846,33 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
 
     case O::CallIndirect:
     case O::ReturnCallIndirect: {
-      Table::Ptr table{store_, inst_->tables()[instr.imm_u32x2.fst]};
-      auto&& func_type = mod_->desc().func_types[instr.imm_u32x2.snd];
+      Table* table = inst_->table_ptr(instr.imm_u32x3.fst);
       auto entry = Pop<u32>();
       TRAP_IF(entry >= table->elements().size(), "undefined table index");
       auto new_func_ref = table->elements()[entry];
       TRAP_IF(new_func_ref == Ref::Null, "uninitialized table element");
-      Func::Ptr new_func{store_, new_func_ref};
+
+      // Most call sites always call the same function, so skip the type
+      // check and the dispatch on the function kind if the table element
+      // is the one that was called last time.
+      auto& cache = inst_->call_indirect_cache(instr.imm_u32x3.trd);
+      if (new_func_ref == cache.ref &&
+          table->generation() == cache.table_generation) {
+        if (instr.op == O::ReturnCallIndirect) {
+          return DoReturnCall(cache.func, out_trap);
+        }
+        return PushCall(*cache.func, out_trap);
+      }
+
+      Func* new_func = store_.UnsafeGetRaw<Func>(new_func_ref);
       TRAP_IF(
-          Failed(Match(new_func->type(), func_type, nullptr)),
+          new_func->type_id() != mod_->func_type_id(instr.imm_u32x3.snd),
           "indirect call signature mismatch");  // TODO: don't use "signature"
+      if (auto* defined_func = dyn_cast<DefinedFunc>(new_func)) {
+        cache.ref = new_func_ref;
+        cache.table_generation = table->generation();
+        cache.func = defined_func;
+      }
       if (instr.op == O::ReturnCallIndirect) {
         return DoReturnCall(new_func, out_trap);
       } else {
@@ -1209,7 +1885,6 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
       break;
 
     case O::Select: {
-      // TODO: need to mark whether this is a ref.
       auto cond = Pop<u32>();
       Value false_ = Pop();
       Value true_ = Pop();
@@ -1218,29 +1893,27 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
     }
 
     case O::LocalGet:
-      // TODO: need to mark whether this is a ref.
       Push(Pick(instr.imm_u32));
       break;
 
     case O::LocalSet: {
-      Pick(instr.imm_u32) = Pick(1);
+      Poke(instr.imm_u32, Pick(1));
       Pop();
       break;
     }
 
     case O::LocalTee:
-      Pick(instr.imm_u32) = Pick(1);
+      Poke(instr.imm_u32, Pick(1));
       break;
 
     case O::GlobalGet: {
-      // TODO: need to mark whether this is a ref.
-      Global::Ptr global{store_, inst_->globals()[instr.imm_u32]};
+      Global* global = inst_->global_ptr(instr.imm_u32);
       Push(global->Get());
       break;
     }
 
     case O::GlobalSet: {
-      Global::Ptr global{store_, inst_->globals()[instr.imm_u32]};
+      Global* global = inst_->global_ptr(instr.imm_u32);
       global->UnsafeSet(Pop());
       break;
     }
@@ -1271,7 +1944,7 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
     case O::I64Store32: return DoStore<u64, u32>(instr, out_trap);
 
     case O::MemorySize: {
-      Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32]};
+      Memory* memory = inst_->memory_ptr(instr.imm_u32);
       if (memory->type().limits.is_64) {
         Push<u64>(memory->PageSize());
       } else {
@@ -1281,7 +1954,7 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
     }
 
     case O::MemoryGrow: {
-      Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32]};
+      Memory* memory = inst_->memory_ptr(instr.imm_u32);
       u64 old_size = memory->PageSize();
       if (memory->type().limits.is_64) {
         if (Failed(memory->Grow(Pop<u64>()))) {
@@ -1443,12 +2116,36 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
     case O::I64Extend16S:  return DoUnop(IntExtend<u64, 15>);
     case O::I64Extend32S:  return DoUnop(IntExtend<u64, 31>);
 
-    case O::InterpAlloca:
-      values_.resize(values_.size() + instr.imm_u32);
-      // refs_ doesn't need to be updated; We may be allocating space for
-      // references, but they will be initialized to null, so it is OK if we
-      // don't mark them.
+    case O::InterpLoopFuel:
+      TRAP_IF(store_.epoch() >= epoch_deadline_, "interrupted");
+      [[fallthrough]];
+    case O::InterpFuel:
+      TRAP_IF(instr.imm_u32x2.fst > fuel_, "out of fuel");
+      fuel_ -= instr.imm_u32x2.fst;
+      if (WABT_UNLIKELY(profiler_)) {
+        profiler_->OnBlock(*this, instr.imm_u32x2.snd);
+      }
+      break;
+
+    case O::InterpAlloca: {
+      // The locals and the operands of the frame live on the value stack.
+      // The second immediate is the most the operands can take, so the whole
+      // frame is checked here and pushes don't have to check. Running out of
+      // value stack is reported the same way as running out of call stack.
+      u64 frame_size = u64{instr.imm_u32x2.fst} + instr.imm_u32x2.snd;
+      TRAP_IF(values_.size() + frame_size > value_stack_size_,
+              "call stack exhausted");
+      if (UsesV128()) {
+        // Clear stale high halves left behind by earlier frames, so v128
+        // locals start out as zero.
+        size_t end = values_.size() + instr.imm_u32x2.fst;
+        high_values_.resize(std::max(high_values_.size(), end));
+        std::fill(high_values_.begin() + values_.size(),
+                  high_values_.begin() + end, 0);
+      }
+      values_.resize(values_.size() + instr.imm_u32x2.fst);
       break;
+    }
 
     case O::InterpBrUnless:
       if (!Pop<u32>()) {
@@ -1456,34 +2153,23 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
       }
       break;
 
-    case O::InterpCallImport: {
-      Ref new_func_ref = inst_->funcs()[instr.imm_u32];
-      Func::Ptr new_func{store_, new_func_ref};
-      return DoCall(new_func, out_trap);
-    }
+    case O::InterpCallImport:
+      return DoCall(inst_->func_ptr(instr.imm_u32), out_trap);
 
     case O::InterpDropKeep: {
       auto drop = instr.imm_u32x2.fst;
       auto keep = instr.imm_u32x2.snd;
-      // Shift kept refs down.
-      for (auto iter = refs_.rbegin(); iter != refs_.rend(); ++iter) {
-        if (*iter >= values_.size() - keep) {
-          *iter -= drop;
-        } else {
-          break;
-        }
-      }
       std::move(values_.end() - keep, values_.end(),
                 values_.end() - drop - keep);
-      values_.resize(values_.size() - drop);
-      break;
-    }
-
-    case O::InterpCatchDrop: {
-      auto drop = instr.imm_u32;
-      for (u32 i = 0; i < drop; i++) {
-        exceptions_.pop_back();
+      if (UsesV128()) {
+        size_t end = values_.size();
+        if (high_values_.size() < end) {
+          high_values_.resize(end);
+        }
+        auto high_end = high_values_.begin() + end;
+        std::move(high_end - keep, high_end, high_end - drop - keep);
       }
+      values_.resize(values_.size() - drop);
       break;
     }
 
@@ -1494,6 +2180,27 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
       Ref new_func_ref = inst_->funcs()[instr.imm_u32];
       Frame& current_frame = frames_.back();
       current_frame.func = new_func_ref;
+      // The new function's params were moved down by the preceding drop/keep.
+      current_frame.values = values_.size();
+      break;
+    }
+
+    // The code of a function that hasn't been compiled yet. The frame for the
+    // call has already been pushed, so once the function is compiled it can
+    // continue from the start of its code.
+    case O::InterpCompile: {
+      Index defined_index = instr.imm_u32;
+      std::string msg;
+      if (Failed(mod_->CompileFunc(defined_index, &msg))) {
+        return TRAP(msg);
+      }
+      const FuncDesc& desc = mod_->desc().funcs[defined_index];
+      Index func_index =
+          inst_->funcs().size() - mod_->desc().funcs.size() + defined_index;
+      cast<DefinedFunc>(inst_->func_ptr(func_index))->desc_ = desc;
+      inst_->call_indirect_caches_.resize(
+          mod_->desc().num_call_indirect_sites);
+      pc = desc.code_offset;
       break;
     }
 
@@ -1879,9 +2586,8 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
       return DoThrow(exn);
     }
     case O::Rethrow: {
-      u32 exn_index = instr.imm_u32;
-      Exception::Ptr exn{store_,
-                         exceptions_[exceptions_.size() - exn_index - 1]};
+      // The immediate is the depth of the caught exception on the value stack.
+      Exception::Ptr exn{store_, Pick(instr.imm_u32).Get<Ref>()};
       return DoThrow(exn);
     }
 
@@ -1910,9 +2616,12 @@ RunResult Thread::StepInternal(Trap::Ptr* out_trap) {
   return RunResult::Ok;
 }
 
-RunResult Thread::DoCall(const Func::Ptr& func, Trap::Ptr* out_trap) {
-  if (auto* host_func = dyn_cast<HostFunc>(func.get())) {
+RunResult Thread::DoCall(Func* func, Trap::Ptr* out_trap) {
+  if (auto* host_func = dyn_cast<HostFunc>(func)) {
     auto& func_type = host_func->type();
+    if (host_func->fast_callback_) {
+      return DoFastHostCall(*host_func, out_trap);
+    }
 
     Values params;
     PopValues(func_type.params, &params);
@@ -1926,18 +2635,63 @@ RunResult Thread::DoCall(const Func::Ptr& func, Trap::Ptr* out_trap) {
     }
 
     PopCall();
+    if (suspend_requested_) {
+      return FinishHostCall(func_type.results);
+    }
     PushValues(func_type.results, results);
   } else {
-    if (PushCall(*cast<DefinedFunc>(func.get()), out_trap) == RunResult::Trap) {
-      return RunResult::Ok;
+    if (PushCall(*cast<DefinedFunc>(func), out_trap) == RunResult::Trap) {
+      return RunResult::Trap;
     }
   }
   return RunResult::Ok;
 }
 
+RunResult Thread::DoFastHostCall(const HostFunc& func, Trap::Ptr* out_trap) {
+  // The value stack doesn't hold full Values, so the params and results are
+  // passed in a small buffer instead. Most host functions fit in the inline
+  // part, so the common case doesn't allocate.
+  const size_t kInlineValues = 16;
+  auto& func_type = func.type();
+  size_t num_params = func_type.params.size();
+  size_t num_results = func_type.results.size();
+  size_t num_values = num_params + num_results;
+  Value inline_values[kInlineValues];
+  Values heap_values;
+  Value* values = inline_values;
+  if (num_values > kInlineValues) {
+    heap_values.resize(num_values);
+    values = heap_values.data();
+  }
+
+  size_t base = values_.size() - num_params;
+  for (size_t i = 0; i < num_params; ++i) {
+    values[i] = GetValue(base + i, func_type.params[i]);
+  }
+  values_.resize(base);
+  if (PushCall(func, out_trap) == RunResult::Trap) {
+    return RunResult::Trap;
+  }
+
+  Span<const Value> params(values, num_params);
+  Span<Value> results(values + num_params, num_results);
+  if (Failed(func.fast_callback_(*this, func, params, results, out_trap))) {
+    return RunResult::Trap;
+  }
+
+  PopCall();
+  if (suspend_requested_) {
+    return FinishHostCall(func_type.results);
+  }
+  for (size_t i = 0; i < num_results; ++i) {
+    PushValue(func_type.results[i], results[i]);
+  }
+  return RunResult::Ok;
+}
+
 template <typename T>
 RunResult Thread::Load(Instr instr, T* out, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   u64 offset = PopPtr(memory);
   TRAP_IF(Failed(memory->Load(offset, instr.imm_u32x2.snd, out)),
           StringPrintf("out of bounds memory access: access at %" PRIu64
@@ -1959,7 +2713,7 @@ RunResult Thread::DoLoad(Instr instr, Trap::Ptr* out_trap) {
 
 template <typename T, typename V>
 RunResult Thread::DoStore(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   V val = static_cast<V>(Pop<T>());
   u64 offset = PopPtr(memory);
   TRAP_IF(Failed(memory->Store(offset, instr.imm_u32x2.snd, val)),
@@ -2023,7 +2777,7 @@ RunResult Thread::DoReinterpret() {
 }
 
 RunResult Thread::DoMemoryInit(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   auto&& data = inst_->datas()[instr.imm_u32x2.snd];
   auto size = Pop<u32>();
   auto src = Pop<u32>();
@@ -2039,8 +2793,8 @@ RunResult Thread::DoDataDrop(Instr instr) {
 }
 
 RunResult Thread::DoMemoryCopy(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr mem_dst{store_, inst_->memories()[instr.imm_u32x2.fst]};
-  Memory::Ptr mem_src{store_, inst_->memories()[instr.imm_u32x2.snd]};
+  Memory* mem_dst = inst_->memory_ptr(instr.imm_u32x2.fst);
+  Memory* mem_src = inst_->memory_ptr(instr.imm_u32x2.snd);
   auto size = PopPtr(mem_src);
   auto src = PopPtr(mem_src);
   auto dst = PopPtr(mem_dst);
@@ -2051,7 +2805,7 @@ RunResult Thread::DoMemoryCopy(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoMemoryFill(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32);
   auto size = PopPtr(memory);
   auto value = Pop<u32>();
   auto dst = PopPtr(memory);
@@ -2061,7 +2815,7 @@ RunResult Thread::DoMemoryFill(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoTableInit(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32x2.fst]};
+  Table* table = inst_->table_ptr(instr.imm_u32x2.fst);
   auto&& elem = inst_->elems()[instr.imm_u32x2.snd];
   auto size = Pop<u32>();
   auto src = Pop<u32>();
@@ -2077,8 +2831,8 @@ RunResult Thread::DoElemDrop(Instr instr) {
 }
 
 RunResult Thread::DoTableCopy(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table_dst{store_, inst_->tables()[instr.imm_u32x2.fst]};
-  Table::Ptr table_src{store_, inst_->tables()[instr.imm_u32x2.snd]};
+  Table* table_dst = inst_->table_ptr(instr.imm_u32x2.fst);
+  Table* table_src = inst_->table_ptr(instr.imm_u32x2.snd);
   auto size = Pop<u32>();
   auto src = Pop<u32>();
   auto dst = Pop<u32>();
@@ -2088,7 +2842,7 @@ RunResult Thread::DoTableCopy(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoTableGet(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32]};
+  Table* table = inst_->table_ptr(instr.imm_u32);
   auto index = Pop<u32>();
   Ref ref;
   TRAP_IF(Failed(table->Get(index, &ref)),
@@ -2100,7 +2854,7 @@ RunResult Thread::DoTableGet(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoTableSet(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32]};
+  Table* table = inst_->table_ptr(instr.imm_u32);
   auto ref = Pop<Ref>();
   auto index = Pop<u32>();
   TRAP_IF(Failed(table->Set(store_, index, ref)),
@@ -2111,7 +2865,7 @@ RunResult Thread::DoTableSet(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoTableGrow(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32]};
+  Table* table = inst_->table_ptr(instr.imm_u32);
   u32 old_size = table->size();
   auto delta = Pop<u32>();
   auto ref = Pop<Ref>();
@@ -2124,13 +2878,13 @@ RunResult Thread::DoTableGrow(Instr instr, Trap::Ptr* out_trap) {
 }
 
 RunResult Thread::DoTableSize(Instr instr) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32]};
+  Table* table = inst_->table_ptr(instr.imm_u32);
   Push<u32>(table->size());
   return RunResult::Ok;
 }
 
 RunResult Thread::DoTableFill(Instr instr, Trap::Ptr* out_trap) {
-  Table::Ptr table{store_, inst_->tables()[instr.imm_u32]};
+  Table* table = inst_->table_ptr(instr.imm_u32);
   auto size = Pop<u32>();
   auto value = Pop<Ref>();
   auto dst = Pop<u32>();
@@ -2296,7 +3050,7 @@ RunResult Thread::DoSimdLoadLane(Instr instr, Trap::Ptr* out_trap) {
 template <typename S>
 RunResult Thread::DoSimdStoreLane(Instr instr, Trap::Ptr* out_trap) {
   using T = typename S::LaneType;
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2_u8.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2_u8.fst);
   auto result = Pop<S>();
   T val = result[instr.imm_u32x2_u8.idx];
   u64 offset = PopPtr(memory);
@@ -2435,7 +3189,7 @@ RunResult Thread::DoSimdDot() {
 
 template <typename T, typename V>
 RunResult Thread::DoAtomicLoad(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   u64 offset = PopPtr(memory);
   V val;
   TRAP_IF(Failed(memory->AtomicLoad(offset, instr.imm_u32x2.snd, &val)),
@@ -2447,7 +3201,7 @@ RunResult Thread::DoAtomicLoad(Instr instr, Trap::Ptr* out_trap) {
 
 template <typename T, typename V>
 RunResult Thread::DoAtomicStore(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   V val = static_cast<V>(Pop<T>());
   u64 offset = PopPtr(memory);
   TRAP_IF(Failed(memory->AtomicStore(offset, instr.imm_u32x2.snd, val)),
@@ -2460,7 +3214,7 @@ template <typename R, typename T>
 RunResult Thread::DoAtomicRmw(BinopFunc<T, T> f,
                               Instr instr,
                               Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   T val = static_cast<T>(Pop<R>());
   u64 offset = PopPtr(memory);
   T old;
@@ -2473,7 +3227,7 @@ RunResult Thread::DoAtomicRmw(BinopFunc<T, T> f,
 
 template <typename T, typename V>
 RunResult Thread::DoAtomicRmwCmpxchg(Instr instr, Trap::Ptr* out_trap) {
-  Memory::Ptr memory{store_, inst_->memories()[instr.imm_u32x2.fst]};
+  Memory* memory = inst_->memory_ptr(instr.imm_u32x2.fst);
   V replace = static_cast<V>(Pop<T>());
   V expect = static_cast<V>(Pop<T>());
   V old;
@@ -2488,7 +3242,7 @@ RunResult Thread::DoAtomicRmwCmpxchg(Instr instr, Trap::Ptr* out_trap) {
 
 RunResult Thread::DoThrow(Exception::Ptr exn) {
   Istream::Offset target_offset = Istream::kInvalidOffset;
-  u32 target_values, target_exceptions;
+  u32 target_values;
   Tag::Ptr exn_tag{store_, exn->tag()};
   bool popped_frame = false;
   bool had_catch_all = false;
@@ -2501,7 +3255,7 @@ RunResult Thread::DoThrow(Exception::Ptr exn) {
     const Frame& frame = frames_.back();
     DefinedFunc::Ptr func{store_, frame.func};
     u32 pc = frame.offset;
-    auto handlers = func->desc().handlers;
+    auto&& handlers = func->desc().handlers;
 
     // We iterate in reverse order, in order to traverse handlers from most
     // specific (pushed last) to least specific within a nested stack of
@@ -2527,14 +3281,12 @@ RunResult Thread::DoThrow(Exception::Ptr exn) {
           if (exn_tag == catch_tag) {
             target_offset = _catch.offset;
             target_values = (*iter).values;
-            target_exceptions = (*iter).exceptions;
             goto found_handler;
           }
         }
         if (handler.catch_all_offset != Istream::kInvalidOffset) {
           target_offset = handler.catch_all_offset;
           target_values = (*iter).values;
-          target_exceptions = (*iter).exceptions;
           had_catch_all = true;
           goto found_handler;
         }
@@ -2562,13 +3314,12 @@ found_handler:
     mod_ = target_frame.mod;
   }
   values_.resize(target_frame.values + target_values);
-  exceptions_.resize(target_frame.exceptions + target_exceptions);
   // Jump to the handler.
   target_frame.offset = target_offset;
-  // When an exception is caught, it needs to be tracked in a stack
-  // to allow for rethrows. This stack is popped on leaving the try-catch
-  // or by control instructions such as `br`.
-  exceptions_.push_back(exn.ref());
+  // The caught exception is kept on the value stack below its args, so it
+  // can be rethrown. Branches out of the catch block drop it along with the
+  // block's other values.
+  Push(exn.ref());
   // Also push exception payload values if applicable.
   if (!had_catch_all) {
     PushValues(exn_tag->type().signature, exn->args());
@@ -17,13 +17,16 @@
 #ifndef WABT_INTERP_H_
 #define WABT_INTERP_H_
 
+#include <atomic>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "src/cast.h"
@@ -44,7 +47,10 @@ class DataSegment;
 class ElemSegment;
 class Module;
 class Instance;
+class MemoryImage;
 class Thread;
+class Profiler;
+class DispatchStats;
 template <typename T>
 class RefPtr;
 
@@ -68,6 +74,8 @@ using ValueTypes = std::vector<ValueType>;
 template <typename T>
 bool HasType(ValueType);
 template <typename T>
+ValueType GetValueType();
+template <typename T>
 void RequireType(ValueType);
 bool IsReference(ValueType);
 bool TypesMatch(ValueType expected, ValueType actual);
@@ -310,9 +318,10 @@ struct HandlerDesc {
     u32 catch_all_offset;
     u32 delegate_handler_index;
   };
-  // Local stack heights at the handler site that need to be restored.
+  // Height of the value stack at the handler site that needs to be restored,
+  // relative to Frame::values. The caught exception is pushed on top of it,
+  // followed by its args, and stays there until the catch block ends.
   u32 values;
-  u32 exceptions;
 };
 
 struct FuncDesc {
@@ -323,6 +332,11 @@ struct FuncDesc {
   std::vector<LocalDesc> locals;
   u32 code_offset;  // Istream offset.
   std::vector<HandlerDesc> handlers;
+  // Istream offsets of the basic blocks. Only set if the code was read with
+  // fuel metering, in which case each block starts with an interp_fuel
+  // instruction that has the block's index.
+  std::vector<u32> block_offsets;
+  std::string name;  // From the "name" section, if any.
 };
 
 struct TableDesc {
@@ -371,6 +385,30 @@ struct ElemDesc {
   FuncDesc init_func;
 };
 
+// Which slots of a frame hold references, from `offset` up to the offset of
+// the next StackMapDesc. Slots are counted from the frame's first param, so
+// they cover the params, the locals and the operand stack.
+struct StackMapDesc {
+  u32 offset;  // Istream offset.
+  std::vector<u32> ref_slots;
+};
+
+struct ModuleDesc;
+
+// Compiles the functions of a module that was read lazily; see
+// ReadBinaryInterpLazy. Until then, the code of a defined function is a single
+// interp_compile instruction, which calls Module::CompileFunc.
+class LazyCompiler {
+ public:
+  virtual ~LazyCompiler() {}
+
+  // Appends the code of `defined_index` to the module's istream, and updates
+  // its FuncDesc. On failure, the FuncDesc is left unchanged.
+  virtual Result Compile(ModuleDesc*,
+                         Index defined_index,
+                         std::string* out_msg) = 0;
+};
+
 struct ModuleDesc {
   std::vector<FuncType> func_types;
   std::vector<ImportDesc> imports;
@@ -384,6 +422,18 @@ struct ModuleDesc {
   std::vector<ElemDesc> elems;
   std::vector<DataDesc> datas;
   Istream istream;
+  // Number of call_indirect and return_call_indirect instructions in the
+  // istream; each one has its own cache in every instance.
+  Index num_call_indirect_sites = 0;
+  // Sorted by offset. Used by Thread::Mark to find the references on the value
+  // stack, so the interpreter doesn't have to track them as it runs.
+  std::vector<StackMapDesc> stack_maps;
+  // Whether the module's code can have v128 values on the value stack at all,
+  // i.e. whether it has any v128 types or SIMD instructions. If not, the
+  // high half of the values never needs to be copied; see Thread::values_.
+  bool uses_v128 = false;
+  // Null unless the functions are compiled on their first call.
+  std::shared_ptr<LazyCompiler> lazy_compiler;
 };
 
 //// Runtime ////
@@ -391,7 +441,6 @@ struct ModuleDesc {
 struct Frame {
   explicit Frame(Ref func,
                  u32 values,
-                 u32 exceptions,
                  u32 offset,
                  Instance*,
                  Module*);
@@ -399,9 +448,8 @@ struct Frame {
   void Mark(Store&);
 
   Ref func;
-  u32 values;      // Height of the value stack at this activation.
-  u32 exceptions;  // Height of the exception stack at this activation.
-  u32 offset;      // Istream offset; either the return PC, or the current PC.
+  u32 values;  // Height of the value stack at this activation.
+  u32 offset;  // Istream offset; either the return PC, or the current PC.
 
   // Cached for convenience. Both are null if func is a HostFunc.
   Instance* inst;
@@ -468,6 +516,14 @@ class Store {
   Result Get(Ref, RefPtr<T>* out);
   template <typename T>
   RefPtr<T> UnsafeGet(Ref);
+  // Like UnsafeGet, but doesn't add a root. The caller must make sure that the
+  // object stays reachable for as long as the pointer is used.
+  template <typename T>
+  T* UnsafeGetRaw(Ref);
+
+  // Returns an id that is the same for all function types that match each
+  // other, so signatures can be checked with a single compare.
+  Index InternFuncType(const FuncType&);
 
   RootList::Index NewRoot(Ref);
   RootList::Index CopyRoot(RootList::Index);
@@ -484,6 +540,18 @@ class Store {
 
   std::set<Thread*>& threads();
 
+  // Returns a Thread from this store's cache of idle threads, or a new one if
+  // the cache is empty. Pass it to ReleaseThread when done, so it can be
+  // reused without reallocating its stacks.
+  std::unique_ptr<Thread> AcquireThread();
+  void ReleaseThread(std::unique_ptr<Thread>);
+
+  // Code read with fuel metering traps at the next loop header or function
+  // entry once the epoch reaches the running Thread's deadline. These can be called from any
+  // thread, e.g. a timer that interrupts long-running instances.
+  u64 epoch() const;
+  void IncrementEpoch();
+
  private:
   template <typename T>
   friend class RefPtr;
@@ -500,8 +568,12 @@ class Store {
   GCContext gc_context_;
   // This set contains the currently active Thread objects.
   std::set<Thread*> threads_;
+  // Must be destroyed before threads_.
+  std::vector<std::unique_ptr<Thread>> idle_threads_;
   ObjectList objects_;
   RootList roots_;
+  std::map<std::pair<ValueTypes, ValueTypes>, Index> func_type_ids_;
+  std::atomic<u64> epoch_{0};
 };
 
 template <typename T>
@@ -569,6 +641,12 @@ struct Value {
   template <typename T>
   void WABT_VECTORCALL Set(T);
 
+  // The bits of the value, regardless of its type, as two 8-byte halves. Only
+  // v128 values use the high half.
+  static Value WABT_VECTORCALL MakeBits(u64 low, u64 high);
+  u64 WABT_VECTORCALL GetLowBits() const;
+  u64 WABT_VECTORCALL GetHighBits() const;
+
  private:
   union {
     u32 i32_;
@@ -597,6 +675,25 @@ struct Value {
 };
 using Values = std::vector<Value>;
 
+// A view of a contiguous range of values, e.g. on a Thread's value stack.
+template <typename T>
+class Span {
+ public:
+  Span(T* data, size_t size) : data_(data), size_(size) {}
+
+  T* begin() const { return data_; }
+  T* end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+  T& operator[](size_t index) const {
+    assert(index < size_);
+    return data_[index];
+  }
+
+ private:
+  T* data_;
+  size_t size_;
+};
+
 struct TypedValue {
   ValueType type;
   Value value;
@@ -738,15 +835,18 @@ class Func : public Extern {
 
   const ExternType& extern_type() override;
   const FuncType& type() const;
+  // See Store::InternFuncType.
+  Index type_id() const;
 
  protected:
-  explicit Func(ObjectKind, FuncType);
+  explicit Func(Store&, ObjectKind, FuncType);
   virtual Result DoCall(Thread& thread,
                         const Values& params,
                         Values& results,
                         Trap::Ptr* out_trap) = 0;
 
   FuncType type_;
+  Index type_id_;
 };
 
 class DefinedFunc : public Func {
@@ -756,12 +856,18 @@ class DefinedFunc : public Func {
   static const char* GetTypeName() { return "DefinedFunc"; }
   using Ptr = RefPtr<DefinedFunc>;
 
-  static DefinedFunc::Ptr New(Store&, Ref instance, FuncDesc);
+  // `index` is the function's index in its module, or kInvalidIndex for the
+  // functions that initialize globals and segments.
+  static DefinedFunc::Ptr New(Store&,
+                              Ref instance,
+                              FuncDesc,
+                              Index index = kInvalidIndex);
 
   Result Match(Store&, const ImportType&, Trap::Ptr* out_trap) override;
 
   Ref instance() const;
   const FuncDesc& desc() const;
+  Index index() const;
 
  protected:
   Result DoCall(Thread& thread,
@@ -771,11 +877,13 @@ class DefinedFunc : public Func {
 
  private:
   friend Store;
-  explicit DefinedFunc(Store&, Ref instance, FuncDesc);
+  friend Thread;
+  explicit DefinedFunc(Store&, Ref instance, FuncDesc, Index index);
   void Mark(Store&) override;
 
   Ref instance_;
   FuncDesc desc_;
+  Index index_;
 };
 
 class HostFunc : public Func {
@@ -790,10 +898,32 @@ class HostFunc : public Func {
                                         Values& results,
                                         Trap::Ptr* out_trap)>;
 
+  // The params and results are copied through a buffer on the calling
+  // thread's C++ stack, so they stay valid for the whole callback, even if it
+  // calls back into the same thread. A call doesn't allocate unless the
+  // function has more than 16 params and results in total, in which case the
+  // buffer is allocated on the heap.
+  using FastCallback = Result (*)(Thread& thread,
+                                  const HostFunc& func,
+                                  Span<const Value> params,
+                                  Span<Value> results,
+                                  Trap::Ptr* out_trap);
+
   static HostFunc::Ptr New(Store&, FuncType, Callback);
+  static HostFunc::Ptr New(Store&,
+                           FuncType,
+                           FastCallback,
+                           void* user_data = nullptr);
+  // Wraps a plain function using FastCallback, e.g.
+  // `HostFunc::New<s32(s32, s64)>(store, fn)`. The function type is derived
+  // from the signature, which may only use s32, u32, s64, u64, f32 and f64.
+  template <typename Sig>
+  static HostFunc::Ptr New(Store&, Sig* fn);
 
   Result Match(Store&, const ImportType&, Trap::Ptr* out_trap) override;
 
+  void* user_data() const;
+
  protected:
   Result DoCall(Thread& thread,
                 const Values& params,
@@ -803,10 +933,18 @@ class HostFunc : public Func {
  private:
   friend Store;
   friend Thread;
+  using GenericFn = void (*)();
+  template <typename Sig>
+  struct TypedCallback;
+
   explicit HostFunc(Store&, FuncType, Callback);
+  explicit HostFunc(Store&, FuncType, FastCallback, void* user_data);
   void Mark(Store&) override;
 
   Callback callback_;
+  FastCallback fast_callback_ = nullptr;
+  void* user_data_ = nullptr;
+  GenericFn typed_fn_ = nullptr;
 };
 
 class Table : public Extern {
@@ -846,13 +984,19 @@ class Table : public Extern {
   const RefVec& elements() const;
   u32 size() const;
 
+  // Incremented whenever an element of the table may have changed. Used to
+  // invalidate the call_indirect caches of the instances that use it.
+  u32 generation() const;
+
  private:
   friend Store;
+  friend Instance;
   explicit Table(Store&, TableType);
   void Mark(Store&) override;
 
   TableType type_;
   RefVec elements_;
+  u32 generation_ = 0;
 };
 
 class Memory : public Extern {
@@ -895,6 +1039,13 @@ class Memory : public Extern {
   u64 ByteSize() const;
   u64 PageSize() const;
 
+  // Creates a memory with the same type and contents. With HAVE_MEMFD_CREATE
+  // both memories become private mappings of a copy of the contents, so a
+  // page is only copied once either memory writes to it. The copy is reused
+  // by later clones until this memory is written again. Like Grow, this may
+  // move the data of this memory.
+  Memory::Ptr Clone(class Store&);
+
   // Unsafe API.
   template <typename T>
   T WABT_VECTORCALL UnsafeLoad(u64 offset, u64 addend) const;
@@ -905,11 +1056,28 @@ class Memory : public Extern {
 
  private:
   friend class Store;
+  friend Instance;
   explicit Memory(class Store&, MemoryType);
+  ~Memory() override;
   void Mark(class Store&) override;
 
+  // Grows the data to `size` bytes, which are zero.
+  Result Resize(u64 size);
+#if HAVE_MEMFD_CREATE
+  Result MapImage(std::shared_ptr<MemoryImage>);
+  bool IsImageModified() const;
+#endif
+
   MemoryType type_;
-  Buffer data_;
+  // With HAVE_MEMFD_CREATE, the data is a private mapping, either anonymous or
+  // of image_; otherwise it is buffer_.
+  u8* data_ = nullptr;
+  u64 size_ = 0;
+#if HAVE_MEMFD_CREATE
+  std::shared_ptr<MemoryImage> image_;
+#else
+  Buffer buffer_;
+#endif
   u64 pages_;
 };
 
@@ -1015,6 +1183,12 @@ class Module : public Object {
   const ModuleDesc& desc() const;
   const std::vector<ImportType>& import_types() const;
   const std::vector<ExportType>& export_types() const;
+  // The interned id of desc().func_types[index]; see Store::InternFuncType.
+  Index func_type_id(Index index) const;
+
+  // Compiles a defined function of a lazily read module, if it hasn't been
+  // compiled yet.
+  Result CompileFunc(Index defined_index, std::string* out_msg);
 
  private:
   friend Store;
@@ -1025,6 +1199,7 @@ class Module : public Object {
   ModuleDesc desc_;
   std::vector<ImportType> import_types_;
   std::vector<ExportType> export_types_;
+  std::vector<Index> func_type_ids_;
 };
 
 class Instance : public Object {
@@ -1039,6 +1214,15 @@ class Instance : public Object {
                                    const RefVec& imports,
                                    Trap::Ptr* out_trap);
 
+  // Creates a new instance of the same module, starting from the current
+  // state of this one. The tables, memories, globals and tags defined by this
+  // instance are copied, and references to this instance's objects (e.g.
+  // functions stored in a table) are redirected to the copies. Imports are
+  // shared. Import matching, the initializers and the start function are not
+  // run again, so an instance can be instantiated once and kept as a
+  // snapshot, then cloned to get fresh instances cheaply.
+  Instance::Ptr Clone(Store&) const;
+
   Ref module() const;
   const RefVec& imports() const;
   const RefVec& funcs() const;
@@ -1052,13 +1236,40 @@ class Instance : public Object {
   const std::vector<DataSegment>& datas() const;
   std::vector<DataSegment>& datas();
 
+  // Unrooted pointers to the objects in funcs(), tables(), memories() and
+  // globals(). They are valid as long as this instance is alive, since the
+  // instance keeps the objects reachable.
+  Func* func_ptr(Index) const;
+  Table* table_ptr(Index) const;
+  Memory* memory_ptr(Index) const;
+  Global* global_ptr(Index) const;
+
+  // The last defined function called from a call_indirect or
+  // return_call_indirect instruction, indexed by the instruction's call site
+  // index. The entry is valid while the table element is still `ref` and the
+  // table's generation hasn't changed.
+  struct CallIndirectCache {
+    Ref ref = Ref::Null;
+    u32 table_generation = 0;
+    DefinedFunc* func = nullptr;
+  };
+
+  CallIndirectCache& call_indirect_cache(Index);
+
  private:
   friend Store;
+  friend Thread;
   friend ElemSegment;
   friend DataSegment;
   explicit Instance(Store&, Ref module);
   void Mark(Store&) override;
 
+  void AddFunc(Store&, Ref func);
+  void AddTable(Store&, Ref table);
+  void AddMemory(Store&, Ref memory);
+  void AddGlobal(Store&, Ref global);
+  void AddExports(const ModuleDesc&);
+
   Result CallInitFunc(Store&,
                       const Ref func_ref,
                       Value* result,
@@ -1074,6 +1285,11 @@ class Instance : public Object {
   RefVec exports_;
   std::vector<ElemSegment> elems_;
   std::vector<DataSegment> datas_;
+  std::vector<Func*> func_ptrs_;
+  std::vector<Table*> table_ptrs_;
+  std::vector<Memory*> memory_ptrs_;
+  std::vector<Global*> global_ptrs_;
+  std::vector<CallIndirectCache> call_indirect_caches_;
 };
 
 enum class RunResult {
@@ -1081,6 +1297,7 @@ enum class RunResult {
   Return,
   Trap,
   Exception,
+  Suspended,
 };
 
 class Thread {
@@ -1088,19 +1305,59 @@ class Thread {
   struct Options {
     static const u32 kDefaultValueStackSize = 64 * 1024 / sizeof(Value);
     static const u32 kDefaultCallStackSize = 64 * 1024 / sizeof(Frame);
+    static const u64 kUnlimitedFuel = ~u64{0};
+    static const u64 kNoEpochDeadline = ~u64{0};
 
+    // The stacks start small and grow on demand up to these limits.
     u32 value_stack_size = kDefaultValueStackSize;
     u32 call_stack_size = kDefaultCallStackSize;
     Stream* trace_stream = nullptr;
+    // Only consumed by code read with fuel metering, see ReadBinaryInterp.
+    u64 fuel = kUnlimitedFuel;
+    // See Thread::set_epoch_deadline; also only for code read with fuel
+    // metering.
+    u64 epoch_deadline = kNoEpochDeadline;
+    // Like fuel, only works for code read with fuel metering.
+    Profiler* profiler = nullptr;
+    // Collecting dispatch stats makes every instruction slower.
+    DispatchStats* dispatch_stats = nullptr;
   };
 
   Thread(Store& store, Stream* trace_stream = nullptr);
+  Thread(Store& store, const Options&);
   ~Thread();
 
   RunResult Run(Trap::Ptr* out_trap);
   RunResult Run(int num_instructions, Trap::Ptr* out_trap);
   RunResult Step(Trap::Ptr* out_trap);
 
+  // Calls func like Func::Call, but a host function called from wasm may
+  // suspend the thread. In that case RunResult::Suspended is returned, and
+  // the thread keeps its state until it is resumed with Resume. Otherwise
+  // the call runs to completion, returning RunResult::Return with func's
+  // results in `results`, or RunResult::Trap.
+  RunResult Call(Func* func,
+                 const Values& params,
+                 Values& results,
+                 Trap::Ptr* out_trap);
+  // Continues a suspended call, passing `host_results` as the results of the
+  // host function that suspended it. Returns the same as Call.
+  RunResult Resume(const Values& host_results,
+                   Values& results,
+                   Trap::Ptr* out_trap);
+
+  // Called from a HostFunc callback to suspend the thread once the callback
+  // returns. The callback's results are ignored.
+  void Suspend();
+  bool suspended() const;
+
+  // The fuel left is kept across calls; running out of it traps. The thread
+  // also traps at a loop header or function entry once Store::epoch() reaches
+  // the deadline.
+  u64 fuel() const;
+  void set_fuel(u64);
+  void set_epoch_deadline(u64);
+
   Store& store();
   void Mark();
 
@@ -1109,31 +1366,56 @@ class Thread {
  private:
   friend Store;
   friend DefinedFunc;
+  friend Profiler;
 
   struct TraceSource;
 
+  static constexpr u32 kInitialValueStackSize = 256;
+  static constexpr u32 kInitialCallStackSize = 16;
+
+  // Clears the stacks, e.g. after a trap, but keeps their storage.
+  void Reset();
+
   RunResult PushCall(Ref func, u32 offset, Trap::Ptr* out_trap);
   RunResult PushCall(const DefinedFunc&, Trap::Ptr* out_trap);
   RunResult PushCall(const HostFunc&, Trap::Ptr* out_trap);
   RunResult PopCall();
-  RunResult DoCall(const Func::Ptr&, Trap::Ptr* out_trap);
-  RunResult DoReturnCall(const Func::Ptr&, Trap::Ptr* out_trap);
+  RunResult DoCall(Func*, Trap::Ptr* out_trap);
+  RunResult DoFastHostCall(const HostFunc&, Trap::Ptr* out_trap);
+  RunResult FinishHostCall(const ValueTypes& result_types);
+  RunResult FinishCall(RunResult, Values& results, Trap::Ptr* out_trap);
+  // Drops the frames and values left behind by a call that trapped, so they
+  // aren't marked using stack maps that no longer match them.
+  void UnwindCall(size_t num_frames, size_t num_values);
+
+  // The index in values_ of the frame's first param.
+  size_t GetFrameBase(const Frame&) const;
+  RunResult DoReturnCall(Func*, Trap::Ptr* out_trap);
 
   void PushValues(const ValueTypes&, const Values&);
+  void PushValue(ValueType, Value);
   void PopValues(const ValueTypes&, Values*);
+  Value GetValue(size_t index, ValueType) const;
 
-  Value& Pick(Index);
+  // Untyped access to the value stack, e.g. for local.get. The high half of
+  // the value is only copied if the current module uses v128.
+  bool UsesV128() const;
+  Value Pick(Index);
+  void Poke(Index, Value);
+  Value Pop();
+  void Push(Value);
 
   template <typename T>
   T WABT_VECTORCALL Pop();
-  Value Pop();
-  u64 PopPtr(const Memory::Ptr& memory);
+  u64 PopPtr(const Memory* memory);
 
   template <typename T>
   void WABT_VECTORCALL Push(T);
-  void Push(Value);
   void Push(Ref);
 
+  u64 GetHighBits(size_t index) const;
+  void SetHighBits(size_t index, u64 bits);
+
   template <typename R, typename T>
   using UnopFunc = R WABT_VECTORCALL(T);
   template <typename R, typename T>
@@ -1234,20 +1516,41 @@ class Thread {
   RunResult DoThrow(Exception::Ptr exn_ref);
 
   RunResult StepInternal(Trap::Ptr* out_trap);
+  // Records the instruction in dispatch_stats_ and runs StepInternal.
+  RunResult StepWithStats(Trap::Ptr* out_trap);
 
   std::vector<Frame> frames_;
-  std::vector<Value> values_;
-  std::vector<u32> refs_;  // Index into values_.
-
-  // Exception handling requires tracking a separate stack of caught
-  // exceptions for catch blocks.
-  RefVec exceptions_;
+  // The value stack is split by size: values_ has the low 8 bytes of every
+  // value, and high_values_ has the high 8 bytes of v128 values. It only
+  // grows as far as needed; entries beyond its end are zero. Scalar code
+  // only touches 8 bytes per value.
+  std::vector<u64> values_;
+  std::vector<u64> high_values_;
 
   // Cached for convenience.
   Store& store_;
   Instance* inst_ = nullptr;
   Module* mod_ = nullptr;
 
+  u32 value_stack_size_;
+  u32 call_stack_size_;
+
+  // Suspending.
+  bool suspend_requested_ = false;
+  bool suspended_ = false;
+  ValueTypes suspended_result_types_;
+  // The function called by Call, whose results are returned once it is done,
+  // and the height of the stacks before the call.
+  Ref call_func_ = Ref::Null;
+  size_t call_num_frames_ = 0;
+  size_t call_num_values_ = 0;
+
+  // Metering.
+  u64 fuel_;
+  u64 epoch_deadline_ = ~u64{0};
+  Profiler* profiler_;
+  DispatchStats* dispatch_stats_;
+
   // Tracing.
   Stream* trace_stream_;
   std::unique_ptr<TraceSource> trace_source_;
@@ -17,10 +17,16 @@
 #include "src/interp/istream.h"
 
 #include <cinttypes>
+#include <limits>
 
 namespace wabt {
 namespace interp {
 
+static_assert(Opcode::Invalid <= std::numeric_limits<u16>::max(),
+              "opcodes must fit in a SerializedOpcode");
+
+Istream::Istream(Buffer data) : data_(std::move(data)) {}
+
 template <typename T>
 void WABT_VECTORCALL Istream::EmitAt(Offset offset, T val) {
   u32 new_size = offset + sizeof(T);
@@ -86,12 +92,6 @@ void Istream::EmitDropKeep(u32 drop, u32 keep) {
   }
 }
 
-void Istream::EmitCatchDrop(u32 drop) {
-  if (drop > 0) {
-    Emit(Opcode::InterpCatchDrop, drop);
-  }
-}
-
 Istream::Offset Istream::EmitFixupU32() {
   auto result = end();
   EmitInternal(kInvalidOffset);
@@ -102,10 +102,18 @@ void Istream::ResolveFixupU32(Offset fixup_offset) {
   EmitAt(fixup_offset, end());
 }
 
+void Istream::ResolveFixupU32(Offset fixup_offset, u32 val) {
+  EmitAt(fixup_offset, val);
+}
+
 Istream::Offset Istream::end() const {
   return static_cast<u32>(data_.size());
 }
 
+const Buffer& Istream::data() const {
+  return data_;
+}
+
 template <typename T>
 T WABT_VECTORCALL Istream::ReadAt(Offset* offset) const {
   assert(*offset + sizeof(T) <= data_.size());
@@ -115,6 +123,11 @@ T WABT_VECTORCALL Istream::ReadAt(Offset* offset) const {
   return result;
 }
 
+Istream::Offset Istream::ReadBrTableTarget(Offset offset, u32 index) const {
+  offset += index * kBrTableEntrySize;
+  return ReadAt<Offset>(&offset);
+}
+
 Instr Istream::Read(Offset* offset) const {
   Instr instr;
   instr.op = static_cast<Opcode::Enum>(ReadAt<SerializedOpcode>(offset));
@@ -538,10 +551,11 @@ Instr Istream::Read(Offset* offset) const {
 
     case Opcode::CallIndirect:
     case Opcode::ReturnCallIndirect:
-      // Index immediate, N operands.
+      // Table index + type index + call site index immediates, N operands.
       instr.kind = InstrKind::Imm_Index_Index_Op_N;
-      instr.imm_u32x2.fst = ReadAt<u32>(offset);
-      instr.imm_u32x2.snd = ReadAt<u32>(offset);
+      instr.imm_u32x3.fst = ReadAt<u32>(offset);
+      instr.imm_u32x3.snd = ReadAt<u32>(offset);
+      instr.imm_u32x3.trd = ReadAt<u32>(offset);
       break;
 
     case Opcode::MemoryInit:
@@ -692,9 +706,8 @@ Instr Istream::Read(Offset* offset) const {
 
     case Opcode::AtomicFence:
     case Opcode::I32Const:
-    case Opcode::InterpAlloca:
-    case Opcode::InterpCatchDrop:
     case Opcode::InterpAdjustFrameForReturnCall:
+    case Opcode::InterpCompile:
       // i32/f32 immediate, 0 operands.
       instr.kind = InstrKind::Imm_I32_Op_0;
       instr.imm_u32 = ReadAt<u32>(offset);
@@ -719,6 +732,9 @@ Instr Istream::Read(Offset* offset) const {
       break;
 
     case Opcode::InterpDropKeep:
+    case Opcode::InterpAlloca:
+    case Opcode::InterpFuel:
+    case Opcode::InterpLoopFuel:
       // i32 and i32 immediates, 0 operands.
       instr.kind = InstrKind::Imm_I32_I32_Op_0;
       instr.imm_u32x2.fst = ReadAt<u32>(offset);
@@ -803,7 +819,16 @@ void Istream::Disassemble(Stream* stream, Offset from, Offset to) const {
 
   Offset pc = from;
   while (pc < to) {
+    Offset table = pc;
+    Instr instr = Read(&table);
     pc = Trace(stream, pc, &source);
+    if (instr.op == Opcode::BrTable) {
+      for (u32 i = 0; i <= instr.imm_u32; ++i) {
+        Offset entry = table;
+        stream->Writef("%s|   @%u\n", source.Header(entry).c_str(),
+                       ReadAt<Offset>(&table));
+      }
+    }
   }
 }
 
@@ -876,8 +901,8 @@ Istream::Offset Istream::Trace(Stream* stream,
       break;
 
     case InstrKind::Imm_Index_Index_Op_N:
-      stream->Writef(" $%u, $%u\n", instr.imm_u32x2.fst,
-                     instr.imm_u32x2.snd);  // TODO param/result count?
+      stream->Writef(" $%u, $%u\n", instr.imm_u32x3.fst,
+                     instr.imm_u32x3.snd);  // TODO param/result count?
       break;
 
     case InstrKind::Imm_Index_Offset_Op_1:
@@ -953,6 +978,10 @@ Istream::Offset Istream::Trace(Stream* stream,
           instr.imm_v128.u32(3));
       break;
   }
+  if (instr.op == Opcode::BrTable) {
+    // Skip the table of targets, see Disassemble.
+    offset += (instr.imm_u32 + 1) * kBrTableEntrySize;
+  }
   return offset;
 }
 
@@ -84,6 +84,9 @@ struct Instr {
     struct {
       u32 fst, snd;
     } imm_u32x2;
+    struct {
+      u32 fst, snd, trd;
+    } imm_u32x3;
     struct {
       u32 fst, snd;
       u8 idx;
@@ -93,18 +96,17 @@ struct Instr {
 
 class Istream {
  public:
-  using SerializedOpcode = u32;  // TODO: change to u16
+  using SerializedOpcode = u16;
   using Offset = u32;
   static const Offset kInvalidOffset = ~0;
-  // Each br_table entry is made up of three instructions:
-  //
-  //   interp_drop_keep $drop $keep
-  //   interp_catch_drop $catches
-  //   br $label
-  //
-  // Each opcode is a SerializedOpcode, and each immediate is a u32.
-  static const Offset kBrTableEntrySize =
-      sizeof(SerializedOpcode) * 3 + 4 * sizeof(u32);
+  // A br_table instruction is followed by a table of `num_targets + 1` target
+  // offsets, the last one being the default target. Targets that need to drop
+  // values point to a drop/keep and br after the table instead.
+  static const Offset kBrTableEntrySize = sizeof(Offset);
+
+  Istream() = default;
+  // Creates an istream from the bytes of another one, see data().
+  explicit Istream(Buffer data);
 
   // Emit API.
   void Emit(u32);
@@ -116,15 +118,21 @@ class Istream {
   void Emit(Opcode::Enum, u32, u32);
   void Emit(Opcode::Enum, u32, u32, u8);
   void EmitDropKeep(u32 drop, u32 keep);
-  void EmitCatchDrop(u32 drop);
 
   Offset EmitFixupU32();
   void ResolveFixupU32(Offset);
+  // Resolve the fixup with a value rather than the current offset.
+  void ResolveFixupU32(Offset, u32);
 
   Offset end() const;
+  // The encoded instructions. They are in host byte order.
+  const Buffer& data() const;
 
   // Read API.
   Instr Read(Offset*) const;
+  // Reads an entry of the table that follows a br_table instruction, where
+  // `offset` is the end of the instruction.
+  Offset ReadBrTableTarget(Offset offset, u32 index) const;
 
   // Disassemble/Trace API.
   // TODO separate out disassembly/tracing?
@@ -553,6 +553,9 @@ const Module* Script::GetFirstModule() const {
 
 Module* Script::GetFirstModule() {
   for (const std::unique_ptr<Command>& command : commands) {
+    if (!command) {
+      continue;
+    }
     if (auto* module_command = dyn_cast<ModuleCommand>(command.get())) {
       return &module_command->module;
     }
@@ -562,7 +565,7 @@ Module* Script::GetFirstModule() {
 
 const Module* Script::GetModule(const Var& var) const {
   Index index = module_bindings.FindIndex(var);
-  if (index >= commands.size()) {
+  if (index >= commands.size() || !commands[index]) {
     return nullptr;
   }
   auto* command = cast<ModuleCommand>(commands[index].get());
@@ -1427,6 +1427,9 @@ struct Script {
   Module* GetFirstModule();
   const Module* GetModule(const Var&) const;
 
+  // When a script is parsed one command at a time (see ParseWastScript), only
+  // the modules that later commands can still refer to are kept; all other
+  // entries are null.
   CommandPtrVector commands;
   BindingHash module_bindings;
 };
@@ -24,6 +24,7 @@
 #include <cstring>
 #include <limits>
 #include <type_traits>
+#include <vector>
 
 namespace wabt {
 
@@ -42,6 +43,14 @@ struct FloatTraitsBase<float> {
   static constexpr int kSigBits = 23;
   static constexpr float kHugeVal = HUGE_VALF;
   static constexpr int kMaxHexBufferSize = WABT_MAX_FLOAT_HEX;
+  // Decimal exponents outside of this range always round to zero or
+  // overflow, see MakeFromDecimal below.
+  static constexpr int kMinDecimalExp = -65;
+  static constexpr int kMaxDecimalExp = 38;
+  // Decimal exponents for which a literal can be exactly halfway between two
+  // floats.
+  static constexpr int kMinRoundToEvenExp = -17;
+  static constexpr int kMaxRoundToEvenExp = 10;
 
   static float Strto(const char* s, char** endptr) { return strtof(s, endptr); }
 };
@@ -53,6 +62,10 @@ struct FloatTraitsBase<double> {
   static constexpr int kSigBits = 52;
   static constexpr float kHugeVal = HUGE_VAL;
   static constexpr int kMaxHexBufferSize = WABT_MAX_DOUBLE_HEX;
+  static constexpr int kMinDecimalExp = -342;
+  static constexpr int kMaxDecimalExp = 308;
+  static constexpr int kMinRoundToEvenExp = -4;
+  static constexpr int kMaxRoundToEvenExp = 23;
 
   static double Strto(const char* s, char** endptr) {
     return strtod(s, endptr);
@@ -77,6 +90,158 @@ struct FloatTraits : FloatTraitsBase<T> {
   static constexpr Uint kQuietNanTag = Uint(1) << (kSigBits - 1);
 };
 
+struct Uint128 {
+  uint64_t high;
+  uint64_t low;
+};
+
+Uint128 FullMultiply(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  __extension__ typedef unsigned __int128 uint128_t;
+  uint128_t product = static_cast<uint128_t>(a) * b;
+  return {static_cast<uint64_t>(product >> 64), static_cast<uint64_t>(product)};
+#else
+  uint64_t a_lo = a & 0xffffffff;
+  uint64_t a_hi = a >> 32;
+  uint64_t b_lo = b & 0xffffffff;
+  uint64_t b_hi = b >> 32;
+  uint64_t lo_lo = a_lo * b_lo;
+  uint64_t hi_lo = a_hi * b_lo;
+  uint64_t lo_hi = a_lo * b_hi;
+  uint64_t hi_hi = a_hi * b_hi;
+  uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+  return {hi_hi + (hi_lo >> 32) + (cross >> 32),
+          (cross << 32) | (lo_lo & 0xffffffff)};
+#endif
+}
+
+// The 128 most significant bits of 5^q, for every decimal exponent q that
+// can produce a finite, non-zero double. This is the table used by the
+// Eisel-Lemire algorithm (see Daniel Lemire, "Number Parsing at a Gigabyte
+// per Second"). Rather than embedding ~10KiB of constants, the table is
+// computed once, on first use, with a tiny bignum implementation.
+class PowersOfFive {
+ public:
+  static constexpr int kMinExp = -342;
+  static constexpr int kMaxExp = 308;
+
+  static const PowersOfFive& Get() {
+    static const PowersOfFive s_powers;
+    return s_powers;
+  }
+
+  const Uint128& operator[](int64_t q) const {
+    assert(q >= kMinExp && q <= kMaxExp);
+    return table_[q - kMinExp];
+  }
+
+ private:
+  // Little-endian arbitrary-precision unsigned integer.
+  typedef std::vector<uint32_t> BigUint;
+
+  PowersOfFive();
+
+  static int BitLength(const BigUint&);
+  static Uint128 Top128Bits(const BigUint&);
+  static void MulSmall(BigUint*, uint32_t);
+  static void DivSmall(BigUint*, uint32_t);
+  static void AddOne(BigUint*);
+
+  Uint128 table_[kMaxExp - kMinExp + 1];
+};
+
+PowersOfFive::PowersOfFive() {
+  // Non-negative exponents: 5^q, truncated.
+  BigUint power = {1};
+  for (int q = 0; q <= kMaxExp; ++q) {
+    table_[q - kMinExp] = Top128Bits(power);
+    MulSmall(&power, 5);
+  }
+
+  // Negative exponents: 2^b / 5^-q, rounded up and then truncated. b is
+  // chosen so the quotient has enough precision (at least 128 bits).
+  const uint32_t kMaxSmallPowerOfFive = 13;  // 5^13 fits in a uint32_t.
+  const uint32_t kSmallPowerOfFive = 1220703125;
+  power = {1};
+  for (int q = -1; q >= kMinExp; --q) {
+    MulSmall(&power, 5);
+    const int k = -q;
+    const int z = BitLength(power);
+    const int b = k <= 27 ? z + 127 : 2 * z + 128;
+    BigUint quotient(b / 32 + 1, 0);
+    quotient.back() = uint32_t(1) << (b % 32);
+    int remaining = k;
+    for (; remaining >= int(kMaxSmallPowerOfFive);
+         remaining -= kMaxSmallPowerOfFive) {
+      DivSmall(&quotient, kSmallPowerOfFive);
+    }
+    uint32_t divisor = 1;
+    for (; remaining > 0; --remaining) {
+      divisor *= 5;
+    }
+    DivSmall(&quotient, divisor);
+    AddOne(&quotient);
+    table_[q - kMinExp] = Top128Bits(quotient);
+  }
+}
+
+// static
+int PowersOfFive::BitLength(const BigUint& x) {
+  assert(!x.empty() && x.back() != 0);
+  return static_cast<int>(x.size()) * 32 - Clz(x.back());
+}
+
+// static
+Uint128 PowersOfFive::Top128Bits(const BigUint& x) {
+  // Values with fewer than 128 bits are shifted up.
+  const int length = BitLength(x);
+  Uint128 result = {0, 0};
+  for (int bit = length - 1; bit >= length - 128; --bit) {
+    result.high = (result.high << 1) | (result.low >> 63);
+    result.low <<= 1;
+    if (bit >= 0) {
+      result.low |= (x[bit / 32] >> (bit % 32)) & 1;
+    }
+  }
+  return result;
+}
+
+// static
+void PowersOfFive::MulSmall(BigUint* x, uint32_t factor) {
+  uint64_t carry = 0;
+  for (uint32_t& word : *x) {
+    uint64_t product = uint64_t(word) * factor + carry;
+    word = static_cast<uint32_t>(product);
+    carry = product >> 32;
+  }
+  if (carry) {
+    x->push_back(static_cast<uint32_t>(carry));
+  }
+}
+
+// static
+void PowersOfFive::DivSmall(BigUint* x, uint32_t divisor) {
+  uint64_t remainder = 0;
+  for (size_t i = x->size(); i > 0; --i) {
+    uint64_t dividend = (remainder << 32) | (*x)[i - 1];
+    (*x)[i - 1] = static_cast<uint32_t>(dividend / divisor);
+    remainder = dividend % divisor;
+  }
+  while (x->size() > 1 && x->back() == 0) {
+    x->pop_back();
+  }
+}
+
+// static
+void PowersOfFive::AddOne(BigUint* x) {
+  for (uint32_t& word : *x) {
+    if (++word != 0) {
+      return;
+    }
+  }
+  x->push_back(1);
+}
+
 template <typename T>
 class FloatParser {
  public:
@@ -98,6 +263,8 @@ class FloatParser {
                                      int shift,
                                      bool seen_trailing_non_zero);
 
+  static bool MakeFromDecimal(uint64_t significand, int64_t exp, Uint* out_bits);
+  static bool ParseDecimal(const char* s, const char* end, Uint* out_bits);
   static Result ParseFloat(const char* s, const char* end, Uint* out_bits);
   static Result ParseNan(const char* s, const char* end, Uint* out_bits);
   static Result ParseHex(const char* s, const char* end, Uint* out_bits);
@@ -130,11 +297,203 @@ bool FloatParser<T>::StringStartsWith(const char* start,
   return *prefix == 0;
 }
 
+// Compute the float nearest to |significand| * 10^|exp|, using the
+// Eisel-Lemire algorithm. Returns false if the value overflows.
+// static
+template <typename T>
+bool FloatParser<T>::MakeFromDecimal(uint64_t significand,
+                                     int64_t exp,
+                                     Uint* out_bits) {
+  if (significand == 0 || exp < Traits::kMinDecimalExp) {
+    *out_bits = 0;
+    return true;
+  }
+  if (exp > Traits::kMaxDecimalExp) {
+    return false;
+  }
+
+  // Normalize the significand, and multiply it by the truncated power of
+  // five. The low half of the power of five is only needed when the bits
+  // below the result's precision (+ 1 rounding bit) are all ones.
+  const int leading_zeroes = Clz(significand);
+  significand <<= leading_zeroes;
+  const Uint128& power = PowersOfFive::Get()[exp];
+  Uint128 product = FullMultiply(significand, power.high);
+  constexpr uint64_t kPrecisionMask = UINT64_MAX >> (Traits::kSigBits + 3);
+  if ((product.high & kPrecisionMask) == kPrecisionMask) {
+    Uint128 low_product = FullMultiply(significand, power.low);
+    product.low += low_product.high;
+    if (low_product.high > product.low) {
+      product.high++;
+    }
+  }
+
+  const int upper_bit = static_cast<int>(product.high >> 63);
+  const int shift = upper_bit + 64 - Traits::kSigBits - 3;
+  uint64_t sig = product.high >> shift;
+  // floor(exp * log2(10)) + 63, biased.
+  int64_t biased_exp = (((152170 + 65536) * exp) >> 16) + 63 + upper_bit -
+                       leading_zeroes - Traits::kMinExp;
+
+  if (biased_exp <= 0) {
+    // Subnormal, or rounds to zero.
+    if (-biased_exp + 1 >= 64) {
+      *out_bits = 0;
+      return true;
+    }
+    sig >>= -biased_exp + 1;
+    sig += sig & 1;
+    sig >>= 1;
+    // Rounding may have produced the smallest normal value.
+    biased_exp = sig < (uint64_t(1) << Traits::kSigBits) ? 0 : 1;
+    *out_bits = (Uint(biased_exp) << Traits::kSigBits) |
+                (Uint(sig) & Traits::kSigMask);
+    return true;
+  }
+
+  // If the product was exact and we're halfway between two values, the
+  // round-up below must instead round to even.
+  if (product.low <= 1 && exp >= Traits::kMinRoundToEvenExp &&
+      exp <= Traits::kMaxRoundToEvenExp && (sig & 3) == 1 &&
+      (sig << shift) == product.high) {
+    sig &= ~uint64_t(1);
+  }
+
+  sig += sig & 1;
+  sig >>= 1;
+  if (sig >= (uint64_t(2) << Traits::kSigBits)) {
+    sig = uint64_t(1) << Traits::kSigBits;
+    biased_exp++;
+  }
+
+  if (biased_exp >= Traits::kExpMask) {
+    return false;
+  }
+
+  *out_bits = (Uint(biased_exp) << Traits::kSigBits) |
+              (Uint(sig) & Traits::kSigMask);
+  return true;
+}
+
+// Fast path for decimal floats. The literal is parsed directly from the token
+// text (including underscores), without copying it and without depending on
+// the current locale. Returns false if the fast path can't produce a result;
+// in that case the literal must be parsed with strto{f,d}.
+// static
+template <typename T>
+bool FloatParser<T>::ParseDecimal(const char* s,
+                                  const char* end,
+                                  Uint* out_bits) {
+  bool is_neg = false;
+  if (s < end && (*s == '-' || *s == '+')) {
+    is_neg = *s == '-';
+    s++;
+  }
+
+  // Only the first 19 significant digits fit in a uint64_t. The remaining
+  // digits are dropped, but tracked in |truncated|.
+  const int kMaxDigits = 19;
+  uint64_t significand = 0;
+  int num_digits = 0;
+  int64_t exp = 0;
+  bool seen_digit = false;
+  bool seen_dot = false;
+  bool truncated = false;
+  for (; s < end; ++s) {
+    if (*s == '_') {
+      continue;
+    } else if (*s == '.') {
+      seen_dot = true;
+      continue;
+    }
+
+    uint32_t digit = *s - '0';
+    if (digit > 9) {
+      break;
+    }
+    seen_digit = true;
+    if (significand == 0 && digit == 0) {
+      // Leading zero.
+      exp -= seen_dot;
+    } else if (num_digits < kMaxDigits) {
+      significand = significand * 10 + digit;
+      num_digits++;
+      exp -= seen_dot;
+    } else {
+      truncated |= digit != 0;
+      exp += !seen_dot;
+    }
+  }
+
+  if (!seen_digit) {
+    return false;
+  }
+
+  if (s < end) {
+    if (*s != 'e' && *s != 'E') {
+      // e.g. a hex integer.
+      return false;
+    }
+    s++;
+    bool exp_is_neg = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+      exp_is_neg = *s == '-';
+      s++;
+    }
+
+    // Saturate the exponent; anything this large overflows or rounds to zero
+    // anyway.
+    const int64_t kMaxExponent = 100000;
+    int64_t exponent = 0;
+    bool seen_exp_digit = false;
+    for (; s < end; ++s) {
+      if (*s == '_') {
+        continue;
+      }
+      uint32_t digit = *s - '0';
+      if (digit > 9) {
+        return false;
+      }
+      seen_exp_digit = true;
+      if (exponent < kMaxExponent) {
+        exponent = exponent * 10 + digit;
+      }
+    }
+
+    if (!seen_exp_digit) {
+      return false;
+    }
+    exp += exp_is_neg ? -exponent : exponent;
+  }
+
+  Uint bits;
+  if (!MakeFromDecimal(significand, exp, &bits)) {
+    return false;
+  }
+
+  if (truncated) {
+    // The exact value lies between significand and significand + 1; if both
+    // round to the same float, it's the correct result.
+    Uint upper_bits;
+    if (!MakeFromDecimal(significand + 1, exp, &upper_bits) ||
+        upper_bits != bits) {
+      return false;
+    }
+  }
+
+  *out_bits = (Uint(is_neg) << Traits::kSignShift) | bits;
+  return true;
+}
+
 // static
 template <typename T>
 Result FloatParser<T>::ParseFloat(const char* s,
                                   const char* end,
                                   Uint* out_bits) {
+  if (ParseDecimal(s, end, out_bits)) {
+    return Result::Ok;
+  }
+
   // Here is the normal behavior for strtof/strtod:
   //
   // input     | errno  |   output   |
@@ -342,8 +342,11 @@ bool Opcode::IsEnabled(const Features& features) const {
     case Opcode::InterpAlloca:
     case Opcode::InterpBrUnless:
     case Opcode::InterpCallImport:
+    case Opcode::InterpCompile:
     case Opcode::InterpData:
     case Opcode::InterpDropKeep:
+    case Opcode::InterpFuel:
+    case Opcode::InterpLoopFuel:
       return false;
 
     default:
@@ -34,6 +34,7 @@ class NameResolver : public ExprVisitor::DelegateNop {
 
   Result VisitModule(Module* module);
   Result VisitScript(Script* script);
+  Result VisitScriptCommand(Command* command);
 
   // Implementation of ExprVisitor::DelegateNop.
   Result BeginBlockExpr(BlockExpr*) override;
@@ -620,6 +621,11 @@ Result NameResolver::VisitScript(Script* script) {
   return result_;
 }
 
+Result NameResolver::VisitScriptCommand(Command* command) {
+  VisitCommand(command);
+  return result_;
+}
+
 Result ResolveNamesModule(Module* module, Errors* errors) {
   NameResolver resolver(nullptr, errors);
   return resolver.VisitModule(module);
@@ -630,4 +636,9 @@ Result ResolveNamesScript(Script* script, Errors* errors) {
   return resolver.VisitScript(script);
 }
 
+Result ResolveNamesCommand(Script* script, Command* command, Errors* errors) {
+  NameResolver resolver(script, errors);
+  return resolver.VisitScriptCommand(command);
+}
+
 }  // namespace wabt
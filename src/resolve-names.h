@@ -22,11 +22,14 @@
 
 namespace wabt {
 
+class Command;
 struct Module;
 struct Script;
 
 Result ResolveNamesModule(Module*, Errors*);
 Result ResolveNamesScript(Script*, Errors*);
+// Resolve the names of a single command of |script|, see ParseWastScript.
+Result ResolveNamesCommand(Script*, Command*, Errors*);
 
 }  // namespace wabt
 
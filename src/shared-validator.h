@@ -48,6 +48,7 @@ class SharedValidator {
   // TODO: Move into SharedValidator?
   using Label = TypeChecker::Label;
   size_t type_stack_size() const { return typechecker_.type_stack_size(); }
+  const TypeVector& type_stack() const { return typechecker_.type_stack(); }
   Result GetLabel(Index depth, Label** out_label) {
     return typechecker_.GetLabel(depth, out_label);
   }
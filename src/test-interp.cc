@@ -20,6 +20,8 @@
 #include "src/error-formatter.h"
 
 #include "src/interp/binary-reader-interp.h"
+#include "src/interp/interp-module-cache.h"
+#include "src/interp/interp-profiler.h"
 #include "src/interp/interp.h"
 
 using namespace wabt;
@@ -36,6 +38,16 @@ class InterpTest : public ::testing::Test {
         << FormatErrorsToString(errors, Location::Type::Binary);
   }
 
+  void ReadModule(const std::vector<u8>& data, const FuelCosts& fuel_costs) {
+    Errors errors;
+    ReadBinaryOptions options;
+    Result result =
+        ReadBinaryInterp("<internal>", data.data(), data.size(), options,
+                         fuel_costs, &errors, &module_desc_);
+    ASSERT_EQ(Result::Ok, result)
+        << FormatErrorsToString(errors, Location::Type::Binary);
+  }
+
   void Instantiate(const RefVec& imports = RefVec{}) {
     mod_ = Module::New(store_, module_desc_);
     RefPtr<Trap> trap;
@@ -139,29 +151,89 @@ TEST_F(InterpTest, Disassemble) {
   auto buf = stream.ReleaseOutputBuffer();
 
   ExpectBufferStrEq(*buf,
-R"(   0| alloca 1
-   8| i32.const 1
+R"(   0| alloca $1 $2
+  10| i32.const 1
   16| local.set $2, %[-1]
-  24| local.get $1
-  32| local.get $3
-  40| i32.eqz %[-1]
-  44| br_unless @60, %[-1]
-  52| br @116
-  60| local.get $3
-  68| i32.mul %[-2], %[-1]
-  72| local.set $2, %[-1]
-  80| local.get $2
-  88| i32.const 1
-  96| i32.sub %[-2], %[-1]
- 100| local.set $3, %[-1]
- 108| br @24
- 116| drop_keep $2 $1
- 128| return
+  22| local.get $1
+  28| local.get $3
+  34| i32.eqz %[-1]
+  36| br_unless @48, %[-1]
+  42| br @88
+  48| local.get $3
+  54| i32.mul %[-2], %[-1]
+  56| local.set $2, %[-1]
+  62| local.get $2
+  68| i32.const 1
+  74| i32.sub %[-2], %[-1]
+  76| local.set $3, %[-1]
+  82| br @22
+  88| drop_keep $2 $1
+  98| return
+)");
+}
+
+TEST_F(InterpTest, BrTable) {
+  // (func (export "f") (param i32) (result i32)
+  //   (block $a (result i32)
+  //     (i32.const 1)
+  //     (block $b (result i32)
+  //       (i32.const 2)
+  //       (block $c (result i32)
+  //         (i32.const 3)
+  //         (br_table $c $b $a $b $c (local.get 0)))
+  //       (i32.add))
+  //     (i32.add)))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7f, 0x01, 0x7f, 0x03, 0x02, 0x01, 0x00, 0x07, 0x05, 0x01, 0x01,
+      0x66, 0x00, 0x00, 0x0a, 0x1e, 0x01, 0x1c, 0x00, 0x02, 0x7f, 0x41, 0x01,
+      0x02, 0x7f, 0x41, 0x02, 0x02, 0x7f, 0x41, 0x03, 0x20, 0x00, 0x0e, 0x04,
+      0x00, 0x01, 0x02, 0x01, 0x00, 0x0b, 0x6a, 0x0b, 0x6a, 0x0b, 0x0b,
+  });
+
+  MemoryStream stream;
+  module_desc_.istream.Disassemble(&stream);
+  auto buf = stream.ReleaseOutputBuffer();
+
+  // $b and $a drop values, so their entries share a drop_keep after the
+  // table.
+  ExpectBufferStrEq(*buf,
+R"(   0| alloca $0 $4
+  10| i32.const 1
+  16| i32.const 2
+  22| i32.const 3
+  28| local.get $4
+  34| br_table @4, %[-1]
+  40|   @92
+  44|   @60
+  48|   @76
+  52|   @60
+  56|   @92
+  60| drop_keep $1 $1
+  70| br @94
+  76| drop_keep $2 $1
+  86| br @96
+  92| i32.add %[-2], %[-1]
+  94| i32.add %[-2], %[-1]
+  96| drop_keep $1 $1
+ 106| return
 )");
+
+  Instantiate();
+  auto func = GetFuncExport(0);
+  const u32 expected[] = {6, 4, 3, 4, 6, 6};
+  for (u32 i = 0; i < WABT_ARRAY_SIZE(expected); ++i) {
+    Values results;
+    Trap::Ptr trap;
+    Result result = func->Call(store_, {Value::Make(i)}, results, &trap);
+    ASSERT_EQ(Result::Ok, result);
+    EXPECT_EQ(expected[i], results[0].Get<u32>());
+  }
 }
 
 TEST_F(InterpTest, Fac) {
   ReadModule(s_fac_module);
+  EXPECT_FALSE(module_desc_.uses_v128);
   Instantiate();
   auto func = GetFuncExport(0);
 
@@ -174,6 +246,105 @@ TEST_F(InterpTest, Fac) {
   EXPECT_EQ(120u, results[0].Get<u32>());
 }
 
+TEST_F(InterpTest, Fac_CollectThread) {
+  ReadModule(s_fac_module);
+  Instantiate();
+
+  // The thread is only used by Func::Call, not Thread::Call, and must still
+  // be safe to mark.
+  Thread thread(store_);
+  Values results;
+  Trap::Ptr trap;
+  Result result =
+      GetFuncExport(0)->Call(thread, {Value::Make(5)}, results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+  store_.Collect();
+  EXPECT_EQ(120u, results[0].Get<u32>());
+}
+
+TEST_F(InterpTest, V128Locals) {
+  // (func $id (param v128) (result v128) (local v128 i64)
+  //   i64.const -1
+  //   local.set 2
+  //   local.get 0
+  //   local.set 1
+  //   local.get 1)
+  // (func (export "f") (param v128) (result v128)
+  //   local.get 0
+  //   call $id)
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x06, 0x01, 0x60,
+      0x01, 0x7b, 0x01, 0x7b, 0x03, 0x03, 0x02, 0x00, 0x00, 0x07, 0x05, 0x01,
+      0x01, 0x66, 0x00, 0x01, 0x0a, 0x19, 0x02, 0x10, 0x02, 0x01, 0x7b, 0x01,
+      0x7e, 0x42, 0x7f, 0x21, 0x02, 0x20, 0x00, 0x21, 0x01, 0x20, 0x01, 0x0b,
+      0x06, 0x00, 0x20, 0x00, 0x10, 0x00, 0x0b,
+  });
+  EXPECT_TRUE(module_desc_.uses_v128);
+  Instantiate();
+  auto func = GetFuncExport(0);
+
+  v128 value = {0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210};
+  Values results;
+  Trap::Ptr trap;
+  Result result = func->Call(store_, {Value::Make(value)}, results, &trap);
+
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_EQ(1u, results.size());
+  EXPECT_EQ(value, results[0].Get<v128>());
+}
+
+TEST_F(InterpTest, Fac_Lazy) {
+  Errors errors;
+  ReadBinaryOptions options;
+  ASSERT_EQ(Result::Ok,
+            ReadBinaryInterpLazy("<internal>", s_fac_module.data(),
+                                 s_fac_module.size(), options,
+                                 LazyValidation::Eager, nullptr, &errors,
+                                 &module_desc_));
+  Instantiate();
+  auto func = GetFuncExport(0);
+
+  // The first call compiles the function, the second runs the compiled code.
+  for (int i = 0; i < 2; ++i) {
+    Values results;
+    Trap::Ptr trap;
+    Result result = func->Call(store_, {Value::Make(5)}, results, &trap);
+    ASSERT_EQ(Result::Ok, result);
+    EXPECT_EQ(120u, results[0].Get<u32>());
+  }
+}
+
+TEST_F(InterpTest, LazyValidation) {
+  // (func (export "f") (result i32) i64.const 0)
+  std::vector<u8> data = {
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05, 0x01, 0x60,
+      0x00, 0x01, 0x7f, 0x03, 0x02, 0x01, 0x00, 0x07, 0x05, 0x01, 0x01, 0x66,
+      0x00, 0x00, 0x0a, 0x06, 0x01, 0x04, 0x00, 0x42, 0x00, 0x0b,
+  };
+  Errors errors;
+  ReadBinaryOptions options;
+  EXPECT_EQ(Result::Error,
+            ReadBinaryInterpLazy("<internal>", data.data(), data.size(),
+                                 options, LazyValidation::Eager, nullptr,
+                                 &errors, &module_desc_));
+  EXPECT_FALSE(errors.empty());
+
+  errors.clear();
+  module_desc_ = ModuleDesc();
+  ASSERT_EQ(Result::Ok,
+            ReadBinaryInterpLazy("<internal>", data.data(), data.size(),
+                                 options, LazyValidation::Lazy, nullptr,
+                                 &errors, &module_desc_));
+  Instantiate();
+
+  Values results;
+  Trap::Ptr trap;
+  EXPECT_EQ(Result::Error, GetFuncExport(0)->Call(store_, {}, results, &trap));
+  ASSERT_TRUE(trap);
+  EXPECT_EQ("type mismatch in implicit return, expected [i32] but got [i64]",
+            trap->message());
+}
+
 TEST_F(InterpTest, Fac_Trace) {
   ReadModule(s_fac_module);
   Instantiate();
@@ -187,40 +358,40 @@ TEST_F(InterpTest, Fac_Trace) {
 
   auto buf = stream.ReleaseOutputBuffer();
   ExpectBufferStrEq(*buf,
-R"(#0.    0: V:1  | alloca 1
-#0.    8: V:2  | i32.const 1
+R"(#0.    0: V:1  | alloca $1 $2
+#0.   10: V:2  | i32.const 1
 #0.   16: V:3  | local.set $2, 1
-#0.   24: V:2  | local.get $1
-#0.   32: V:3  | local.get $3
-#0.   40: V:4  | i32.eqz 2
-#0.   44: V:4  | br_unless @60, 0
-#0.   60: V:3  | local.get $3
-#0.   68: V:4  | i32.mul 1, 2
-#0.   72: V:3  | local.set $2, 2
-#0.   80: V:2  | local.get $2
-#0.   88: V:3  | i32.const 1
-#0.   96: V:4  | i32.sub 2, 1
-#0.  100: V:3  | local.set $3, 1
-#0.  108: V:2  | br @24
-#0.   24: V:2  | local.get $1
-#0.   32: V:3  | local.get $3
-#0.   40: V:4  | i32.eqz 1
-#0.   44: V:4  | br_unless @60, 0
-#0.   60: V:3  | local.get $3
-#0.   68: V:4  | i32.mul 2, 1
-#0.   72: V:3  | local.set $2, 2
-#0.   80: V:2  | local.get $2
-#0.   88: V:3  | i32.const 1
-#0.   96: V:4  | i32.sub 1, 1
-#0.  100: V:3  | local.set $3, 0
-#0.  108: V:2  | br @24
-#0.   24: V:2  | local.get $1
-#0.   32: V:3  | local.get $3
-#0.   40: V:4  | i32.eqz 0
-#0.   44: V:4  | br_unless @60, 1
-#0.   52: V:3  | br @116
-#0.  116: V:3  | drop_keep $2 $1
-#0.  128: V:1  | return
+#0.   22: V:2  | local.get $1
+#0.   28: V:3  | local.get $3
+#0.   34: V:4  | i32.eqz 2
+#0.   36: V:4  | br_unless @48, 0
+#0.   48: V:3  | local.get $3
+#0.   54: V:4  | i32.mul 1, 2
+#0.   56: V:3  | local.set $2, 2
+#0.   62: V:2  | local.get $2
+#0.   68: V:3  | i32.const 1
+#0.   74: V:4  | i32.sub 2, 1
+#0.   76: V:3  | local.set $3, 1
+#0.   82: V:2  | br @22
+#0.   22: V:2  | local.get $1
+#0.   28: V:3  | local.get $3
+#0.   34: V:4  | i32.eqz 1
+#0.   36: V:4  | br_unless @48, 0
+#0.   48: V:3  | local.get $3
+#0.   54: V:4  | i32.mul 2, 1
+#0.   56: V:3  | local.set $2, 2
+#0.   62: V:2  | local.get $2
+#0.   68: V:3  | i32.const 1
+#0.   74: V:4  | i32.sub 1, 1
+#0.   76: V:3  | local.set $3, 0
+#0.   82: V:2  | br @22
+#0.   22: V:2  | local.get $1
+#0.   28: V:3  | local.get $3
+#0.   34: V:4  | i32.eqz 0
+#0.   36: V:4  | br_unless @48, 1
+#0.   42: V:3  | br @88
+#0.   88: V:3  | drop_keep $2 $1
+#0.   98: V:1  | return
 )");
 }
 
@@ -251,17 +422,17 @@ TEST_F(InterpTest, Local_Trace) {
 
   auto buf = stream.ReleaseOutputBuffer();
   ExpectBufferStrEq(*buf,
-R"(#0.    0: V:0  | alloca 4
-#0.    8: V:4  | i32.const 0
+R"(#0.    0: V:0  | alloca $4 $1
+#0.   10: V:4  | i32.const 0
 #0.   16: V:5  | local.set $5, 0
-#0.   24: V:4  | i64.const 1
-#0.   36: V:5  | local.set $4, 1
-#0.   44: V:4  | f32.const 2
-#0.   52: V:5  | local.set $3, 2
-#0.   60: V:4  | f64.const 3
-#0.   72: V:5  | local.set $2, 3
-#0.   80: V:4  | drop_keep $4 $0
-#0.   92: V:0  | return
+#0.   22: V:4  | i64.const 1
+#0.   32: V:5  | local.set $4, 1
+#0.   38: V:4  | f32.const 2
+#0.   44: V:5  | local.set $3, 2
+#0.   50: V:4  | f64.const 3
+#0.   60: V:5  | local.set $2, 3
+#0.   66: V:4  | drop_keep $4 $0
+#0.   76: V:0  | return
 )");
 }
 
@@ -296,6 +467,509 @@ TEST_F(InterpTest, HostFunc) {
   EXPECT_EQ(2u, results[0].Get<u32>());
 }
 
+TEST_F(InterpTest, HostFunc_Fast) {
+  // (import "" "f" (func $f (param i32) (result i32)))
+  // (func (export "g") (result i32)
+  //   (call $f (i32.const 1)))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a,
+      0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f,
+      0x02, 0x06, 0x01, 0x00, 0x01, 0x66, 0x00, 0x00, 0x03, 0x02,
+      0x01, 0x01, 0x07, 0x05, 0x01, 0x01, 0x67, 0x00, 0x01, 0x0a,
+      0x08, 0x01, 0x06, 0x00, 0x41, 0x01, 0x10, 0x00, 0x0b,
+  });
+
+  u32 addend = 10;
+  auto host_func = HostFunc::New(
+      store_, FuncType{{ValueType::I32}, {ValueType::I32}},
+      [](Thread& thread, const HostFunc& func, Span<const Value> params,
+         Span<Value> results, Trap::Ptr* out_trap) -> Result {
+        u32 addend = *static_cast<u32*>(func.user_data());
+        results[0] = Value::Make(params[0].Get<u32>() + addend);
+        return Result::Ok;
+      },
+      &addend);
+
+  Instantiate({host_func->self()});
+
+  Values results;
+  Trap::Ptr trap;
+  Result result = GetFuncExport(0)->Call(store_, {}, results, &trap);
+
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_EQ(1u, results.size());
+  EXPECT_EQ(11u, results[0].Get<u32>());
+
+  // Calling it directly goes through the Values interface, with results
+  // that have not been sized yet.
+  Values direct_results;
+  result =
+      host_func->Call(store_, {Value::Make(u32{5})}, direct_results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_EQ(1u, direct_results.size());
+  EXPECT_EQ(15u, direct_results[0].Get<u32>());
+}
+
+static u32 AddOne(u32 x) {
+  return x + 1;
+}
+
+TEST_F(InterpTest, HostFunc_Typed) {
+  // (import "" "f" (func $f (param i32) (result i32)))
+  // (func (export "g") (result i32)
+  //   (call $f (i32.const 1)))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a,
+      0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f,
+      0x02, 0x06, 0x01, 0x00, 0x01, 0x66, 0x00, 0x00, 0x03, 0x02,
+      0x01, 0x01, 0x07, 0x05, 0x01, 0x01, 0x67, 0x00, 0x01, 0x0a,
+      0x08, 0x01, 0x06, 0x00, 0x41, 0x01, 0x10, 0x00, 0x0b,
+  });
+
+  auto host_func = HostFunc::New<u32(u32)>(store_, AddOne);
+  EXPECT_EQ(ValueTypes{ValueType::I32}, host_func->type().params);
+  EXPECT_EQ(ValueTypes{ValueType::I32}, host_func->type().results);
+
+  Instantiate({host_func->self()});
+
+  Values results;
+  Trap::Ptr trap;
+  Result result = GetFuncExport(0)->Call(store_, {}, results, &trap);
+
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_EQ(1u, results.size());
+  EXPECT_EQ(2u, results[0].Get<u32>());
+}
+
+TEST_F(InterpTest, HostFunc_Suspend) {
+  // (import "" "f" (func $f (param i32) (result i32)))
+  // (func (export "g") (result i32)
+  //   (call $f (i32.const 1)))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a,
+      0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f,
+      0x02, 0x06, 0x01, 0x00, 0x01, 0x66, 0x00, 0x00, 0x03, 0x02,
+      0x01, 0x01, 0x07, 0x05, 0x01, 0x01, 0x67, 0x00, 0x01, 0x0a,
+      0x08, 0x01, 0x06, 0x00, 0x41, 0x01, 0x10, 0x00, 0x0b,
+  });
+
+  u32 param = 0;
+  auto host_func = HostFunc::New(
+      store_, FuncType{{ValueType::I32}, {ValueType::I32}},
+      [](Thread& thread, const HostFunc& func, Span<const Value> params,
+         Span<Value> results, Trap::Ptr* out_trap) -> Result {
+        *static_cast<u32*>(func.user_data()) = params[0].Get<u32>();
+        thread.Suspend();
+        return Result::Ok;
+      },
+      &param);
+
+  Instantiate({host_func->self()});
+
+  Thread thread(store_);
+  Values results;
+  Trap::Ptr trap;
+  RunResult result = thread.Call(GetFuncExport(0).get(), {}, results, &trap);
+  ASSERT_EQ(RunResult::Suspended, result);
+  EXPECT_TRUE(thread.suspended());
+  EXPECT_EQ(1u, param);
+
+  result = thread.Resume({Value::Make(u32{42})}, results, &trap);
+  ASSERT_EQ(RunResult::Return, result);
+  EXPECT_FALSE(thread.suspended());
+  EXPECT_EQ(1u, results.size());
+  EXPECT_EQ(42u, results[0].Get<u32>());
+
+  // Calling the host function itself suspends too. The previous call left
+  // the thread's instance set, which must not make Resume run wasm code.
+  result = thread.Call(host_func.get(), {Value::Make(u32{2})}, results, &trap);
+  ASSERT_EQ(RunResult::Suspended, result);
+  EXPECT_EQ(2u, param);
+  result = thread.Resume({Value::Make(u32{7})}, results, &trap);
+  ASSERT_EQ(RunResult::Return, result);
+  EXPECT_EQ(1u, results.size());
+  EXPECT_EQ(7u, results[0].Get<u32>());
+
+  // Func::Call can't return until the call is done, so suspending traps.
+  Result call_result = GetFuncExport(0)->Call(thread, {}, results, &trap);
+  ASSERT_EQ(Result::Error, call_result);
+  ASSERT_TRUE(trap);
+  EXPECT_EQ("can't suspend a nested call", trap->message());
+  EXPECT_FALSE(thread.suspended());
+
+  // The thread can still be used afterward.
+  result = thread.Call(GetFuncExport(0).get(), {}, results, &trap);
+  ASSERT_EQ(RunResult::Suspended, result);
+  result = thread.Resume({Value::Make(u32{3})}, results, &trap);
+  ASSERT_EQ(RunResult::Return, result);
+  EXPECT_EQ(3u, results[0].Get<u32>());
+}
+
+TEST_F(InterpTest, Fuel) {
+  // (func (export "f") (param i32)
+  //   loop
+  //     local.get 0
+  //     i32.const 1
+  //     i32.sub
+  //     local.tee 0
+  //     br_if 0
+  //   end)
+  ReadModule(
+      {
+          0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05,
+          0x01, 0x60, 0x01, 0x7f, 0x00, 0x03, 0x02, 0x01, 0x00, 0x07,
+          0x05, 0x01, 0x01, 0x66, 0x00, 0x00, 0x0a, 0x10, 0x01, 0x0e,
+          0x00, 0x03, 0x40, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00,
+          0x0d, 0x00, 0x0b, 0x0b,
+      },
+      FuelCosts());
+  Instantiate();
+
+  Thread::Options options;
+  options.fuel = 40;
+  Thread thread(store_, options);
+  Values results;
+  Trap::Ptr trap;
+
+  // Each iteration of the loop costs 5, and the fuel left carries over to the
+  // next call.
+  Result result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{3})}, results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_EQ(25u, thread.fuel());
+
+  result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{6})}, results, &trap);
+  ASSERT_EQ(Result::Error, result);
+  ASSERT_TRUE(trap);
+  EXPECT_EQ("out of fuel", trap->message());
+
+  thread.set_fuel(Thread::Options::kUnlimitedFuel);
+  thread.set_epoch_deadline(store_.epoch() + 1);
+  result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{6})}, results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+
+  store_.IncrementEpoch();
+  result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{6})}, results, &trap);
+  ASSERT_EQ(Result::Error, result);
+  ASSERT_TRUE(trap);
+  EXPECT_EQ("interrupted", trap->message());
+}
+
+TEST_F(InterpTest, Profiler) {
+  // (func (export "f") (param i32)
+  //   loop
+  //     local.get 0
+  //     i32.const 1
+  //     i32.sub
+  //     local.tee 0
+  //     br_if 0
+  //   end)
+  ReadModule(
+      {
+          0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x05,
+          0x01, 0x60, 0x01, 0x7f, 0x00, 0x03, 0x02, 0x01, 0x00, 0x07,
+          0x05, 0x01, 0x01, 0x66, 0x00, 0x00, 0x0a, 0x10, 0x01, 0x0e,
+          0x00, 0x03, 0x40, 0x20, 0x00, 0x41, 0x01, 0x6b, 0x22, 0x00,
+          0x0d, 0x00, 0x0b, 0x0b,
+      },
+      FuelCosts());
+  Instantiate();
+
+  Profiler profiler(store_);
+  Thread::Options options;
+  options.profiler = &profiler;
+  Thread thread(store_, options);
+  Values results;
+  Trap::Ptr trap;
+
+  profiler.RequestSample();
+  Result result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{3})}, results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+
+  MemoryStream stream;
+  profiler.WriteFoldedStacks(&stream);
+  ExpectBufferStrEq(stream.output_buffer(), "f 1\n");
+
+  MemoryStream counts_stream;
+  profiler.WriteCounts(&counts_stream);
+  ExpectBufferStrEq(counts_stream.output_buffer(),
+                    "f: 1\n"
+                    "  @0: 1\n"
+                    "  @20: 3\n"
+                    "  @62: 1\n"
+                    "  @72: 1\n");
+
+  // The counts are kept per function of the module, so another instance adds
+  // to them, even after the first one is collected.
+  inst_ = Instance::Instantiate(store_, mod_.ref(), {}, &trap);
+  ASSERT_TRUE(inst_);
+  store_.Collect();
+  result =
+      GetFuncExport(0)->Call(thread, {Value::Make(u32{1})}, results, &trap);
+  ASSERT_EQ(Result::Ok, result);
+
+  MemoryStream counts_stream2;
+  profiler.WriteCounts(&counts_stream2);
+  ExpectBufferStrEq(counts_stream2.output_buffer(),
+                    "f: 2\n"
+                    "  @0: 2\n"
+                    "  @20: 4\n"
+                    "  @62: 2\n"
+                    "  @72: 2\n");
+}
+
+TEST_F(InterpTest, FuncTypeIds) {
+  // (type (func (param i32) (result i32)))
+  // (type (func (result i32)))
+  // (import "" "f" (func $f (type 0)))
+  // (func (export "g") (type 1)
+  //   (call $f (i32.const 1)))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a,
+      0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x00, 0x01, 0x7f,
+      0x02, 0x06, 0x01, 0x00, 0x01, 0x66, 0x00, 0x00, 0x03, 0x02,
+      0x01, 0x01, 0x07, 0x05, 0x01, 0x01, 0x67, 0x00, 0x01, 0x0a,
+      0x08, 0x01, 0x06, 0x00, 0x41, 0x01, 0x10, 0x00, 0x0b,
+  });
+
+  auto host_func =
+      HostFunc::New(store_, FuncType{{ValueType::I32}, {ValueType::I32}},
+                    [](Thread& thread, const Values& params, Values& results,
+                       Trap::Ptr* out_trap) -> Result { return Result::Ok; });
+  auto other_func = HostFunc::New(store_, FuncType{{}, {ValueType::I64}},
+                                  [](Thread& thread, const Values& params,
+                                     Values& results, Trap::Ptr* out_trap)
+                                      -> Result { return Result::Ok; });
+
+  Instantiate({host_func->self()});
+
+  EXPECT_EQ(host_func->type_id(), mod_->func_type_id(0));
+  EXPECT_EQ(GetFuncExport(0)->type_id(), mod_->func_type_id(1));
+  EXPECT_NE(mod_->func_type_id(0), mod_->func_type_id(1));
+  EXPECT_NE(other_func->type_id(), mod_->func_type_id(0));
+  EXPECT_NE(other_func->type_id(), mod_->func_type_id(1));
+}
+
+TEST_F(InterpTest, CallIndirectCache) {
+  // (type $t (func (result i32)))
+  // (table 2 funcref)
+  // (elem (i32.const 0) $a $b)
+  // (func $a (type $t) i32.const 1)
+  // (func $b (type $t) i32.const 2)
+  // (func (export "call") (param i32) (result i32)
+  //   local.get 0
+  //   call_indirect (type $t))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x02, 0x60,
+      0x00, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x03, 0x04, 0x03, 0x00,
+      0x00, 0x01, 0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x07, 0x08, 0x01, 0x04,
+      0x63, 0x61, 0x6c, 0x6c, 0x00, 0x02, 0x09, 0x08, 0x01, 0x00, 0x41, 0x00,
+      0x0b, 0x02, 0x00, 0x01, 0x0a, 0x13, 0x03, 0x04, 0x00, 0x41, 0x01, 0x0b,
+      0x04, 0x00, 0x41, 0x02, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x11, 0x00, 0x00,
+      0x0b,
+  });
+  Instantiate();
+  EXPECT_EQ(1u, module_desc_.num_call_indirect_sites);
+
+  auto call = [&](u32 entry, Trap::Ptr* trap) -> u32 {
+    Values results;
+    Result result =
+        GetFuncExport(0)->Call(store_, {Value::Make(entry)}, results, trap);
+    return Succeeded(result) ? results[0].Get<u32>() : 0;
+  };
+
+  Trap::Ptr trap;
+  EXPECT_EQ(1u, call(0, &trap));
+  EXPECT_EQ(1u, call(0, &trap));
+  EXPECT_EQ(2u, call(1, &trap));
+
+  // Changing the table must invalidate the cached target.
+  Table::Ptr table{store_, inst_->tables()[0]};
+  EXPECT_EQ(Result::Ok, table->Set(store_, 0, inst_->funcs()[1]));
+  EXPECT_EQ(2u, call(0, &trap));
+
+  auto other_func = HostFunc::New(store_, FuncType{{}, {ValueType::I64}},
+                                  [](Thread& thread, const Values& params,
+                                     Values& results, Trap::Ptr* out_trap)
+                                      -> Result { return Result::Ok; });
+  EXPECT_EQ(Result::Ok, table->Set(store_, 0, other_func->self()));
+  EXPECT_EQ(0u, call(0, &trap));
+  ASSERT_TRUE(trap);
+  EXPECT_EQ("indirect call signature mismatch", trap->message());
+}
+
+TEST_F(InterpTest, Clone) {
+  // (type $t (func (result i32)))
+  // (global $g (mut i32) (i32.const 0))
+  // (memory (export "mem") 1)
+  // (data (i32.const 0) "\01")
+  // (table 1 funcref)
+  // (elem (i32.const 0) $get)
+  // (func $get (type $t) global.get $g)
+  // (func $start
+  //   (global.set $g (i32.add (global.get $g) (i32.const 1))))
+  // (func (export "inc")
+  //   (global.set $g (i32.add (global.get $g) (i32.const 10))))
+  // (func (export "call") (result i32)
+  //   (call_indirect (type $t) (i32.const 0)))
+  // (start $start)
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x02, 0x60,
+      0x00, 0x01, 0x7f, 0x60, 0x00, 0x00, 0x03, 0x05, 0x04, 0x00, 0x01, 0x01,
+      0x00, 0x04, 0x04, 0x01, 0x70, 0x00, 0x01, 0x05, 0x03, 0x01, 0x00, 0x01,
+      0x06, 0x06, 0x01, 0x7f, 0x01, 0x41, 0x00, 0x0b, 0x07, 0x14, 0x03, 0x03,
+      0x6d, 0x65, 0x6d, 0x02, 0x00, 0x03, 0x69, 0x6e, 0x63, 0x00, 0x02, 0x04,
+      0x63, 0x61, 0x6c, 0x6c, 0x00, 0x03, 0x08, 0x01, 0x01, 0x09, 0x07, 0x01,
+      0x00, 0x41, 0x00, 0x0b, 0x01, 0x00, 0x0a, 0x22, 0x04, 0x04, 0x00, 0x23,
+      0x00, 0x0b, 0x09, 0x00, 0x23, 0x00, 0x41, 0x01, 0x6a, 0x24, 0x00, 0x0b,
+      0x09, 0x00, 0x23, 0x00, 0x41, 0x0a, 0x6a, 0x24, 0x00, 0x0b, 0x07, 0x00,
+      0x41, 0x00, 0x11, 0x00, 0x00, 0x0b, 0x0b, 0x07, 0x01, 0x00, 0x41, 0x00,
+      0x0b, 0x01, 0x01,
+  });
+  Instantiate();
+
+  auto call = [&](const Instance::Ptr& inst, Index export_index) {
+    Values results;
+    Trap::Ptr trap;
+    auto func = store_.UnsafeGet<DefinedFunc>(inst->exports()[export_index]);
+    EXPECT_EQ(Result::Ok, func->Call(store_, {}, results, &trap));
+    return results.empty() ? 0 : results[0].Get<u32>();
+  };
+  auto memory_byte = [&](const Instance::Ptr& inst) {
+    return store_.UnsafeGet<Memory>(inst->exports()[0])->UnsafeData()[0];
+  };
+
+  Instance::Ptr snapshot = inst_->Clone(store_);
+  EXPECT_NE(inst_->exports()[0], snapshot->exports()[0]);
+  EXPECT_NE(inst_->exports()[2], snapshot->exports()[2]);
+
+  // The original instance can be changed without affecting the snapshot.
+  call(inst_, 1);
+  store_.UnsafeGet<Memory>(inst_->exports()[0])->UnsafeData()[0] = 2;
+  EXPECT_EQ(11u, call(inst_, 2));
+
+  // The start function isn't run again, and the function in the table is the
+  // copy that reads the clone's global.
+  Instance::Ptr clone = snapshot->Clone(store_);
+  EXPECT_EQ(1u, call(clone, 2));
+  EXPECT_EQ(1, memory_byte(clone));
+  call(clone, 1);
+  EXPECT_EQ(11u, call(clone, 2));
+  EXPECT_EQ(1u, call(snapshot, 2));
+  EXPECT_EQ(2, memory_byte(inst_));
+}
+
+TEST_F(InterpTest, Memory_Clone) {
+  auto memory = Memory::New(store_, MemoryType{Limits{2, 4}});
+  memory->UnsafeData()[0] = 1;
+  memory->UnsafeData()[WABT_PAGE_SIZE] = 2;
+
+  // Writes to a clone or to the original aren't seen by the other.
+  auto clone = memory->Clone(store_);
+  EXPECT_EQ(2u, clone->PageSize());
+  EXPECT_EQ(1, clone->UnsafeData()[0]);
+  EXPECT_EQ(2, clone->UnsafeData()[WABT_PAGE_SIZE]);
+  clone->UnsafeData()[0] = 3;
+  EXPECT_EQ(1, memory->UnsafeData()[0]);
+  memory->UnsafeData()[WABT_PAGE_SIZE] = 4;
+  EXPECT_EQ(2, clone->UnsafeData()[WABT_PAGE_SIZE]);
+
+  // A later clone sees the writes made to the original since the last one.
+  auto clone2 = memory->Clone(store_);
+  EXPECT_EQ(1, clone2->UnsafeData()[0]);
+  EXPECT_EQ(4, clone2->UnsafeData()[WABT_PAGE_SIZE]);
+  auto clone3 = memory->Clone(store_);
+  EXPECT_EQ(4, clone3->UnsafeData()[WABT_PAGE_SIZE]);
+
+  // Growing keeps the data, and the new pages are zero.
+  EXPECT_EQ(Result::Ok, clone->Grow(2));
+  EXPECT_EQ(4u, clone->PageSize());
+  EXPECT_EQ(3, clone->UnsafeData()[0]);
+  EXPECT_EQ(2, clone->UnsafeData()[WABT_PAGE_SIZE]);
+  EXPECT_EQ(0, clone->UnsafeData()[3 * WABT_PAGE_SIZE]);
+  EXPECT_EQ(Result::Error, clone->Grow(1));
+
+  // Filling a cloned memory with zero doesn't bring back the cloned data.
+  EXPECT_EQ(Result::Ok, clone2->Fill(0, 0, 2 * WABT_PAGE_SIZE));
+  EXPECT_EQ(0, clone2->UnsafeData()[0]);
+  EXPECT_EQ(0, clone2->UnsafeData()[WABT_PAGE_SIZE]);
+  EXPECT_EQ(1, memory->UnsafeData()[0]);
+  EXPECT_EQ(4, clone3->UnsafeData()[WABT_PAGE_SIZE]);
+}
+
+TEST_F(InterpTest, ModuleDescRoundTrip) {
+  // (type $t (func (result i32)))
+  // (table 2 funcref)
+  // (elem (i32.const 0) $a $b)
+  // (func $a (type $t) i32.const 1)
+  // (func $b (type $t) i32.const 2)
+  // (func (export "call") (param i32) (result i32)
+  //   local.get 0
+  //   call_indirect (type $t))
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x02, 0x60,
+      0x00, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x03, 0x04, 0x03, 0x00,
+      0x00, 0x01, 0x04, 0x04, 0x01, 0x70, 0x00, 0x02, 0x07, 0x08, 0x01, 0x04,
+      0x63, 0x61, 0x6c, 0x6c, 0x00, 0x02, 0x09, 0x08, 0x01, 0x00, 0x41, 0x00,
+      0x0b, 0x02, 0x00, 0x01, 0x0a, 0x13, 0x03, 0x04, 0x00, 0x41, 0x01, 0x0b,
+      0x04, 0x00, 0x41, 0x02, 0x0b, 0x07, 0x00, 0x20, 0x00, 0x11, 0x00, 0x00,
+      0x0b,
+  });
+
+  MemoryStream stream;
+  WriteModuleDesc(&stream, module_desc_);
+  const auto& data = stream.output_buffer().data;
+
+  ModuleDesc module_desc;
+  ASSERT_EQ(Result::Ok,
+            ReadModuleDesc(data.data(), data.size(), &module_desc));
+  EXPECT_EQ(module_desc_.istream.data(), module_desc.istream.data());
+  EXPECT_EQ(module_desc_.num_call_indirect_sites,
+            module_desc.num_call_indirect_sites);
+  ASSERT_EQ(3u, module_desc.funcs.size());
+  EXPECT_EQ(module_desc_.funcs[2].code_offset,
+            module_desc.funcs[2].code_offset);
+  ASSERT_EQ(1u, module_desc.exports.size());
+  EXPECT_EQ("call", module_desc.exports[0].type.name);
+
+  // Truncated data is rejected.
+  ModuleDesc truncated;
+  EXPECT_EQ(Result::Error,
+            ReadModuleDesc(data.data(), data.size() - 1, &truncated));
+
+  // So are offsets and indices that are out of range.
+  auto round_trip = [&]() {
+    MemoryStream bad_stream;
+    WriteModuleDesc(&bad_stream, module_desc_);
+    const auto& bad_data = bad_stream.output_buffer().data;
+    ModuleDesc bad;
+    return ReadModuleDesc(bad_data.data(), bad_data.size(), &bad);
+  };
+  u32 code_offset = module_desc_.funcs[2].code_offset;
+  module_desc_.funcs[2].code_offset = module_desc_.istream.end();
+  EXPECT_EQ(Result::Error, round_trip());
+  module_desc_.funcs[2].code_offset = code_offset;
+  module_desc_.exports[0].index = 3;
+  EXPECT_EQ(Result::Error, round_trip());
+  module_desc_.exports[0].index = 2;
+  module_desc_.elems[0].elements[1].index = 3;
+  EXPECT_EQ(Result::Error, round_trip());
+  module_desc_.elems[0].elements[1].index = 1;
+  EXPECT_EQ(Result::Ok, round_trip());
+
+  module_desc_ = std::move(module_desc);
+  Instantiate();
+  Values results;
+  Trap::Ptr trap;
+  ASSERT_EQ(Result::Ok, GetFuncExport(0)->Call(store_, {Value::Make(u32{1})},
+                                               results, &trap));
+  EXPECT_EQ(2u, results[0].Get<u32>());
+}
+
 TEST_F(InterpTest, HostFunc_PingPong) {
   // (import "" "f" (func $f (param i32) (result i32)))
   // (func (export "g") (param i32) (result i32)
@@ -403,6 +1077,42 @@ TEST_F(InterpTest, HostTrap) {
   ASSERT_EQ("boom", trap->message());
 }
 
+TEST_F(InterpTest, HostTrap_ReuseThread) {
+  // (import "host" "a" (func $0))
+  // (func (export "f") call $0)
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x04, 0x01,
+      0x60, 0x00, 0x00, 0x02, 0x0a, 0x01, 0x04, 0x68, 0x6f, 0x73, 0x74,
+      0x01, 0x61, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0x07, 0x05, 0x01,
+      0x01, 0x66, 0x00, 0x01, 0x0a, 0x06, 0x01, 0x04, 0x00, 0x10, 0x00,
+      0x0b,
+  });
+
+  int calls = 0;
+  auto host_func =
+      HostFunc::New(store_, FuncType{{}, {}},
+                    [&](Thread& thread, const Values& params, Values& results,
+                        Trap::Ptr* out_trap) -> Result {
+                      if (calls++ == 0) {
+                        *out_trap = Trap::New(store_, "boom");
+                        return Result::Error;
+                      }
+                      return Result::Ok;
+                    });
+
+  Instantiate({host_func->self()});
+  auto func = GetFuncExport(0);
+
+  // The thread left behind by the trap is reset before it is reused.
+  Values results;
+  Trap::Ptr trap;
+  ASSERT_EQ(Result::Error, func->Call(store_, {}, results, &trap));
+  ASSERT_EQ("boom", trap->message());
+  ASSERT_EQ(Result::Ok, func->Call(store_, {}, results, &trap));
+  ASSERT_EQ(Result::Ok, func->Call(store_, {}, results, &trap));
+  EXPECT_EQ(3, calls);
+}
+
 TEST_F(InterpTest, Rot13) {
   // (import "host" "mem" (memory $mem 1))
   // (import "host" "fill_buf" (func $fill_buf (param i32 i32) (result i32)))
@@ -550,6 +1260,40 @@ TEST_F(InterpTest, Rot13) {
   ASSERT_EQ("Hello, WebAssembly!", string_data);
 }
 
+TEST_F(InterpTest, Memory_FillAndCopy) {
+  // 64 pages is 4MiB, enough for the large fill paths.
+  auto memory = Memory::New(store_, MemoryType{Limits{64}});
+  const u64 size = 3 << 20;
+  u8 byte;
+
+  ASSERT_EQ(Result::Ok, memory->Fill(1, 0xab, size + 2));
+  // A large zero fill that doesn't start or end on a page boundary.
+  ASSERT_EQ(Result::Ok, memory->Fill(2, 0, size));
+  const u64 offsets[] = {1, 2, 4095, 4096, size / 2, size + 1, size + 2};
+  const u8 expected[] = {0xab, 0, 0, 0, 0, 0, 0xab};
+  for (size_t i = 0; i < WABT_ARRAY_SIZE(offsets); ++i) {
+    ASSERT_EQ(Result::Ok, memory->Load(offsets[i], 0, &byte));
+    EXPECT_EQ(expected[i], byte) << "offset " << offsets[i];
+  }
+
+  // Overlapping copies in both directions.
+  for (u8 i = 0; i < 8; ++i) {
+    ASSERT_EQ(Result::Ok, memory->Store(100 + i, 0, i));
+  }
+  ASSERT_EQ(Result::Ok, Memory::Copy(*memory, 102, *memory, 100, 8));
+  ASSERT_EQ(Result::Ok, memory->Load(109, 0, &byte));
+  EXPECT_EQ(7, byte);
+  ASSERT_EQ(Result::Ok, Memory::Copy(*memory, 101, *memory, 102, 8));
+  ASSERT_EQ(Result::Ok, memory->Load(101, 0, &byte));
+  EXPECT_EQ(0, byte);
+  ASSERT_EQ(Result::Ok, memory->Load(108, 0, &byte));
+  EXPECT_EQ(7, byte);
+
+  EXPECT_EQ(Result::Error, memory->Fill(memory->ByteSize() - 1, 0, 2));
+  EXPECT_EQ(Result::Error,
+            Memory::Copy(*memory, 0, *memory, memory->ByteSize(), 1));
+}
+
 class InterpGCTest : public InterpTest {
  public:
   void SetUp() override { before_new = store_.object_count(); }
@@ -718,6 +1462,52 @@ TEST_F(InterpGCTest, Collect_DeepRecursion) {
   EXPECT_EQ(1u, store_.object_count());
 }
 
-// TODO: Test for Thread keeping references alive as locals/params/stack values.
-// This requires better tracking of references than currently exists in the
-// interpreter. (see TODOs in Select/LocalGet/GlobalGet)
+TEST_F(InterpGCTest, Collect_ThreadStack) {
+  // (import "host" "collect" (func $collect))
+  // (func (export "f") (param externref externref)
+  //                    (result externref externref)
+  //   (local externref)
+  //   local.get 0
+  //   local.set 2
+  //   local.get 1
+  //   ref.null extern
+  //   local.set 0
+  //   ref.null extern
+  //   local.set 1
+  //   call $collect
+  //   local.get 2)
+  ReadModule({
+      0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x01, 0x0b, 0x02, 0x60,
+      0x00, 0x00, 0x60, 0x02, 0x6f, 0x6f, 0x02, 0x6f, 0x6f, 0x02, 0x10, 0x01,
+      0x04, 0x68, 0x6f, 0x73, 0x74, 0x07, 0x63, 0x6f, 0x6c, 0x6c, 0x65, 0x63,
+      0x74, 0x00, 0x00, 0x03, 0x02, 0x01, 0x01, 0x07, 0x05, 0x01, 0x01, 0x66,
+      0x00, 0x01, 0x0a, 0x18, 0x01, 0x16, 0x01, 0x01, 0x6f, 0x20, 0x00, 0x21,
+      0x02, 0x20, 0x01, 0xd0, 0x6f, 0x21, 0x00, 0xd0, 0x6f, 0x21, 0x01, 0x10,
+      0x00, 0x20, 0x02, 0x0b,
+  });
+
+  auto host_func =
+      HostFunc::New(store_, FuncType{{}, {}},
+                    [&](Thread& thread, const Values& params, Values& results,
+                        Trap::Ptr* out_trap) -> Result {
+                      store_.Collect();
+                      return Result::Ok;
+                    });
+  Instantiate({host_func->self()});
+  auto func = GetFuncExport(0);
+
+  // The foreign objects are only kept alive by the thread: one in a local,
+  // the other on the operand stack.
+  Ref local_ref = Foreign::New(store_, nullptr)->self();
+  Ref stack_ref = Foreign::New(store_, nullptr)->self();
+  Values results;
+  Trap::Ptr trap;
+  Result result = func->Call(
+      store_, {Value::Make(local_ref), Value::Make(stack_ref)}, results, &trap);
+
+  ASSERT_EQ(Result::Ok, result);
+  EXPECT_TRUE(store_.IsValid(local_ref));
+  EXPECT_TRUE(store_.IsValid(stack_ref));
+  EXPECT_EQ(stack_ref, results[0].Get<Ref>());
+  EXPECT_EQ(local_ref, results[1].Get<Ref>());
+}
@@ -185,6 +185,36 @@ void AssertHexDoubleFails(const char* s) {
       << s;
 }
 
+void AssertFloatEquals(uint32_t expected_bits, const char* s) {
+  uint32_t actual_bits;
+  ASSERT_EQ(Result::Ok,
+            ParseFloat(LiteralType::Float, s, s + strlen(s), &actual_bits))
+      << s;
+  ASSERT_EQ(expected_bits, actual_bits) << s;
+}
+
+void AssertFloatFails(const char* s) {
+  uint32_t actual_bits;
+  ASSERT_EQ(Result::Error,
+            ParseFloat(LiteralType::Float, s, s + strlen(s), &actual_bits))
+      << s;
+}
+
+void AssertDoubleEquals(uint64_t expected_bits, const char* s) {
+  uint64_t actual_bits;
+  ASSERT_EQ(Result::Ok,
+            ParseDouble(LiteralType::Float, s, s + strlen(s), &actual_bits))
+      << s;
+  ASSERT_EQ(expected_bits, actual_bits) << s;
+}
+
+void AssertDoubleFails(const char* s) {
+  uint64_t actual_bits;
+  ASSERT_EQ(Result::Error,
+            ParseDouble(LiteralType::Float, s, s + strlen(s), &actual_bits))
+      << s;
+}
+
 }  // end anonymous namespace
 
 TEST(ParseInt8, Both) {
@@ -610,6 +640,34 @@ TEST(ParseFloat, RoundingSpec) {
   }
 }
 
+TEST(ParseFloat, Decimal) {
+  AssertFloatEquals(0, "0");
+  AssertFloatEquals(0x80000000, "-0");
+  AssertFloatEquals(0x3fc00000, "1.5");
+  AssertFloatEquals(0x447a0002, "1_000.000_1");
+  AssertFloatEquals(0x501502f9, "1e1_0");
+  AssertFloatEquals(0xbdcccccd, "-0.1");
+  AssertFloatEquals(0x40490fdb, "3.14159265358979323846");
+  AssertFloatEquals(0x3e99999a, "0.30000000000000000000000000000000001");
+  AssertFloatEquals(0x6fc77488, "123456789012345678901234567890");
+}
+
+TEST(ParseFloat, DecimalRounding) {
+  // Halfway between 16777216 and 16777218, round to even.
+  AssertFloatEquals(0x4b800000, "16777217");
+  AssertFloatEquals(0x00000001, "1e-45");
+  AssertFloatEquals(0x00000001, "7.1e-46");
+  AssertFloatEquals(0x00000000, "7e-46");
+  AssertFloatEquals(0x00800000, "1.17549435e-38");
+  AssertFloatEquals(0x7f7fffff, "3.4028235e38");
+}
+
+TEST(ParseFloat, DecimalOutOfRange) {
+  AssertFloatFails("1e39");
+  AssertFloatFails("-3.5e38");
+  AssertFloatFails("1e99999999999999999999");
+}
+
 TEST(ParseFloat, OutOfRange) {
   AssertHexFloatFails("0x1p128");
   AssertHexFloatFails("-0x1p128");
@@ -638,6 +696,31 @@ TEST(ParseDouble, Rounding) {
   AssertHexDoubleEquals(0x7fefffffffffffff, "0x1.fffffffffffff0p1023");
 }
 
+TEST(ParseDouble, Decimal) {
+  AssertDoubleEquals(0, "0.0");
+  AssertDoubleEquals(0x8000000000000000, "-0");
+  AssertDoubleEquals(0x408f4000346dc5d6, "1_000.000_1");
+  AssertDoubleEquals(0xbfb999999999999a, "-0.1");
+  AssertDoubleEquals(0x400921fb54442d18, "3.14159265358979323846");
+  AssertDoubleEquals(0x3fd3333333333333,
+                     "0.30000000000000000000000000000000001");
+  AssertDoubleEquals(0x45f8ee90ff6c373e, "123456789012345678901234567890");
+  AssertDoubleEquals(0x4340000000000000, "9007199254740993");
+}
+
+TEST(ParseDouble, DecimalRounding) {
+  AssertDoubleEquals(0x0000000000000001, "4.9e-324");
+  AssertDoubleEquals(0x0000000000000001, "2.4703282292062328e-324");
+  AssertDoubleEquals(0x0000000000000000, "1e-400");
+  AssertDoubleEquals(0x000fffffffffffff, "2.2250738585072011e-308");
+  AssertDoubleEquals(0x7fefffffffffffff, "1.7976931348623157e308");
+}
+
+TEST(ParseDouble, DecimalOutOfRange) {
+  AssertDoubleFails("1e309");
+  AssertDoubleFails("-1.8e308");
+}
+
 TEST(ParseDouble, OutOfRange) {
   AssertHexDoubleFails("0x1p1024");
   AssertHexDoubleFails("-0x1p1024");
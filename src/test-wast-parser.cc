@@ -17,7 +17,9 @@
 #include "gtest/gtest.h"
 
 #include <memory>
+#include <vector>
 
+#include "src/cast.h"
 #include "src/wast-lexer.h"
 #include "src/wast-parser.h"
 
@@ -85,3 +87,34 @@ TEST(WastParser, LongTokenSpace) {
   ASSERT_STREQ(R"(unexpected token notmodule, expected EOF.)",
                errors[1].message.c_str());
 }
+
+TEST(WastParser, StreamCommands) {
+  std::string text =
+      "(module $M (func (export \"f\")))\n"
+      "(invoke \"f\")\n"
+      "(module (func (export \"g\")))\n"
+      "(invoke $M \"f\")\n";
+  auto lexer = WastLexer::CreateBufferLexer("test", text.c_str(), text.size());
+  Errors errors;
+  Features features;
+  WastParseOptions options(features);
+
+  std::vector<CommandType> types;
+  auto callback = [&](Script* script, Command* command) {
+    types.push_back(command->type);
+    EXPECT_EQ(command, script->commands.back().get());
+    if (auto* action = dyn_cast<ActionCommand>(command)) {
+      // Both the named module and the most recent module must still be
+      // available when an action is run.
+      EXPECT_NE(nullptr, script->GetModule(action->action->module_var));
+    }
+    return Result::Ok;
+  };
+  Result result = ParseWastScript(lexer.get(), callback, &errors, &options);
+  ASSERT_EQ(Result::Ok, result);
+  ASSERT_EQ(0u, errors.size());
+  std::vector<CommandType> expected = {CommandType::Module, CommandType::Action,
+                                       CommandType::Module,
+                                       CommandType::Action};
+  ASSERT_EQ(expected, types);
+}
@@ -19,6 +19,7 @@
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -86,7 +87,10 @@ static void ParseOptions(int argc, char** argv) {
                      s_thread_options.call_stack_size = atoi(argument.c_str());
                    });
   parser.AddOption('t', "trace", "Trace execution",
-                   []() { s_trace_stream = s_stdout_stream.get(); });
+                   []() {
+                     s_trace_stream = s_stdout_stream.get();
+                     s_thread_options.trace_stream = s_trace_stream;
+                   });
 
   parser.AddArgument("filename", OptionParser::ArgumentCount::One,
                      [](const char* argument) {
@@ -100,14 +104,15 @@ namespace spectest {
 
 class Command;
 typedef std::unique_ptr<Command> CommandPtr;
-typedef std::vector<CommandPtr> CommandPtrVector;
 
 class Script {
  public:
   std::string filename;
-  CommandPtrVector commands;
 };
 
+// Called with each command as soon as it has been parsed.
+typedef std::function<void(const Script&, CommandPtr)> CommandCallback;
+
 class Command {
  public:
   WABT_DISALLOW_COPY_AND_ASSIGN(Command);
@@ -326,7 +331,9 @@ class JSONParser {
   JSONParser() {}
 
   wabt::Result ReadFile(std::string_view spec_json_filename);
-  wabt::Result ParseScript(Script* out_script);
+  wabt::Result ParseScript(Script* out_script, const CommandCallback&);
+  // Starts parsing again from the beginning of the file.
+  void Rewind();
 
  private:
   void WABT_PRINTF_FORMAT(2, 3) PrintError(const char* format, ...);
@@ -402,6 +409,13 @@ wabt::Result JSONParser::ReadFile(std::string_view spec_json_filename) {
   return wabt::ReadFile(spec_json_filename, &json_data_);
 }
 
+void JSONParser::Rewind() {
+  json_offset_ = 0;
+  loc_.line = 1;
+  loc_.first_column = 1;
+  has_prev_loc_ = false;
+}
+
 void JSONParser::PrintError(const char* format, ...) {
   WABT_SNPRINTF_ALLOCA(buffer, length, format);
   fprintf(stderr, "%s:%d:%d: %s\n", std::string(loc_.filename).c_str(),
@@ -1128,7 +1142,8 @@ wabt::Result JSONParser::ParseCommand(CommandPtr* out_command) {
   return wabt::Result::Ok;
 }
 
-wabt::Result JSONParser::ParseScript(Script* out_script) {
+wabt::Result JSONParser::ParseScript(Script* out_script,
+                                     const CommandCallback& callback) {
   EXPECT("{");
   PARSE_KEY_STRING_VALUE("source_filename", &out_script->filename);
   EXPECT(",");
@@ -1141,7 +1156,7 @@ wabt::Result JSONParser::ParseScript(Script* out_script) {
       EXPECT(",");
     }
     CHECK_RESULT(ParseCommand(&command));
-    out_script->commands.push_back(std::move(command));
+    callback(*out_script, std::move(command));
     first = false;
   }
   EXPECT("}");
@@ -1157,7 +1172,7 @@ struct ActionResult {
 class CommandRunner {
  public:
   CommandRunner();
-  wabt::Result Run(const Script& script);
+  void RunCommand(const Script& script, const Command* command);
 
   int passed() const { return passed_; }
   int total() const { return total_; }
@@ -1217,7 +1232,7 @@ class CommandRunner {
   int passed_ = 0;
   int total_ = 0;
 
-  std::string source_filename_;
+  const Script* script_ = nullptr;
 };
 
 CommandRunner::CommandRunner() : store_(s_features) {
@@ -1268,71 +1283,63 @@ CommandRunner::CommandRunner() : store_(s_features) {
                           Value::Make(f64{666}));
 }
 
-wabt::Result CommandRunner::Run(const Script& script) {
-  source_filename_ = script.filename;
-
-  for (const CommandPtr& command : script.commands) {
-    switch (command->type) {
-      case CommandType::Module:
-        OnModuleCommand(cast<ModuleCommand>(command.get()));
-        break;
+void CommandRunner::RunCommand(const Script& script, const Command* command) {
+  script_ = &script;
+  switch (command->type) {
+    case CommandType::Module:
+      OnModuleCommand(cast<ModuleCommand>(command));
+      break;
 
-      case CommandType::Action:
-        TallyCommand(OnActionCommand(cast<ActionCommand>(command.get())));
-        break;
+    case CommandType::Action:
+      TallyCommand(OnActionCommand(cast<ActionCommand>(command)));
+      break;
 
-      case CommandType::Register:
-        OnRegisterCommand(cast<RegisterCommand>(command.get()));
-        break;
+    case CommandType::Register:
+      OnRegisterCommand(cast<RegisterCommand>(command));
+      break;
 
-      case CommandType::AssertMalformed:
-        TallyCommand(OnAssertMalformedCommand(
-            cast<AssertMalformedCommand>(command.get())));
-        break;
+    case CommandType::AssertMalformed:
+      TallyCommand(OnAssertMalformedCommand(
+          cast<AssertMalformedCommand>(command)));
+      break;
 
-      case CommandType::AssertInvalid:
-        TallyCommand(
-            OnAssertInvalidCommand(cast<AssertInvalidCommand>(command.get())));
-        break;
+    case CommandType::AssertInvalid:
+      TallyCommand(OnAssertInvalidCommand(cast<AssertInvalidCommand>(command)));
+      break;
 
-      case CommandType::AssertUnlinkable:
-        TallyCommand(OnAssertUnlinkableCommand(
-            cast<AssertUnlinkableCommand>(command.get())));
-        break;
+    case CommandType::AssertUnlinkable:
+      TallyCommand(OnAssertUnlinkableCommand(
+          cast<AssertUnlinkableCommand>(command)));
+      break;
 
-      case CommandType::AssertUninstantiable:
-        TallyCommand(OnAssertUninstantiableCommand(
-            cast<AssertUninstantiableCommand>(command.get())));
-        break;
+    case CommandType::AssertUninstantiable:
+      TallyCommand(OnAssertUninstantiableCommand(
+          cast<AssertUninstantiableCommand>(command)));
+      break;
 
-      case CommandType::AssertReturn:
-        TallyCommand(
-            OnAssertReturnCommand(cast<AssertReturnCommand>(command.get())));
-        break;
+    case CommandType::AssertReturn:
+      TallyCommand(OnAssertReturnCommand(cast<AssertReturnCommand>(command)));
+      break;
 
-      case CommandType::AssertTrap:
-        TallyCommand(
-            OnAssertTrapCommand(cast<AssertTrapCommand>(command.get())));
-        break;
+    case CommandType::AssertTrap:
+      TallyCommand(OnAssertTrapCommand(cast<AssertTrapCommand>(command)));
+      break;
 
-      case CommandType::AssertExhaustion:
-        TallyCommand(OnAssertExhaustionCommand(
-            cast<AssertExhaustionCommand>(command.get())));
-        break;
+    case CommandType::AssertExhaustion:
+      TallyCommand(OnAssertExhaustionCommand(
+          cast<AssertExhaustionCommand>(command)));
+      break;
 
-      case CommandType::AssertException:
-        TallyCommand(OnAssertExceptionCommand(
-            cast<AssertExceptionCommand>(command.get())));
-        break;
-    }
+    case CommandType::AssertException:
+      TallyCommand(OnAssertExceptionCommand(
+          cast<AssertExceptionCommand>(command)));
+      break;
   }
-
-  return wabt::Result::Ok;
 }
 
 void CommandRunner::PrintError(uint32_t line_number, const char* format, ...) {
   WABT_SNPRINTF_ALLOCA(buffer, length, format);
-  printf("%s:%u: %s\n", source_filename_.c_str(), line_number, buffer);
+  printf("%s:%u: %s\n", script_->filename.c_str(), line_number, buffer);
 }
 
 ActionResult CommandRunner::RunAction(int line_number,
@@ -1353,8 +1360,8 @@ ActionResult CommandRunner::RunAction(int line_number,
   switch (action->type) {
     case ActionType::Invoke: {
       auto* func = cast<interp::Func>(extern_.get());
-      func->Call(store_, action->args, result.values, &result.trap,
-                 s_trace_stream);
+      Thread thread(store_, s_thread_options);
+      func->Call(thread, action->args, result.values, &result.trap);
       result.types = func->type().results;
       if (verbose == RunVerbosity::Verbose) {
         WriteCall(s_stdout_stream.get(), action->field_name, func->type(),
@@ -1429,7 +1436,7 @@ wabt::Result CommandRunner::ReadInvalidModule(int line_number,
                                               ModuleType module_type,
                                               const char* desc) {
   std::string header = StringPrintf(
-      "%s:%d: %s passed", source_filename_.c_str(), line_number, desc);
+      "%s:%d: %s passed", script_->filename.c_str(), line_number, desc);
 
   switch (module_type) {
     case ModuleType::Text: {
@@ -1866,13 +1873,22 @@ static int ReadAndRunSpecJSON(std::string_view spec_json_filename) {
     return 1;
   }
 
+  // The script is parsed twice. The first pass only checks it, so that no
+  // command is run if the JSON is invalid. In the second pass each command is
+  // run as soon as it is parsed, and freed afterward.
   Script script;
-  if (parser.ParseScript(&script) == wabt::Result::Error) {
+  CommandCallback check_command = [](const Script&, CommandPtr) {};
+  if (parser.ParseScript(&script, check_command) == wabt::Result::Error) {
     return 1;
   }
 
   CommandRunner runner;
-  if (runner.Run(script) == wabt::Result::Error) {
+  CommandCallback run_command = [&](const Script& s, CommandPtr command) {
+    runner.RunCommand(s, command.get());
+  };
+  parser.Rewind();
+  script = Script();
+  if (parser.ParseScript(&script, run_command) == wabt::Result::Error) {
     return 1;
   }
 
@@ -16,19 +16,26 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "src/binary-reader.h"
 #include "src/error-formatter.h"
 #include "src/feature.h"
 #include "src/interp/binary-reader-interp.h"
+#include "src/interp/interp-module-cache.h"
+#include "src/interp/interp-profiler.h"
 #include "src/interp/interp-util.h"
 #include "src/interp/interp-wasi.h"
 #include "src/interp/interp.h"
+#include "src/make-unique.h"
 #include "src/option-parser.h"
 #include "src/stream.h"
 
@@ -42,6 +49,14 @@ using namespace wabt::interp;
 static int s_verbose;
 static const char* s_infile;
 static Thread::Options s_thread_options;
+static bool s_fuel_metering;
+static int s_timeout;
+static std::string s_profile_filename;
+static int s_profile_interval = 1000;
+static bool s_block_counts;
+static std::string s_module_cache_dir;
+static bool s_lazy_compile;
+static LazyValidation s_lazy_validation = LazyValidation::Eager;
 static Stream* s_trace_stream;
 static bool s_run_all_exports;
 static bool s_host_print;
@@ -57,6 +72,8 @@ static std::unique_ptr<FileStream> s_stdout_stream;
 static std::unique_ptr<FileStream> s_stderr_stream;
 
 static Store s_store;
+static std::unique_ptr<Profiler> s_profiler;
+static std::unique_ptr<DispatchStats> s_dispatch_stats;
 
 static const char s_description[] =
     R"(  read a file in the wasm binary format, and run in it a stack-based
@@ -97,8 +114,66 @@ static void ParseOptions(int argc, char** argv) {
                      // TODO(binji): validate.
                      s_thread_options.call_stack_size = atoi(argument.c_str());
                    });
+  parser.AddOption(0, "fuel", "N",
+                   "Trap once a call has executed N instructions",
+                   [](const std::string& argument) {
+                     s_fuel_metering = true;
+                     s_thread_options.fuel =
+                         strtoull(argument.c_str(), nullptr, 10);
+                   });
+  parser.AddOption(0, "timeout", "MS",
+                   "Trap once the code has run for MS milliseconds",
+                   [](const std::string& argument) {
+                     s_fuel_metering = true;
+                     s_timeout = atoi(argument.c_str());
+                   });
+  parser.AddOption(0, "profile", "FILE",
+                   "Sample the call stack while running, and write the "
+                   "samples to FILE in folded stack format",
+                   [](const std::string& argument) {
+                     s_fuel_metering = true;
+                     s_profile_filename = argument;
+                   });
+  parser.AddOption(0, "profile-interval", "USEC",
+                   "Time between call stack samples, default 1000",
+                   [](const std::string& argument) {
+                     s_profile_interval = atoi(argument.c_str());
+                   });
+  parser.AddOption("block-counts",
+                   "Print how many times each function and basic block ran",
+                   []() {
+                     s_fuel_metering = true;
+                     s_block_counts = true;
+                   });
+  parser.AddOption(0, "module-cache", "DIR",
+                   "Load the module from a precompiled copy in DIR if there "
+                   "is one, otherwise add one",
+                   [](const std::string& argument) {
+                     s_module_cache_dir = argument;
+                   });
+  parser.AddOption("lazy-compile",
+                   "Compile each function on its first call; the module is "
+                   "still validated when it is loaded",
+                   []() { s_lazy_compile = true; });
+  parser.AddOption("lazy-validate",
+                   "Same as --lazy-compile, but also validate each function "
+                   "on its first call",
+                   []() {
+                     s_lazy_compile = true;
+                     s_lazy_validation = LazyValidation::Lazy;
+                   });
+  parser.AddOption("dispatch-stats",
+                   "Print how many times each opcode and pair of opcodes ran, "
+                   "in the format used by wasm-opcodecnt",
+                   []() {
+                     s_dispatch_stats = MakeUnique<DispatchStats>(s_store);
+                     s_thread_options.dispatch_stats = s_dispatch_stats.get();
+                   });
   parser.AddOption('t', "trace", "Trace execution",
-                   []() { s_trace_stream = s_stdout_stream.get(); });
+                   []() {
+                     s_trace_stream = s_stdout_stream.get();
+                     s_thread_options.trace_stream = s_trace_stream;
+                   });
   parser.AddOption("wasi",
                    "Assume input module is WASI compliant (Export "
                    " WASI API the the module and invoke _start function)",
@@ -152,7 +227,8 @@ Result RunAllExports(const Instance::Ptr& instance, Errors* errors) {
       Values params;
       Values results;
       Trap::Ptr trap;
-      result |= func->Call(s_store, params, results, &trap, s_trace_stream);
+      Thread thread(s_store, s_thread_options);
+      result |= func->Call(thread, params, results, &trap);
       WriteCall(s_stdout_stream.get(), export_.type.name, *func_type, params,
                 results, trap);
     }
@@ -204,9 +280,26 @@ static Result ReadModule(const char* module_filename,
   const bool kFailOnCustomSectionError = true;
   ReadBinaryOptions options(s_features, s_log_stream.get(), kReadDebugNames,
                             kStopOnFirstError, kFailOnCustomSectionError);
-  CHECK_RESULT(ReadBinaryInterp(module_filename, file_data.data(),
-                                file_data.size(), options, errors,
-                                &module_desc));
+  FuelCosts fuel_costs;
+  if (s_lazy_compile) {
+    CHECK_RESULT(ReadBinaryInterpLazy(
+        module_filename, file_data.data(), file_data.size(), options,
+        s_lazy_validation, s_fuel_metering ? &fuel_costs : nullptr, errors,
+        &module_desc));
+  } else if (!s_module_cache_dir.empty()) {
+    ModuleCache cache(s_module_cache_dir);
+    CHECK_RESULT(cache.ReadBinaryInterp(
+        module_filename, file_data.data(), file_data.size(), options,
+        s_fuel_metering ? &fuel_costs : nullptr, errors, &module_desc));
+  } else if (s_fuel_metering) {
+    CHECK_RESULT(ReadBinaryInterp(module_filename, file_data.data(),
+                                  file_data.size(), options, fuel_costs,
+                                  errors, &module_desc));
+  } else {
+    CHECK_RESULT(ReadBinaryInterp(module_filename, file_data.data(),
+                                  file_data.size(), options, errors,
+                                  &module_desc));
+  }
 
   if (s_verbose) {
     module_desc.istream.Disassemble(stream);
@@ -310,8 +403,8 @@ static Result ReadAndRunModule(const char* module_filename) {
   }
 #ifdef WITH_WASI
   if (s_wasi) {
-    CHECK_RESULT(
-        WasiRunStart(instance, &uvwasi, s_stderr_stream.get(), s_trace_stream));
+    CHECK_RESULT(WasiRunStart(instance, &uvwasi, s_stderr_stream.get(),
+                              s_thread_options));
   }
 #endif
 
@@ -326,7 +419,60 @@ int ProgramMain(int argc, char** argv) {
   ParseOptions(argc, argv);
   s_store.setFeatures(s_features);
 
+  if (s_block_counts || !s_profile_filename.empty()) {
+    s_profiler = MakeUnique<Profiler>(s_store);
+    s_thread_options.profiler = s_profiler.get();
+    if (!s_profile_filename.empty()) {
+      s_profiler->StartSampling(std::chrono::microseconds(s_profile_interval));
+    }
+  }
+
+  // Interrupts the code by advancing the store's epoch past the threads'
+  // deadline once the timeout expires, unless the run is done by then.
+  std::thread timer;
+  std::mutex timer_mutex;
+  std::condition_variable timer_cv;
+  bool done = false;
+  if (s_timeout > 0) {
+    s_thread_options.epoch_deadline = s_store.epoch() + 1;
+    timer = std::thread([&]() {
+      std::unique_lock<std::mutex> lock(timer_mutex);
+      if (!timer_cv.wait_for(lock, std::chrono::milliseconds(s_timeout),
+                             [&]() { return done; })) {
+        s_store.IncrementEpoch();
+      }
+    });
+  }
+
   wabt::Result result = ReadAndRunModule(s_infile);
+
+  if (timer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(timer_mutex);
+      done = true;
+    }
+    timer_cv.notify_all();
+    timer.join();
+  }
+
+  if (s_dispatch_stats) {
+    s_dispatch_stats->Write(s_stdout_stream.get());
+  }
+
+  if (s_profiler) {
+    s_profiler->StopSampling();
+    if (s_block_counts) {
+      s_profiler->WriteCounts(s_stdout_stream.get());
+    }
+    if (!s_profile_filename.empty()) {
+      FileStream stream(s_profile_filename);
+      if (stream.is_open()) {
+        s_profiler->WriteFoldedStacks(&stream);
+      } else {
+        result = wabt::Result::Error;
+      }
+    }
+  }
   return result != wabt::Result::Ok;
 }
 
@@ -51,6 +51,21 @@ static void ParseOptions(int argc, char** argv) {
                    []() { s_objdump_options.raw = true; });
   parser.AddOption('d', "disassemble", "Disassemble function bodies",
                    []() { s_objdump_options.disassemble = true; });
+  parser.AddOption(0, "function", "FUNC",
+                   "Disassemble just one function, given by index or name. "
+                   "Implies -d",
+                   [](const char* argument) {
+                     s_objdump_options.function_name = argument;
+                   });
+  parser.AddOption(0, "threads", "N", "Disassemble function bodies on N threads",
+                   [](const char* argument) {
+                     s_objdump_options.num_threads = atoi(argument);
+                     if (s_objdump_options.num_threads < 1) {
+                       fprintf(stderr, "invalid --threads value: %s\n",
+                               argument);
+                       exit(1);
+                     }
+                   });
   parser.AddOption("debug", "Print extra debug information", []() {
     s_objdump_options.debug = true;
     s_log_stream = FileStream::CreateStderr();
@@ -69,6 +84,10 @@ static void ParseOptions(int argc, char** argv) {
       [](const char* argument) { s_infiles.push_back(argument); });
 
   parser.Parse(argc, argv);
+
+  if (s_objdump_options.function_name) {
+    s_objdump_options.disassemble = true;
+  }
 }
 
 Result dump_file(const char* filename) {
@@ -92,6 +111,13 @@ Result dump_file(const char* filename) {
   result |= ReadBinaryObjdump(data, size, &s_objdump_options, &state);
   s_objdump_options.log_stream = nullptr;
 
+  // Names are only used to annotate details and disassembly, so only load them
+  // (from the imports, exports, and the name and linking sections) if needed.
+  if (s_objdump_options.details || s_objdump_options.disassemble) {
+    s_objdump_options.mode = ObjdumpMode::Names;
+    result |= ReadBinaryObjdump(data, size, &s_objdump_options, &state);
+  }
+
   // Pass 1: Print the section headers
   if (s_objdump_options.headers) {
     s_objdump_options.mode = ObjdumpMode::Headers;
@@ -110,43 +110,61 @@ int ProgramMain(int argc, char** argv) {
     WABT_FATAL("unable to read file: %s\n", s_infile);
   }
 
-  Errors errors;
-  std::unique_ptr<Script> script;
-  WastParseOptions parse_wast_options(s_features);
-  result = ParseWastScript(lexer.get(), &script, &errors, &parse_wast_options);
-
-  if (Succeeded(result) && s_validate) {
-    ValidateOptions options(s_features);
-    result = ValidateScript(script.get(), &errors, options);
+  if (s_outfile.empty()) {
+    s_outfile = DefaultOuputName(s_infile);
   }
 
-  if (Succeeded(result)) {
-    if (s_outfile.empty()) {
-      s_outfile = DefaultOuputName(s_infile);
-    }
+  // The script is converted one command at a time, as it is parsed, so only
+  // the current command's modules are held in memory. The JSON file is only
+  // written if the whole script is valid.
+  std::vector<FilenameMemoryStreamPair> module_streams;
+  WriteBinarySpecStreamFactory module_stream_factory =
+      [&](std::string_view filename) {
+        module_streams.emplace_back(
+            filename, MakeUnique<MemoryStream>(s_log_stream.get()));
+        return module_streams.back().stream.get();
+      };
+
+  MemoryStream json_stream;
+  std::string output_basename(StripExtension(s_outfile));
+  s_write_binary_options.features = s_features;
+  SpecScriptWriter writer(&json_stream, module_stream_factory, s_infile,
+                          output_basename, s_write_binary_options);
+
+  Errors errors;
+  WastParseOptions parse_wast_options(s_features);
+  ValidateOptions validate_options(s_features);
+  Result write_result = Result::Ok;
+  result = ParseWastScript(
+      lexer.get(),
+      [&](Script* script, Command* command) -> Result {
+        if (s_validate &&
+            Failed(ValidateCommand(script, command, &errors,
+                                   validate_options))) {
+          return Result::Ok;
+        }
+        if (!errors.empty() || Failed(write_result)) {
+          return Result::Ok;
+        }
 
-    std::vector<FilenameMemoryStreamPair> module_streams;
-    MemoryStream json_stream;
+        writer.WriteCommand(*script, *command);
+        for (auto& module_stream : module_streams) {
+          write_result |=
+              module_stream.stream->WriteToFile(module_stream.filename);
+        }
+        module_streams.clear();
+        return Result::Ok;
+      },
+      &errors, &parse_wast_options);
 
-    std::string output_basename(StripExtension(s_outfile));
-    s_write_binary_options.features = s_features;
-    result = WriteBinarySpecScript(&json_stream, script.get(), s_infile,
-                                   output_basename, s_write_binary_options,
-                                   &module_streams, s_log_stream.get());
+  if (Succeeded(result) && errors.empty()) {
+    result = write_result | writer.Finish();
 
     if (Succeeded(result)) {
       result = json_stream.WriteToFile(s_outfile);
     }
-
-    if (Succeeded(result)) {
-      for (auto iter = module_streams.begin(); iter != module_streams.end();
-           ++iter) {
-        result = iter->stream->WriteToFile(iter->filename);
-        if (!Succeeded(result)) {
-          break;
-        }
-      }
-    }
+  } else {
+    result = Result::Error;
   }
 
   auto line_finder = lexer->MakeLineFinder();
@@ -54,6 +54,7 @@ class TypeChecker {
   }
 
   size_t type_stack_size() const { return type_stack_.size(); }
+  const TypeVector& type_stack() const { return type_stack_; }
 
   bool IsUnreachable();
   Result GetLabel(Index depth, Label** out_label);
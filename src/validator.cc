@@ -39,6 +39,7 @@ class ScriptValidator {
   ScriptValidator(Errors*, const Script*, const ValidateOptions& options);
 
   Result CheckScript();
+  Result CheckScriptCommand(const Command* command);
 
  private:
   struct ActionResult {
@@ -1018,6 +1019,11 @@ Result ScriptValidator::CheckScript() {
   return result_;
 }
 
+Result ScriptValidator::CheckScriptCommand(const Command* command) {
+  CheckCommand(command);
+  return result_;
+}
+
 }  // end anonymous namespace
 
 Result ValidateScript(const Script* script,
@@ -1028,6 +1034,15 @@ Result ValidateScript(const Script* script,
   return validator.CheckScript();
 }
 
+Result ValidateCommand(const Script* script,
+                       const Command* command,
+                       Errors* errors,
+                       const ValidateOptions& options) {
+  ScriptValidator validator(errors, script, options);
+
+  return validator.CheckScriptCommand(command);
+}
+
 Result ValidateModule(const Module* module,
                       Errors* errors,
                       const ValidateOptions& options) {
@@ -23,12 +23,19 @@
 
 namespace wabt {
 
+class Command;
 struct Module;
 struct Script;
 
 // Perform all checks on the script. It is valid if and only if this function
 // succeeds.
 Result ValidateScript(const Script*, Errors*, const ValidateOptions&);
+// Perform the checks for a single command of |script|. Used when the script
+// is parsed one command at a time, see ParseWastScript.
+Result ValidateCommand(const Script*,
+                       const Command*,
+                       Errors*,
+                       const ValidateOptions&);
 Result ValidateModule(const Module*, Errors*, const ValidateOptions&);
 
 }  // namespace wabt
@@ -18,9 +18,17 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 
 #include "config.h"
 
+#if defined(__SSE2__) || (COMPILER_IS_MSVC && _M_X64)
+#define WABT_LEXER_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define WABT_LEXER_USE_SSE2 0
+#endif
+
 #include "src/lexer-source.h"
 #include "src/wast-parser.h"
 
@@ -32,6 +40,94 @@ namespace {
 
 #include "src/prebuilt/lexer-keywords.cc"
 
+#if WABT_LEXER_USE_SSE2
+
+// These functions scan 16 bytes at a time, and return a pointer to the first
+// byte that needs to be looked at more closely. They stop early when fewer
+// than 16 bytes remain, so the caller must always finish with a scalar loop.
+
+typedef int (*StopMaskFunc)(__m128i);
+
+template <StopMaskFunc GetStopMask>
+const char* ScanSSE2(const char* p, const char* end) {
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = GetStopMask(chunk);
+    if (mask) {
+      return p + Ctz(static_cast<unsigned>(mask));
+    }
+    p += 16;
+  }
+  return p;
+}
+
+int BlankStopMask(__m128i chunk) {
+  __m128i blank = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+      _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+  return ~_mm_movemask_epi8(blank) & 0xffff;
+}
+
+int ReservedStopMask(__m128i chunk) {
+  // See WastLexer::IsCharClass; reserved chars are '!'..'~', except for
+  // '"(),;[]{}'. Bytes >= 0x80 are negative, so fail the signed compare.
+  __m128i in_range =
+      _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(' ')),
+                    _mm_cmplt_epi8(chunk, _mm_set1_epi8('\x7f')));
+  __m128i excluded = _mm_or_si128(
+      _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('('))),
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(')')),
+                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8(',')))),
+      _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(';')),
+                       _mm_cmpeq_epi8(chunk, _mm_set1_epi8('['))),
+          _mm_or_si128(
+              _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(']')),
+                           _mm_cmpeq_epi8(chunk, _mm_set1_epi8('{'))),
+              _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')))));
+  return ~_mm_movemask_epi8(_mm_andnot_si128(excluded, in_range)) & 0xffff;
+}
+
+int StringStopMask(__m128i chunk) {
+  return _mm_movemask_epi8(
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')),
+                                _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\'))),
+                   _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))));
+}
+
+#endif  // WABT_LEXER_USE_SSE2
+
+// Skip ' ', '\t' and '\r'.
+const char* SkipBlanks(const char* p, const char* end) {
+#if WABT_LEXER_USE_SSE2
+  return ScanSSE2<BlankStopMask>(p, end);
+#else
+  return p;
+#endif
+}
+
+// Skip chars for which WastLexer::IsReserved() is true.
+const char* SkipReservedChars(const char* p, const char* end) {
+#if WABT_LEXER_USE_SSE2
+  return ScanSSE2<ReservedStopMask>(p, end);
+#else
+  return p;
+#endif
+}
+
+// Skip string contents that don't need special handling, i.e. everything
+// except '"', '\\' and '\n'.
+const char* SkipPlainStringChars(const char* p, const char* end) {
+#if WABT_LEXER_USE_SSE2
+  return ScanSSE2<StringStopMask>(p, end);
+#else
+  return p;
+#endif
+}
+
 }  // namespace
 
 WastLexer::WastLexer(std::unique_ptr<LexerSource> source,
@@ -260,20 +356,20 @@ bool WastLexer::ReadBlockComment(WastParser* parser) {
 }
 
 bool WastLexer::ReadLineComment() {
-  while (true) {
-    switch (ReadChar()) {
-      case kEof:
-        return false;
-
-      case '\n':
-        Newline();
-        return true;
-    }
+  auto newline = static_cast<const char*>(
+      memchr(cursor_, '\n', buffer_end_ - cursor_));
+  if (!newline) {
+    cursor_ = buffer_end_;
+    return false;
   }
+  cursor_ = newline + 1;
+  Newline();
+  return true;
 }
 
 void WastLexer::ReadWhitespace() {
   while (true) {
+    cursor_ = SkipBlanks(cursor_, buffer_end_);
     switch (PeekChar()) {
       case ' ':
       case '\t':
@@ -298,6 +394,7 @@ Token WastLexer::GetStringToken(WastParser* parser) {
   bool in_string = true;
   ReadChar();
   while (in_string) {
+    cursor_ = SkipPlainStringChars(cursor_, buffer_end_);
     switch (ReadChar()) {
       case kEof:
         return BareToken(TokenType::Eof);
@@ -424,12 +521,12 @@ bool WastLexer::ReadHexNum() {
 }
 
 int WastLexer::ReadReservedChars() {
-  int count = 0;
+  const char* start = cursor_;
+  cursor_ = SkipReservedChars(cursor_, buffer_end_);
   while (IsReserved(PeekChar())) {
     ReadChar();
-    ++count;
   }
-  return count;
+  return static_cast<int>(cursor_ - start);
 }
 
 void WastLexer::ReadSign() {
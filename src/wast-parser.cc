@@ -1136,7 +1136,23 @@ Result WastParser::ParseModule(std::unique_ptr<Module>* out_module) {
 Result WastParser::ParseScript(std::unique_ptr<Script>* out_script) {
   WABT_TRACE(ParseScript);
   auto script = MakeUnique<Script>();
+  CHECK_RESULT(ParseScriptCommands(script.get()));
+  *out_script = std::move(script);
+  return Result::Ok;
+}
+
+Result WastParser::ParseScript(const WastCommandCallback& callback) {
+  WABT_TRACE(ParseScript);
+  Script script;
+  command_callback_ = &callback;
+  Result result = ParseScriptCommands(&script);
+  command_callback_ = nullptr;
+  streamed_module_index_ = kInvalidIndex;
+  return result;
+}
 
+Result WastParser::ParseScriptCommands(Script* script) {
+  WABT_TRACE(ParseScriptCommands);
   // Don't consume the Lpar yet, even though it is required. This way the
   // sub-parser functions (e.g. ParseFuncModuleField) can consume it and keep
   // the parsing structure more regular.
@@ -1145,21 +1161,16 @@ Result WastParser::ParseScript(std::unique_ptr<Script>* out_script) {
     auto command = MakeUnique<ModuleCommand>();
     command->module.loc = GetLocation();
     CHECK_RESULT(ParseModuleFieldList(&command->module));
-    script->commands.emplace_back(std::move(command));
+    CHECK_RESULT(AddCommand(script, std::move(command)));
   } else if (IsCommand(PeekPair())) {
-    CHECK_RESULT(ParseCommandList(script.get(), &script->commands));
+    CHECK_RESULT(ParseCommandList(script));
   } else {
     ConsumeIfLpar();
     ErrorExpected({"a module field", "a command"});
   }
 
   EXPECT(Eof);
-  if (errors_->size() == 0) {
-    *out_script = std::move(script);
-    return Result::Ok;
-  } else {
-    return Result::Error;
-  }
+  return errors_->size() == 0 ? Result::Ok : Result::Error;
 }
 
 Result WastParser::ParseModuleFieldList(Module* module) {
@@ -3130,13 +3141,12 @@ Result WastParser::ParseGlobalType(Global* global) {
   return Result::Ok;
 }
 
-Result WastParser::ParseCommandList(Script* script,
-                                    CommandPtrVector* commands) {
+Result WastParser::ParseCommandList(Script* script) {
   WABT_TRACE(ParseCommandList);
   while (IsCommand(PeekPair())) {
     CommandPtr command;
     if (Succeeded(ParseCommand(script, &command))) {
-      commands->push_back(std::move(command));
+      CHECK_RESULT(AddCommand(script, std::move(command)));
     } else {
       CHECK_RESULT(Synchronize(IsCommand));
     }
@@ -3144,6 +3154,35 @@ Result WastParser::ParseCommandList(Script* script,
   return Result::Ok;
 }
 
+Result WastParser::AddCommand(Script* script, CommandPtr command) {
+  if (!command_callback_) {
+    script->commands.push_back(std::move(command));
+    return Result::Ok;
+  }
+
+  // Later commands can only refer to the most recent module, or to a named
+  // module; everything else can be freed as soon as the callback returns. The
+  // freed commands leave null entries so command indexes stay valid.
+  bool is_module = isa<ModuleCommand>(command.get());
+  if (is_module && streamed_module_index_ != kInvalidIndex) {
+    CommandPtr& prev_module = script->commands[streamed_module_index_];
+    if (cast<ModuleCommand>(prev_module.get())->module.name.empty()) {
+      prev_module.reset();
+    }
+  }
+
+  Index command_index = script->commands.size();
+  script->commands.push_back(std::move(command));
+  Result result =
+      (*command_callback_)(script, script->commands[command_index].get());
+  if (is_module) {
+    streamed_module_index_ = command_index;
+  } else {
+    script->commands[command_index].reset();
+  }
+  return result;
+}
+
 Result WastParser::ParseCommand(Script* script, CommandPtr* out_command) {
   WABT_TRACE(ParseCommand);
   switch (Peek(1)) {
@@ -3532,4 +3571,25 @@ Result ParseWastScript(WastLexer* lexer,
   return Result::Ok;
 }
 
+Result ParseWastScript(WastLexer* lexer,
+                       const WastCommandCallback& callback,
+                       Errors* errors,
+                       WastParseOptions* options) {
+  assert(options != nullptr);
+  WastParser parser(lexer, errors, options);
+  // Errors reported by the callback itself (e.g. validation errors) don't
+  // stop later commands from being passed on.
+  size_t num_callback_errors = 0;
+  return parser.ParseScript([&](Script* script, Command* command) -> Result {
+    if (errors->size() != num_callback_errors ||
+        Failed(ResolveNamesCommand(script, command, errors))) {
+      return Result::Ok;
+    }
+    size_t num_errors = errors->size();
+    Result result = callback(script, command);
+    num_callback_errors += errors->size() - num_errors;
+    return result;
+  });
+}
+
 }  // namespace wabt
@@ -18,6 +18,7 @@
 #define WABT_WAST_PARSER_H_
 
 #include <array>
+#include <functional>
 #include <unordered_map>
 
 #include "src/circular-array.h"
@@ -38,6 +39,13 @@ struct WastParseOptions {
 
 typedef std::array<TokenType, 2> TokenTypePair;
 
+// Called with each command of a script as soon as it has been parsed. The
+// command is owned by |script|, and is freed when the callback returns, unless
+// it is a module that later commands may refer to (the most recent module, or
+// a named module).
+typedef std::function<Result(Script* script, Command* command)>
+    WastCommandCallback;
+
 class WastParser {
  public:
   WastParser(WastLexer*, Errors*, WastParseOptions*);
@@ -45,6 +53,9 @@ class WastParser {
   void WABT_PRINTF_FORMAT(3, 4) Error(Location, const char* format, ...);
   Result ParseModule(std::unique_ptr<Module>* out_module);
   Result ParseScript(std::unique_ptr<Script>* out_script);
+  // Like above, but commands are passed to |callback| as they are parsed,
+  // instead of all being kept in the returned Script.
+  Result ParseScript(const WastCommandCallback& callback);
 
   std::unique_ptr<Script> ReleaseScript();
 
@@ -220,8 +231,10 @@ class WastParser {
   Result ParseMemoryBinaryExpr(Location, std::unique_ptr<Expr>*);
   Result ParseSimdLane(Location, uint64_t*);
 
-  Result ParseCommandList(Script*, CommandPtrVector*);
+  Result ParseScriptCommands(Script*);
+  Result ParseCommandList(Script*);
   Result ParseCommand(Script*, CommandPtr*);
+  Result AddCommand(Script*, CommandPtr);
   Result ParseAssertExceptionCommand(CommandPtr*);
   Result ParseAssertExhaustionCommand(CommandPtr*);
   Result ParseAssertInvalidCommand(CommandPtr*);
@@ -254,6 +267,8 @@ class WastParser {
 
   WastLexer* lexer_;
   Index last_module_index_ = kInvalidIndex;
+  const WastCommandCallback* command_callback_ = nullptr;
+  Index streamed_module_index_ = kInvalidIndex;
   Errors* errors_;
   WastParseOptions* options_;
 
@@ -270,6 +285,14 @@ Result ParseWastScript(WastLexer* lexer,
                        Errors*,
                        WastParseOptions* options);
 
+// Parse a script one command at a time, so the whole script is never held in
+// memory. Names are resolved before a command is passed to |callback|. After
+// a parse or name resolution error, no more commands are passed on.
+Result ParseWastScript(WastLexer* lexer,
+                       const WastCommandCallback& callback,
+                       Errors*,
+                       WastParseOptions* options);
+
 }  // namespace wabt
 
 #endif /* WABT_WAST_PARSER_H_ */
@@ -951,6 +951,8 @@ def main(args):
     variables['bindir'] = options.bindir
     variables['gen_wasm_py'] = os.path.join(TEST_DIR, 'gen-wasm.py')
     variables['gen_spec_js_py'] = os.path.join(TEST_DIR, 'gen-spec-js.py')
+    variables['run_wasi_guests_py'] = os.path.join(TEST_DIR,
+                                                   'run-wasi-guests.py')
     for exe_basename in find_exe.EXECUTABLES:
         exe_override = os.path.join(options.bindir, exe_basename)
         variables[exe_basename] = find_exe.FindExecutable(exe_basename,
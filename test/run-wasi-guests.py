@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Copyright 2026 WebAssembly Community Group participants
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""Runs several WASI guests at once and checks the CPU time they use.
+
+Each guest is expected to spend most of its time waiting, e.g. in
+poll_oneoff, so together they should use much less CPU time than the
+wall-clock time they run for. A single guest that busy-waits already uses
+about as much CPU time as that, on any number of cores.
+"""
+
+import argparse
+import resource
+import subprocess
+import sys
+import time
+
+from utils import Error
+
+
+def main(args):
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('wasm_interp', metavar='PATH',
+                        help='path to the wasm-interp executable.')
+    parser.add_argument('file', help='wasm file to run in each guest.')
+    parser.add_argument('--guests', type=int, default=8,
+                        help='number of guests to run at once.')
+    parser.add_argument('--max-cpu-fraction', type=float, default=0.25,
+                        help='the most CPU time the guests may use, as a '
+                        'fraction of the wall-clock time they ran for.')
+    options = parser.parse_args(args)
+
+    start = time.monotonic()
+    guests = [subprocess.Popen([options.wasm_interp, '--wasi', options.file],
+                               stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+              for _ in range(options.guests)]
+    outputs = [guest.communicate() for guest in guests]
+    run_time = time.monotonic() - start
+    usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    cpu_time = usage.ru_utime + usage.ru_stime
+
+    for guest, (stdout, stderr) in zip(guests, outputs):
+        if guest.returncode != 0:
+            raise Error('guest failed with %d:\n%s' %
+                        (guest.returncode, stderr.decode()))
+        sys.stdout.write(stdout.decode())
+
+    if cpu_time > run_time * options.max_cpu_fraction:
+        raise Error('%d guests used %.2fs of CPU time in %.2fs' %
+                    (options.guests, cpu_time, run_time))
+    return 0
+
+
+if __name__ == '__main__':
+    try:
+        sys.exit(main(sys.argv[1:]))
+    except Error as e:
+        sys.stderr.write(str(e) + '\n')
+        sys.exit(1)